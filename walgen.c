@@ -1,8 +1,42 @@
 #include <stdio.h>
 #include "wallet_gen.h"
 #include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 
-int main()
+static double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_output(const char *path)
+{
+	if (!path || strcmp(path, "-") == 0)
+	{
+		return STDOUT_FILENO;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+	{
+		perror(path);
+	}
+	return fd;
+}
+
+static int cmd_single(void)
 {
 	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
 	unsigned char address[ETH_ADDRESS_SIZE];
@@ -26,4 +60,2716 @@ int main()
 		printf("%02x", address[i]);
 	}
 	printf("\n");
+	return 0;
+}
+
+// What the huge-page layer actually obtained, largest allocation state
+static void print_huge_stats(void)
+{
+	struct eth_huge_stats stats;
+	eth_huge_stats(&stats);
+	fprintf(stderr, "Huge pages (%s requested):", eth_huge_pages_name(eth_huge_pages_mode()));
+	for (int i = 0; i < ETH_PAGES_KINDS; i++)
+	{
+		if (stats.peak[i])
+		{
+			fprintf(stderr, " %.1f MB on %s", stats.peak[i] / 1048576.0, eth_huge_pages_name(i));
+		}
+	}
+	fprintf(stderr, ", %lu fallbacks\n", stats.fallbacks);
+}
+
+static int parse_writer_backend(const char *name)
+{
+	static const char *const names[] = {"auto", "uring", "pwritev"};
+	for (int i = 0; i < 3; i++)
+	{
+		if (strcmp(names[i], name) == 0)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void print_writer_stats(const struct eth_writer *writer)
+{
+	struct eth_writer_stats stats;
+	eth_writer_stats(writer, &stats);
+	fprintf(stderr, "Writer: %s%s, %llu writes, up to %u in flight, %llu stalls\n", eth_writer_backend(writer),
+		stats.direct ? " + O_DIRECT" : "", stats.writes, stats.max_in_flight, stats.stalls);
+}
+
+static void print_tune_params(const struct eth_tune_params *p)
+{
+	fprintf(stderr, "Tuned for %s (%u CPUs)%s: kernel %s, %u lanes, batch %zu, ring %zu, %.0f wallets/s\n",
+		p->cpu_model, p->cpus, p->cached ? " [cached]" : "", p->kernel, p->lanes, p->batch, p->ring_size, p->rate);
+}
+
+// Records in the ring walgen gen --shm creates (3.4 MB)
+#define SHM_RING_RECORDS 65536
+
+static int cmd_gen(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"lanes", required_argument, NULL, 'l'},
+		{"batch", required_argument, NULL, 'b'},
+		{"ring", required_argument, NULL, 'R'},
+		{"output", required_argument, NULL, 'o'},
+		{"raw", no_argument, NULL, 'r'},
+		{"no-pin", no_argument, NULL, 'P'},
+		{"shm", required_argument, NULL, 'S'},
+		{"multichain", no_argument, NULL, 'M'},
+		{"hugepages", required_argument, NULL, 'H'},
+		{"writer", required_argument, NULL, 'W'},
+		{"direct", no_argument, NULL, 'D'},
+		{"autotune", no_argument, NULL, 'A'},
+		{"retune", no_argument, NULL, 'T'},
+		{"entropy", required_argument, NULL, 'E'},
+		{"entropy-mix", no_argument, NULL, 'X'},
+		{"latency", required_argument, NULL, 'L'},
+		{NULL, 0, NULL, 0},
+	};
+	struct eth_pipeline_config config = {.count = 1, .format = ETH_OUTPUT_HEX, .pin = 1};
+	struct eth_writer_config writer = {.backend = -1};
+	const char *output = NULL;
+	const char *shm = NULL;
+	const char *entropy = NULL;
+	const char *latency = NULL;
+	int entropy_flags = 0;
+	int autotune = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:l:b:R:o:r", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			config.count = strtoull(optarg, NULL, 0);
+			break;
+		case 'l':
+			config.lanes = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.batch = strtoull(optarg, NULL, 0);
+			break;
+		case 'R':
+			config.ring_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			config.format = ETH_OUTPUT_RAW;
+			break;
+		case 'P':
+			config.pin = 0;
+			break;
+		case 'S':
+			shm = optarg;
+			break;
+		case 'M':
+			config.format = ETH_OUTPUT_MULTICHAIN;
+			break;
+		case 'H':
+			if (eth_huge_pages_select(optarg) != 0)
+			{
+				fprintf(stderr, "--hugepages takes off, thp, 2m or 1g\n");
+				return 2;
+			}
+			break;
+		case 'W':
+			writer.backend = parse_writer_backend(optarg);
+			if (writer.backend < 0)
+			{
+				fprintf(stderr, "--writer takes auto, uring or pwritev\n");
+				return 2;
+			}
+			break;
+		case 'D':
+			writer.direct = 1;
+			if (writer.backend < 0)
+			{
+				writer.backend = ETH_WRITER_AUTO;
+			}
+			break;
+		case 'A':
+			autotune = autotune ? autotune : 1;
+			break;
+		case 'T':
+			autotune = 2;
+			break;
+		case 'E':
+			entropy = optarg;
+			break;
+		case 'X':
+			entropy_flags |= ETH_ENTROPY_MIX_OS;
+			break;
+		case 'L':
+			latency = optarg;
+			break;
+		default:
+			return 2;
+		}
+	}
+
+	// Explicit -l/-b/--ring still win over tuned values
+	if (autotune)
+	{
+		struct eth_tune_params tune;
+		if (eth_autotune(NULL, autotune == 2, &tune) != 0)
+		{
+			fprintf(stderr, "Autotuning failed\n");
+			return 1;
+		}
+		print_tune_params(&tune);
+	}
+
+	// After tuning, whose trial keys must not come out of the entropy file
+	if (entropy)
+	{
+		struct eth_entropy_source source;
+		if (eth_entropy_file_open(entropy, entropy_flags, &source) != 0 || eth_entropy_install(&source) != 0)
+		{
+			fprintf(stderr, "Cannot use %s as entropy source (missing, used up or unreadable ledger)\n", entropy);
+			return 1;
+		}
+	}
+
+	if (shm)
+	{
+		config.shm = eth_shm_ring_create(shm, SHM_RING_RECORDS);
+		if (!config.shm)
+		{
+			fprintf(stderr, "Cannot create shared-memory ring %s (does it exist already?)\n", shm);
+			return 1;
+		}
+		config.fd = -1;
+	}
+	else
+	{
+		config.fd = open_output(output);
+		if (config.fd < 0)
+		{
+			return 1;
+		}
+		if (writer.backend >= 0)
+		{
+			writer.fd = config.fd;
+			config.writer = eth_writer_create(&writer);
+			if (!config.writer)
+			{
+				fprintf(stderr, "Cannot set up the %s writer\n", writer.backend == ETH_WRITER_URING ? "io_uring" : "output");
+				return 1;
+			}
+		}
+	}
+
+	double start = now_seconds();
+	int sc = generate_eth_wallets_pipeline(&config);
+	if (config.writer)
+	{
+		if (eth_writer_finish(config.writer) != 0)
+		{
+			sc = -1;
+		}
+	}
+	if (config.shm)
+	{
+		// Keep the name until a consumer has taken everything
+		eth_shm_ring_close(config.shm);
+		if (sc == 0)
+		{
+			eth_shm_ring_drain(config.shm, -1);
+		}
+		eth_shm_ring_free(config.shm);
+	}
+	double elapsed = now_seconds() - start;
+	if (config.fd >= 0 && config.fd != STDOUT_FILENO)
+	{
+		close(config.fd);
+	}
+	if (sc != 0)
+	{
+		fprintf(stderr, "Pipelined generation failed%s\n", entropy ? " (entropy source exhausted?)" : "");
+		eth_writer_free(config.writer);
+		return 1;
+	}
+	if (entropy)
+	{
+		fprintf(stderr, "%llu bytes drawn from %s\n", eth_entropy_used(), entropy);
+		eth_entropy_install(NULL);
+	}
+	fprintf(stderr, "%zu wallets in %.3f s (%.0f wallets/s)\n",
+		config.count, elapsed, elapsed > 0 ? config.count / elapsed : 0.0);
+	if (eth_huge_pages_mode() != ETH_HUGE_OFF)
+	{
+		print_huge_stats();
+	}
+	if (config.writer)
+	{
+		print_writer_stats(config.writer);
+		eth_writer_free(config.writer);
+	}
+	// Output flushes, once every writer thread has finished
+	if (latency && eth_latency_expose_file(latency) != 0)
+	{
+		fprintf(stderr, "Cannot write latency metrics to %s\n", latency);
+		return 1;
+	}
+	return 0;
+}
+
+static void print_hex(const char *label, const unsigned char *buf, size_t len)
+{
+	printf("%s0x", label);
+	for (size_t i = 0; i < len; i++)
+	{
+		printf("%02x", buf[i]);
+	}
+	printf("\n");
+}
+
+// Case-sensitive patterns are shown in the EIP-55 form they were matched on
+static void print_result(const struct eth_search_result *result, const struct eth_search_pattern *pattern)
+{
+	int checksum = 0;
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		checksum |= pattern->case_mask[i];
+	}
+	print_hex("Private Key: ", result->priv_key, ETH_PRIV_KEY_SIZE);
+	if (checksum)
+	{
+		char eip55[ETH_EIP55_SIZE];
+		eth_address_eip55(result->address, 1, eip55);
+		printf("Address: %.*s\n", ETH_EIP55_SIZE, eip55);
+	}
+	else
+	{
+		print_hex("Address: ", result->address, ETH_ADDRESS_SIZE);
+	}
+}
+
+static const struct option search_options[] = {
+	{"prefix", required_argument, NULL, 'p'},
+	{"suffix", required_argument, NULL, 's'},
+	{"threads", required_argument, NULL, 't'},
+	{"listen", required_argument, NULL, 'L'},
+	{"connect", required_argument, NULL, 'C'},
+	{"checkpoint", required_argument, NULL, 'c'},
+	{"interval", required_argument, NULL, 'i'},
+	{"resume", required_argument, NULL, 'r'},
+	{"eip55", no_argument, NULL, 'E'},
+	{NULL, 0, NULL, 0},
+};
+
+struct search_args
+{
+	const char *prefix;
+	const char *suffix;
+	int eip55;
+	const char *address;
+	unsigned int threads;
+	const char *checkpoint;
+	unsigned int interval;
+	const char *resume;
+};
+
+static int parse_search_args(int argc, char **argv, struct search_args *args)
+{
+	int c;
+	memset(args, 0, sizeof(*args));
+	while ((c = getopt_long(argc, argv, "p:s:t:", search_options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'p':
+			args->prefix = optarg;
+			break;
+		case 's':
+			args->suffix = optarg;
+			break;
+		case 't':
+			args->threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+		case 'C':
+			args->address = optarg;
+			break;
+		case 'c':
+			args->checkpoint = optarg;
+			break;
+		case 'i':
+			args->interval = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			args->resume = optarg;
+			break;
+		case 'E':
+			args->eip55 = 1;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int compile_pattern(const struct search_args *args, struct eth_search_pattern *pattern)
+{
+	int ret = args->eip55 ? eth_search_pattern_compile_eip55(pattern, args->prefix, args->suffix)
+		: eth_search_pattern_compile(pattern, args->prefix, args->suffix);
+	if ((!args->prefix && !args->suffix) || ret != 0)
+	{
+		fprintf(stderr, "Invalid or missing --prefix/--suffix hex pattern\n");
+		return -1;
+	}
+	fprintf(stderr, "Difficulty: %.0f attempts per hit on average\n", eth_search_pattern_difficulty(pattern));
+	return 0;
+}
+
+static volatile sig_atomic_t interrupted;
+
+static void on_interrupt(int sig)
+{
+	(void)sig;
+	interrupted = 1;
+}
+
+static int cmd_search(int argc, char **argv)
+{
+	struct search_args args;
+	struct eth_search_pattern pattern;
+	struct eth_search *search;
+	if (parse_search_args(argc, argv, &args) != 0)
+	{
+		return 2;
+	}
+
+	// Interrupting still frees the search, which writes a final checkpoint
+	signal(SIGINT, on_interrupt);
+	signal(SIGTERM, on_interrupt);
+
+	struct eth_search_checkpoint *checkpoint = calloc(1, sizeof(*checkpoint));
+	if (!checkpoint)
+	{
+		return 1;
+	}
+	if (args.resume)
+	{
+		if (eth_search_checkpoint_load(args.resume, checkpoint) != 0)
+		{
+			fprintf(stderr, "Cannot load checkpoint %s\n", args.resume);
+			free(checkpoint);
+			return 1;
+		}
+		fprintf(stderr, "Resuming after %.0f s, best so far %d nibbles\n", checkpoint->elapsed, checkpoint->best_score);
+		pattern = checkpoint->pattern;
+		search = eth_search_resume(checkpoint, args.checkpoint ? args.checkpoint : args.resume, args.interval);
+	}
+	else
+	{
+		struct eth_search_config config;
+		memset(&config, 0, sizeof(config));
+		if (compile_pattern(&args, &config.pattern) != 0)
+		{
+			free(checkpoint);
+			return 2;
+		}
+		pattern = config.pattern;
+		config.threads = args.threads;
+		config.checkpoint_path = args.checkpoint;
+		config.checkpoint_interval = args.interval;
+		search = eth_random_private_key(config.base_key) == 0 ? eth_search_start(&config) : NULL;
+		memset(config.base_key, 0, sizeof(config.base_key));
+	}
+	if (!search)
+	{
+		fprintf(stderr, "Failed to start search\n");
+		free(checkpoint);
+		return 1;
+	}
+
+	struct eth_search_result result;
+	double start = now_seconds();
+	unsigned long long first = eth_search_attempts(search);
+	int found;
+	while (!(found = eth_search_poll(search, &result)) && !interrupted)
+	{
+		sleep(1);
+		double elapsed = now_seconds() - start;
+		eth_search_snapshot(search, checkpoint);
+		unsigned long long attempts = eth_search_attempts(search);
+		fprintf(stderr, "\r%llu attempts, %.0f/s, best %d nibbles   ",
+			attempts, (attempts - first) / elapsed, checkpoint->best_score);
+	}
+	fprintf(stderr, "\n");
+	eth_search_free(search);
+	memset(checkpoint, 0, sizeof(*checkpoint));
+	free(checkpoint);
+	if (found < 0)
+	{
+		fprintf(stderr, "Search failed\n");
+		return 1;
+	}
+	if (!found)
+	{
+		fprintf(stderr, "Interrupted\n");
+		return 130;
+	}
+	print_result(&result, &pattern);
+	return 0;
+}
+
+static void print_dist_status(const struct eth_dist_status *status, void *arg)
+{
+	(void)arg;
+	fprintf(stderr, "\r%u workers, %llu attempts, %.0f/s   ", status->workers, status->attempts, status->rate);
+}
+
+static int cmd_coordinate(int argc, char **argv)
+{
+	struct search_args args;
+	struct eth_search_pattern pattern;
+	if (parse_search_args(argc, argv, &args) != 0 || !args.address)
+	{
+		fprintf(stderr, "usage: walgen coordinate --listen ADDR --prefix HEX [--suffix HEX] [--eip55]\n");
+		return 2;
+	}
+	if (compile_pattern(&args, &pattern) != 0)
+	{
+		return 2;
+	}
+
+	struct eth_search_result result;
+	if (eth_dist_coordinate(args.address, &pattern, print_dist_status, NULL, &result) != 0)
+	{
+		fprintf(stderr, "\nCoordinator failed\n");
+		return 1;
+	}
+	fprintf(stderr, "\n");
+	print_result(&result, &pattern);
+	return 0;
+}
+
+static int cmd_work(int argc, char **argv)
+{
+	struct search_args args;
+	if (parse_search_args(argc, argv, &args) != 0 || !args.address)
+	{
+		fprintf(stderr, "usage: walgen work --connect ADDR [-t THREADS]\n");
+		return 2;
+	}
+	int ret = eth_dist_work(args.address, args.threads);
+	if (ret == ETH_DIST_VERSION_MISMATCH)
+	{
+		fprintf(stderr, "Coordinator runs another walgen protocol version\n");
+		return 1;
+	}
+	if (ret != 0)
+	{
+		fprintf(stderr, "Worker failed or lost the coordinator\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int cmd_bench_sign(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"threads", required_argument, NULL, 't'},
+		{"typed", no_argument, NULL, 'T'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 100000;
+	unsigned int threads = 0;
+	int mode = ETH_SIGN_PERSONAL;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			mode = ETH_SIGN_TYPED;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	struct eth_signer *signer = eth_random_private_key(priv_key) == 0 ? eth_signer_create(priv_key) : NULL;
+	memset(priv_key, 0, sizeof(priv_key));
+
+	// Personal messages are order-book sized strings; typed items are struct hashes
+	const size_t msg_len = mode == ETH_SIGN_TYPED ? 32 : 96;
+	unsigned char *messages = malloc(count * msg_len);
+	struct eth_sign_item *items = malloc(count * sizeof(*items));
+	unsigned char *sigs = malloc(count * ETH_SIGNATURE_SIZE);
+	if (!signer || !messages || !items || !sigs)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		memset(messages + i * msg_len, 'a' + (int)(i % 26), msg_len);
+		items[i].data = messages + i * msg_len;
+		items[i].len = msg_len;
+	}
+
+	struct eth_eip712_domain domain = {.name = "walgen", .version = "1", .has_chain_id = 1, .chain_id = 1};
+	unsigned char separator[32];
+	eth_eip712_domain_separator(&domain, separator);
+
+	double start = now_seconds();
+	for (size_t i = 0; i < count; i++)
+	{
+		eth_sign(signer, mode, separator, &items[i], sigs + i * ETH_SIGNATURE_SIZE);
+	}
+	double single = now_seconds() - start;
+
+	start = now_seconds();
+	int sc = eth_sign_batch(signer, mode, separator, items, count, sigs, threads);
+	double batch = now_seconds() - start;
+
+	printf("%s signatures: %zu\n", mode == ETH_SIGN_TYPED ? "EIP-712" : "EIP-191", count);
+	printf("eth_sign loop:  %.0f signatures/s\n", count / single);
+	printf("eth_sign_batch: %.0f signatures/s%s\n", count / batch, sc == 0 ? "" : " (errors)");
+
+	eth_signer_destroy(signer);
+	free(messages);
+	free(items);
+	free(sigs);
+	return sc == 0 ? 0 : 1;
+}
+
+static int cmd_bench_recover(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"threads", required_argument, NULL, 't'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 100000;
+	unsigned int threads = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	struct eth_signer *signer = eth_random_private_key(priv_key) == 0 ? eth_signer_create(priv_key) : NULL;
+	memset(priv_key, 0, sizeof(priv_key));
+
+	unsigned char *hashes = malloc(count * 32);
+	struct eth_sign_item *items = malloc(count * sizeof(*items));
+	unsigned char *sigs = malloc(count * ETH_SIGNATURE_SIZE);
+	unsigned char *addresses = malloc(count * ETH_ADDRESS_SIZE);
+	unsigned char *expected = malloc(count * ETH_ADDRESS_SIZE);
+	if (!signer || !hashes || !items || !sigs || !addresses || !expected)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		for (int b = 0; b < 32; b++)
+		{
+			hashes[i * 32 + b] = (unsigned char)(i >> (8 * (b % 8))) ^ (unsigned char)b;
+		}
+		items[i].data = hashes + i * 32;
+		items[i].len = 32;
+		eth_signer_address(signer, expected + i * ETH_ADDRESS_SIZE);
+	}
+	if (eth_sign_batch(signer, ETH_SIGN_HASH, NULL, items, count, sigs, threads) != 0)
+	{
+		fprintf(stderr, "Failed to sign the input set\n");
+		return 1;
+	}
+
+	size_t naive_failures = 0;
+	double start = now_seconds();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (eth_ecrecover(hashes + i * 32, sigs + i * ETH_SIGNATURE_SIZE, addresses + i * ETH_ADDRESS_SIZE) != 0 ||
+			memcmp(addresses + i * ETH_ADDRESS_SIZE, expected + i * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE) != 0)
+		{
+			naive_failures++;
+		}
+	}
+	double single = now_seconds() - start;
+
+	size_t failures = 0;
+	start = now_seconds();
+	int sc = eth_ecrecover_batch(hashes, sigs, count, addresses, expected, NULL, &failures, threads);
+	double batch = now_seconds() - start;
+
+	printf("signatures: %zu\n", count);
+	printf("eth_ecrecover loop:  %.0f recoveries/s (%zu failed)\n", count / single, naive_failures);
+	printf("eth_ecrecover_batch: %.0f recoveries/s (%zu failed)\n", count / batch, failures);
+
+	eth_signer_destroy(signer);
+	free(hashes);
+	free(items);
+	free(sigs);
+	free(addresses);
+	free(expected);
+	return sc == 0 && failures == 0 && naive_failures == 0 ? 0 : 1;
+}
+
+static int cmd_addresses(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"input", required_argument, NULL, 'i'},
+		{"output", required_argument, NULL, 'o'},
+		{"threads", required_argument, NULL, 't'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *input = NULL;
+	const char *output = NULL;
+	unsigned int threads = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "i:o:t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'i':
+			input = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 't':
+			threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!input || !output)
+	{
+		return 2;
+	}
+
+	size_t count = 0, failures = 0;
+	double start = now_seconds();
+	if (eth_pubkey_file_to_addresses(input, output, &count, &failures, threads) != 0)
+	{
+		fprintf(stderr, "Failed to convert %s\n", input);
+		return 1;
+	}
+	double elapsed = now_seconds() - start;
+	fprintf(stderr, "%zu keys, %zu invalid, %.0f keys/s\n", count, failures, elapsed > 0 ? count / elapsed : 0.0);
+	return failures == 0 ? 0 : 1;
+}
+
+static void audit_report(void *arg, size_t record, int problem, const unsigned char *expected,
+	const unsigned char *derived)
+{
+	(void)arg;
+	switch (problem)
+	{
+	case ETH_AUDIT_MISMATCH:
+		printf("record %zu: mismatch\n", record);
+		print_hex("  stored:  ", expected, ETH_ADDRESS_SIZE);
+		print_hex("  derived: ", derived, ETH_ADDRESS_SIZE);
+		break;
+	case ETH_AUDIT_INVALID_KEY:
+		printf("record %zu: invalid private key\n", record);
+		print_hex("  stored:  ", expected, ETH_ADDRESS_SIZE);
+		break;
+	default:
+		printf("record %zu: malformed\n", record);
+		break;
+	}
+}
+
+static void audit_progress(void *arg, size_t done, size_t total)
+{
+	double *start = arg;
+	double elapsed = now_seconds() - *start;
+	fprintf(stderr, "\r%zu/%zu records, %.0f/s", done, total, elapsed > 0 ? done / elapsed : 0.0);
+}
+
+static int cmd_audit(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"threads", required_argument, NULL, 't'},
+		{"quiet", no_argument, NULL, 'q'},
+		{NULL, 0, NULL, 0},
+	};
+	unsigned int threads = 0;
+	int quiet = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "t:q", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 't':
+			threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (optind != argc - 1)
+	{
+		return 2;
+	}
+
+	struct eth_audit_result result;
+	double start = now_seconds();
+	if (eth_audit_file(argv[optind], threads, audit_report, quiet ? NULL : audit_progress, &start, &result) != 0)
+	{
+		fprintf(stderr, "Failed to audit %s\n", argv[optind]);
+		return 1;
+	}
+	fprintf(stderr, "%s%zu records, %zu mismatches, %zu invalid\n", quiet ? "" : "\n",
+		result.records, result.mismatches, result.invalid);
+	return result.mismatches == 0 && result.invalid == 0 ? 0 : 1;
+}
+
+// Duplicate report: one line per repeated record
+static void sort_report(void *arg, const unsigned char *record, const unsigned char *first)
+{
+	FILE *f = arg;
+	fprintf(f, "0x");
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		fprintf(f, "%02x", record[ETH_PRIV_KEY_SIZE + i]);
+	}
+	fprintf(f, " %s\n", memcmp(record, first, ETH_PRIV_KEY_SIZE) == 0 ? "repeated-record" : "different-key");
+}
+
+static int cmd_sort(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"output", required_argument, NULL, 'o'},
+		{"tmp", required_argument, NULL, 'T'},
+		{"memory", required_argument, NULL, 'm'},
+		{"threads", required_argument, NULL, 't'},
+		{"fan-in", required_argument, NULL, 'k'},
+		{"dedup", no_argument, NULL, 'd'},
+		{"report", required_argument, NULL, 'R'},
+		{NULL, 0, NULL, 0},
+	};
+	struct eth_sort_config config;
+	const char *report = NULL;
+	int c;
+
+	memset(&config, 0, sizeof(config));
+	while ((c = getopt_long(argc, argv, "o:m:t:k:d", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'o':
+			config.output = optarg;
+			break;
+		case 'T':
+			config.tmp_dir = optarg;
+			break;
+		case 'm':
+			config.memory = strtoull(optarg, NULL, 0) << 20;
+			break;
+		case 't':
+			config.threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'k':
+			config.fan_in = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			config.dedup = 1;
+			break;
+		case 'R':
+			report = optarg;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!config.output || optind != argc - 1)
+	{
+		fprintf(stderr, "usage: walgen sort -o OUTPUT [--tmp DIR] [-m MB] [-t THREADS] [--fan-in N] "
+			"[--dedup] [--report FILE] INPUT\n");
+		return 2;
+	}
+	config.input = argv[optind];
+
+	FILE *f = stderr;
+	if (report)
+	{
+		f = fopen(report, "w");
+		if (!f)
+		{
+			perror(report);
+			return 1;
+		}
+	}
+	struct eth_sort_result result;
+	double start = now_seconds();
+	int ret = eth_sort_records(&config, sort_report, f, &result);
+	double elapsed = now_seconds() - start;
+	if (f != stderr)
+	{
+		fclose(f);
+	}
+	if (ret != 0)
+	{
+		fprintf(stderr, "Failed to sort %s (not raw 52-byte records, output same as input, or an I/O error)\n", config.input);
+		return 1;
+	}
+	fprintf(stderr, "%zu records in %.1f s (%.0f MB/s), %zu runs, %u merge passes\n", result.records, elapsed,
+		elapsed > 0 ? result.records * (double)ETH_WALLET_RECORD_SIZE / 1048576.0 / elapsed : 0.0, result.runs,
+		result.merge_passes);
+	fprintf(stderr, "%zu duplicate addresses (%zu repeated records), %zu records written\n",
+		result.duplicate_addresses, result.duplicate_keys, result.written);
+	return result.duplicate_addresses == 0 ? 0 : 1;
+}
+
+static int cmd_bench_kernels(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 1000000;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+
+	const char *chosen = eth_kernel_name();
+	unsigned char block[64] = {0};
+	unsigned char hash[32];
+	char hex[2 * sizeof(block)];
+
+	// Single-message hashing and hex encoding are the same in every variant
+	double start = now_seconds();
+	for (size_t i = 0; i < count; i++)
+	{
+		eth_keccak256_64(block, hash);
+		memcpy(block, hash, sizeof(hash));
+	}
+	double keccak = now_seconds() - start;
+
+	start = now_seconds();
+	for (size_t i = 0; i < count; i++)
+	{
+		eth_hex_encode(block, sizeof(block), hex);
+		block[i % sizeof(block)] ^= (unsigned char)hex[i % sizeof(hex)];
+	}
+	double encode = now_seconds() - start;
+
+	printf("selected kernel: %s\n", chosen);
+	printf("%-10s keccak256(64 B): %.2f M/s   hex: %.0f MB/s\n", "all", count / keccak / 1e6,
+		count * sizeof(block) / encode / 1e6);
+
+	// Multi-lane hashing, on one thread of selector mining for a target
+	// that is never met
+	struct eth_selector_config config = {
+		.name = "bench",
+		.params = "(address,uint256)",
+		.threads = 1,
+		.max_attempts = count,
+	};
+	eth_selector_target(&config, 32, NULL);
+	for (unsigned int v = 0; eth_kernel_variant(v); v++)
+	{
+		const char *name = eth_kernel_variant(v);
+		struct eth_selector_result result;
+
+		if (eth_kernel_select(name) != 0)
+		{
+			printf("%-10s unsupported on this CPU\n", name);
+			continue;
+		}
+		start = now_seconds();
+		if (eth_selector_mine(&config, &result) < 0)
+		{
+			printf("%-10s failed\n", name);
+			continue;
+		}
+		printf("%-10s keccak256 lanes: %.2f M/s\n", name, result.attempts / (now_seconds() - start) / 1e6);
+	}
+	eth_kernel_select(chosen);
+	return 0;
+}
+
+// Every available EC and Keccak backend on one thread, each checked
+// against the defaults (libsecp256k1 and the built-in kernels)
+static int cmd_bench_backends(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 20000;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+
+	const char *chosen_ec = eth_backend_name(ETH_BACKEND_EC);
+	const char *chosen_keccak = eth_backend_name(ETH_BACKEND_KECCAK);
+	size_t record = ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE;
+	unsigned char *records = malloc(count * record);
+	unsigned char *pubkeys = malloc(count * 64);
+	unsigned char *expected = malloc(count * ETH_ADDRESS_SIZE);
+	unsigned char *addresses = malloc(count * ETH_ADDRESS_SIZE);
+	struct eth_generator *gen = eth_generator_create();
+	int ret = 1;
+	if (!records || !pubkeys || !expected || !addresses || !gen)
+	{
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	printf("selected: ec %s, keccak %s\n", chosen_ec, chosen_keccak);
+	eth_backend_select(ETH_BACKEND_KECCAK, "kernels");
+	for (unsigned int v = 0; eth_backend_variant(ETH_BACKEND_EC, v); v++)
+	{
+		const char *name = eth_backend_variant(ETH_BACKEND_EC, v);
+		if (eth_backend_select(ETH_BACKEND_EC, name) != 0)
+		{
+			printf("ec     %-10s unavailable\n", name);
+			continue;
+		}
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++)
+		{
+			if (eth_generator_fill(gen, records + i * record, records + i * record + ETH_PRIV_KEY_SIZE, 1) != 0)
+			{
+				fprintf(stderr, "%s failed\n", name);
+				goto out;
+			}
+		}
+		double elapsed = now_seconds() - start;
+
+		struct eth_audit_result audit;
+		eth_backend_select(ETH_BACKEND_EC, "secp256k1");
+		if (eth_audit_buffer(records, count * record, 0, NULL, NULL, NULL, &audit) != 0)
+		{
+			goto out;
+		}
+		printf("ec     %-10s %.0f keys/s   %s\n", name, count / elapsed,
+			audit.mismatches || audit.invalid ? "MISMATCH" : "ok");
+	}
+
+	// Hashing needs no valid points, any 64 bytes will do
+	for (size_t i = 0; i < count * 64; i += ETH_PRIV_KEY_SIZE)
+	{
+		if (eth_random_private_key(pubkeys + i) != 0)
+		{
+			goto out;
+		}
+	}
+	eth_pubkey64_to_addresses(pubkeys, count, expected);
+	for (unsigned int v = 0; eth_backend_variant(ETH_BACKEND_KECCAK, v); v++)
+	{
+		const char *name = eth_backend_variant(ETH_BACKEND_KECCAK, v);
+		if (eth_backend_select(ETH_BACKEND_KECCAK, name) != 0)
+		{
+			printf("keccak %-10s unavailable\n", name);
+			continue;
+		}
+		double start = now_seconds();
+		if (eth_pubkey64_to_addresses(pubkeys, count, addresses) != 0)
+		{
+			fprintf(stderr, "%s failed\n", name);
+			goto out;
+		}
+		double elapsed = now_seconds() - start;
+		printf("keccak %-10s %.2f M addresses/s   %s\n", name, count / elapsed / 1e6,
+			memcmp(addresses, expected, count * ETH_ADDRESS_SIZE) ? "MISMATCH" : "ok");
+	}
+	ret = 0;
+
+out:
+	eth_backend_select(ETH_BACKEND_EC, chosen_ec);
+	eth_backend_select(ETH_BACKEND_KECCAK, chosen_keccak);
+	eth_generator_destroy(gen);
+	if (records)
+	{
+		memset(records, 0, count * record);
+	}
+	free(records);
+	free(pubkeys);
+	free(expected);
+	free(addresses);
+	return ret;
+}
+
+// Consecutive-key address derivation per kernel variant, each result
+// cross-checked against full multiplications by the audit path
+static int cmd_bench_ec(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"check", required_argument, NULL, 'k'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 100000;
+	size_t check = 1000;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:k:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'k':
+			check = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+	if (check > count)
+	{
+		check = count;
+	}
+
+	const char *chosen = eth_kernel_name();
+	unsigned char start_key[ETH_PRIV_KEY_SIZE];
+	unsigned char first[ETH_ADDRESS_SIZE];
+	unsigned char *addresses = malloc(count * ETH_ADDRESS_SIZE);
+	unsigned char *records = malloc(check * (ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE) + 1);
+	struct eth_generator *gen = eth_generator_create();
+	int ret = 1;
+
+	if (!addresses || !records || !gen || eth_generator_fill(gen, start_key, first, 1) != 0)
+	{
+		fprintf(stderr, "setup failed\n");
+		goto out;
+	}
+
+	// Baseline: one full multiplication per key
+	double start = now_seconds();
+	size_t full = count < 10000 ? count : 10000;
+	for (size_t i = 0; i < full; i++)
+	{
+		if (eth_generator_fill(gen, records, records + ETH_PRIV_KEY_SIZE, 1) != 0)
+		{
+			goto out;
+		}
+	}
+	printf("selected kernel: %s\n", chosen);
+	printf("%-10s %.0f keys/s (full multiplication)\n", "baseline", full / (now_seconds() - start));
+
+	ret = 0;
+	for (unsigned int v = 0; eth_kernel_variant(v); v++)
+	{
+		const char *name = eth_kernel_variant(v);
+		struct eth_audit_result result;
+
+		if (eth_kernel_select(name) != 0)
+		{
+			printf("%-10s unsupported on this CPU\n", name);
+			continue;
+		}
+		start = now_seconds();
+		if (eth_sequential_addresses(start_key, count, addresses) != 0)
+		{
+			printf("%-10s failed\n", name);
+			ret = 1;
+			continue;
+		}
+		double elapsed = now_seconds() - start;
+
+		unsigned char key[ETH_PRIV_KEY_SIZE];
+		memcpy(key, start_key, sizeof(key));
+		for (size_t i = 0; i < check; i++)
+		{
+			unsigned char *record = records + i * (ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE);
+			memcpy(record, key, ETH_PRIV_KEY_SIZE);
+			memcpy(record + ETH_PRIV_KEY_SIZE, addresses + i * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+			for (int j = ETH_PRIV_KEY_SIZE - 1; j >= 0 && ++key[j] == 0; j--)
+			{
+			}
+		}
+		if (eth_audit_buffer(records, check * (ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE), 0, NULL, NULL, NULL,
+			&result) != 0 || result.mismatches || result.invalid)
+		{
+			ret = 1;
+		}
+		printf("%-10s %.0f keys/s   checked %zu, %zu mismatched\n", name, count / elapsed, check,
+			result.mismatches + result.invalid);
+	}
+	eth_kernel_select(chosen);
+
+out:
+	memset(start_key, 0, sizeof(start_key));
+	if (records)
+	{
+		memset(records, 0, check * (ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE));
+	}
+	free(records);
+	free(addresses);
+	eth_generator_destroy(gen);
+	return ret;
+}
+
+static struct eth_dispenser *active_dispenser;
+
+static void on_dispense_interrupt(int sig)
+{
+	(void)sig;
+	eth_dispenser_stop(active_dispenser);
+}
+
+static void print_dispense_status(const struct eth_dispenser_status *status, void *arg)
+{
+	(void)arg;
+	fprintf(stderr, "\rpool %zu/%zu, %u clients, %llu served, %llu empty waits   ", status->available,
+		status->capacity, status->clients, status->served, status->empty_waits);
+}
+
+static int cmd_dispense(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"listen", required_argument, NULL, 'L'},
+		{"pool", required_argument, NULL, 'p'},
+		{"low", required_argument, NULL, 'l'},
+		{"high", required_argument, NULL, 'h'},
+		{"threads", required_argument, NULL, 't'},
+		{"hugepages", required_argument, NULL, 'H'},
+		{NULL, 0, NULL, 0},
+	};
+	struct eth_dispenser_config config;
+	const char *path = NULL;
+	int c;
+
+	memset(&config, 0, sizeof(config));
+	while ((c = getopt_long(argc, argv, "L:p:l:h:t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'L':
+			path = optarg;
+			break;
+		case 'p':
+			config.capacity = strtoull(optarg, NULL, 0);
+			break;
+		case 'l':
+			config.low_water = strtoull(optarg, NULL, 0);
+			break;
+		case 'h':
+			config.high_water = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			config.threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			if (eth_huge_pages_select(optarg) != 0)
+			{
+				return 2;
+			}
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!path)
+	{
+		fprintf(stderr, "usage: walgen dispense --listen PATH [--pool N] [--low N] [--high N] [-t THREADS] "
+			"[--hugepages MODE]\n");
+		return 2;
+	}
+
+	active_dispenser = eth_dispenser_create(&config);
+	if (!active_dispenser)
+	{
+		fprintf(stderr, "Failed to create the wallet pool\n");
+		return 1;
+	}
+	struct eth_dispenser_status status;
+	eth_dispenser_stats(active_dispenser, &status);
+	if (!status.locked)
+	{
+		fprintf(stderr, "Warning: could not mlock the pool (see ulimit -l); it may be swapped out\n");
+	}
+	if (eth_huge_pages_mode() != ETH_HUGE_OFF)
+	{
+		fprintf(stderr, "Pool on %s pages\n", eth_huge_pages_name(status.pages));
+	}
+	signal(SIGINT, on_dispense_interrupt);
+	signal(SIGTERM, on_dispense_interrupt);
+
+	int ret = eth_dispenser_serve(active_dispenser, path, print_dispense_status, NULL);
+	fprintf(stderr, "\n");
+	if (ret != 0)
+	{
+		fprintf(stderr, "Cannot listen on %s, or wallet generation failed\n", path);
+	}
+	eth_dispenser_destroy(active_dispenser);
+	return ret != 0;
+}
+
+struct dispense_client
+{
+	const char *path;
+	size_t requests;
+	size_t wallets;
+	double *latencies;
+	int failed;
+};
+
+static void *dispense_client_main(void *arg)
+{
+	struct dispense_client *client = arg;
+	unsigned char records[ETH_DISPENSE_MAX * ETH_WALLET_RECORD_SIZE];
+	int fd = eth_dispenser_connect(client->path);
+
+	client->failed = fd < 0;
+	for (size_t i = 0; i < client->requests && !client->failed; i++)
+	{
+		double start = now_seconds();
+		client->failed = eth_dispenser_request(fd, records, client->wallets) != 0;
+		client->latencies[i] = now_seconds() - start;
+	}
+	memset(records, 0, sizeof(records));
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+// Handout latency as a client sees it, socket round trip included
+static int cmd_bench_dispense(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"connect", required_argument, NULL, 'C'},
+		{"count", required_argument, NULL, 'n'},
+		{"clients", required_argument, NULL, 'c'},
+		{"batch", required_argument, NULL, 'b'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *path = NULL;
+	size_t requests = 100000;
+	unsigned int nclients = 1;
+	size_t wallets = 1;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "C:n:c:b:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'C':
+			path = optarg;
+			break;
+		case 'n':
+			requests = strtoull(optarg, NULL, 0);
+			break;
+		case 'c':
+			nclients = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			wallets = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!path || nclients == 0 || requests < nclients || wallets == 0 || wallets > ETH_DISPENSE_MAX)
+	{
+		fprintf(stderr, "usage: walgen bench-dispense --connect PATH [-n REQUESTS] [-c CLIENTS] [-b WALLETS]\n");
+		return 2;
+	}
+
+	size_t per_client = requests / nclients;
+	struct dispense_client *clients = calloc(nclients, sizeof(*clients));
+	pthread_t *tids = calloc(nclients, sizeof(*tids));
+	double *latencies = calloc(per_client * nclients, sizeof(*latencies));
+	if (!clients || !tids || !latencies)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	double start = now_seconds();
+	unsigned int started = 0;
+	for (; started < nclients; started++)
+	{
+		clients[started].path = path;
+		clients[started].requests = per_client;
+		clients[started].wallets = wallets;
+		clients[started].latencies = latencies + started * per_client;
+		if (pthread_create(&tids[started], NULL, dispense_client_main, &clients[started]) != 0)
+		{
+			break;
+		}
+	}
+	int failed = started < nclients;
+	for (unsigned int i = 0; i < started; i++)
+	{
+		pthread_join(tids[i], NULL);
+		failed |= clients[i].failed;
+	}
+	double elapsed = now_seconds() - start;
+	if (failed)
+	{
+		fprintf(stderr, "Requests to %s failed\n", path);
+		return 1;
+	}
+
+	size_t total = per_client * started;
+	qsort(latencies, total, sizeof(*latencies), compare_double);
+	printf("%zu requests of %zu wallets from %u clients: %.0f requests/s, %.0f wallets/s\n", total, wallets,
+		nclients, total / elapsed, total * wallets / elapsed);
+	printf("latency us: p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", latencies[total / 2] * 1e6,
+		latencies[total * 90 / 100] * 1e6, latencies[total * 99 / 100] * 1e6, latencies[total * 999 / 1000] * 1e6,
+		latencies[total - 1] * 1e6);
+	free(latencies);
+	free(tids);
+	free(clients);
+	return 0;
+}
+
+// Consumer side of gen --shm: the same hex lines or raw records gen writes
+static int cmd_shm_read(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"output", required_argument, NULL, 'o'},
+		{"raw", no_argument, NULL, 'r'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *output = NULL;
+	int raw = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "o:r", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			raw = 1;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (optind >= argc)
+	{
+		fprintf(stderr, "usage: walgen shm-read [-o FILE] [-r] NAME\n");
+		return 2;
+	}
+
+	struct eth_shm_ring *ring = eth_shm_ring_open(argv[optind]);
+	if (!ring)
+	{
+		fprintf(stderr, "Cannot open shared-memory ring %s\n", argv[optind]);
+		return 1;
+	}
+	FILE *out = stdout;
+	int fd = open_output(output);
+	if (fd < 0 || (fd != STDOUT_FILENO && !(out = fdopen(fd, "w"))))
+	{
+		eth_shm_ring_free(ring);
+		return 1;
+	}
+
+	const unsigned char *records;
+	size_t n, total = 0;
+	char line[ETH_WALLET_HEX_LINE_SIZE];
+	while ((n = eth_shm_ring_acquire(ring, 4096, &records, -1)) > 0)
+	{
+		for (size_t i = 0; i < n; i++)
+		{
+			const unsigned char *rec = records + i * ETH_WALLET_RECORD_SIZE;
+			if (raw)
+			{
+				fwrite(rec, ETH_WALLET_RECORD_SIZE, 1, out);
+				continue;
+			}
+			line[0] = '0';
+			line[1] = 'x';
+			eth_hex_encode(rec, ETH_PRIV_KEY_SIZE, line + 2);
+			memcpy(line + 2 + 2 * ETH_PRIV_KEY_SIZE, " 0x", 3);
+			eth_hex_encode(rec + ETH_PRIV_KEY_SIZE, ETH_ADDRESS_SIZE, line + 5 + 2 * ETH_PRIV_KEY_SIZE);
+			line[ETH_WALLET_HEX_LINE_SIZE - 1] = '\n';
+			fwrite(line, sizeof(line), 1, out);
+		}
+		eth_shm_ring_release(ring, n);
+		total += n;
+	}
+	memset(line, 0, sizeof(line));
+	int failed = fflush(out) != 0;
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+	eth_shm_ring_free(ring);
+	fprintf(stderr, "%zu wallets read\n", total);
+	return failed;
+}
+
+// Ring throughput between two processes: the parent publishes numbered
+// synthetic records, a forked child consumes them in place and checks the order
+static int cmd_bench_shm(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"ring", required_argument, NULL, 'R'},
+		{"batch", required_argument, NULL, 'b'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 50000000;
+	size_t capacity = SHM_RING_RECORDS;
+	size_t batch = 256;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:R:b:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'R':
+			capacity = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0 || batch == 0)
+	{
+		return 2;
+	}
+
+	char name[64];
+	snprintf(name, sizeof(name), "/walgen-bench-%d", (int)getpid());
+	struct eth_shm_ring *ring = eth_shm_ring_create(name, capacity);
+	if (!ring)
+	{
+		fprintf(stderr, "Cannot create shared-memory ring (capacity must be a power of two)\n");
+		return 1;
+	}
+
+	double start = now_seconds();
+	pid_t child = fork();
+	if (child < 0)
+	{
+		perror("fork");
+		eth_shm_ring_free(ring);
+		return 1;
+	}
+	if (child == 0)
+	{
+		struct eth_shm_ring *in = eth_shm_ring_open(name);
+		const unsigned char *records;
+		unsigned long long expect = 0;
+		size_t n;
+		if (!in)
+		{
+			_exit(1);
+		}
+		while ((n = eth_shm_ring_acquire(in, batch, &records, -1)) > 0)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				unsigned long long seq;
+				memcpy(&seq, records + i * ETH_WALLET_RECORD_SIZE, sizeof(seq));
+				if (seq != expect++)
+				{
+					_exit(1);
+				}
+			}
+			eth_shm_ring_release(in, n);
+		}
+		eth_shm_ring_free(in);
+		_exit(expect == count ? 0 : 1);
+	}
+
+	unsigned long long seq = 0;
+	while (seq < count)
+	{
+		unsigned char *slots;
+		size_t n = eth_shm_ring_reserve(ring, count - seq < batch ? count - seq : batch, &slots);
+		if (n == 0)
+		{
+			break;
+		}
+		for (size_t i = 0; i < n; i++, seq++)
+		{
+			memcpy(slots + i * ETH_WALLET_RECORD_SIZE, &seq, sizeof(seq));
+		}
+		eth_shm_ring_commit(ring, n);
+	}
+	eth_shm_ring_close(ring);
+	int status = 1;
+	waitpid(child, &status, 0);
+	double elapsed = now_seconds() - start;
+	eth_shm_ring_free(ring);
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+	{
+		fprintf(stderr, "Consumer saw missing or out-of-order records\n");
+		return 1;
+	}
+	printf("%zu records (%zu B) across processes in %.3f s: %.1f M records/s, %.0f MB/s\n", count,
+		(size_t)ETH_WALLET_RECORD_SIZE, elapsed, count / elapsed / 1e6, count * ETH_WALLET_RECORD_SIZE / elapsed / 1e6);
+	return 0;
+}
+
+static int cmd_selector(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"name", required_argument, NULL, 'N'},
+		{"params", required_argument, NULL, 'p'},
+		{"zero-bytes", required_argument, NULL, 'z'},
+		{"match", required_argument, NULL, 'm'},
+		{"threads", required_argument, NULL, 't'},
+		{"max", required_argument, NULL, 'x'},
+		{NULL, 0, NULL, 0},
+	};
+	struct eth_selector_config config;
+	unsigned int zero_bytes = 0;
+	const char *match = NULL;
+	int c;
+
+	memset(&config, 0, sizeof(config));
+	config.params = "()";
+	while ((c = getopt_long(argc, argv, "N:p:z:m:t:x:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'N':
+			config.name = optarg;
+			break;
+		case 'p':
+			config.params = optarg;
+			break;
+		case 'z':
+			zero_bytes = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			match = optarg;
+			break;
+		case 't':
+			config.threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			config.max_attempts = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!config.name || (zero_bytes == 0 && !match) || eth_selector_target(&config, zero_bytes, match) != 0)
+	{
+		fprintf(stderr, "usage: walgen selector --name NAME [--params '(TYPES)'] "
+			"[--zero-bytes N] [--match HEX] [-t THREADS] [--max N]\n");
+		return 2;
+	}
+
+	struct eth_selector_result result;
+	double start = now_seconds();
+	int ret = eth_selector_mine(&config, &result);
+	double elapsed = now_seconds() - start;
+	fprintf(stderr, "%llu candidates in %.2f s (%.2f M/s)\n", result.attempts, elapsed,
+		elapsed > 0 ? result.attempts / elapsed / 1e6 : 0.0);
+	if (ret < 0)
+	{
+		fprintf(stderr, "Name and parameters are too long\n");
+		return 2;
+	}
+	if (ret > 0)
+	{
+		fprintf(stderr, "No match within %llu candidates\n", config.max_attempts);
+		return 1;
+	}
+
+	char hex[2 * sizeof(result.hash) + 1];
+	eth_hex_encode(result.hash, sizeof(result.hash), hex);
+	hex[sizeof(hex) - 1] = '\0';
+	printf("Signature: %s\nSelector: 0x%.8s\nTopic: 0x%s\n", result.signature, hex, hex);
+	return 0;
+}
+
+static int cmd_bench_numa(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"threads", required_argument, NULL, 't'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 200000;
+	unsigned int max_threads = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+	if (max_threads == 0)
+	{
+		max_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+	}
+
+	unsigned char *keys = malloc(count * ETH_PRIV_KEY_SIZE);
+	unsigned char *addresses = malloc(count * ETH_ADDRESS_SIZE);
+	if (!keys || !addresses)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	printf("NUMA nodes: %u, wallets per run: %zu\n", eth_numa_nodes(), count);
+	printf("%8s %14s %9s %14s %9s\n", "threads", "unpinned/s", "scaling", "node-local/s", "scaling");
+	// Scaling is relative to one thread with the same placement
+	double base[2] = {0, 0};
+	int ret = 0;
+	for (unsigned int threads = 1; ret == 0; threads = threads * 2 < max_threads ? threads * 2 : max_threads)
+	{
+		double rate[2];
+		for (int p = 0; p < 2; p++)
+		{
+			struct eth_numa_config config = {.count = count, .threads = threads};
+			config.placement = p == 0 ? ETH_NUMA_NONE : ETH_NUMA_LOCAL;
+			double start = now_seconds();
+			if (generate_eth_wallets_numa(&config, keys, addresses) != 0)
+			{
+				fprintf(stderr, "Generation failed\n");
+				ret = 1;
+				break;
+			}
+			rate[p] = count / (now_seconds() - start);
+			if (threads == 1)
+			{
+				base[p] = rate[p];
+			}
+		}
+		if (ret == 0)
+		{
+			printf("%8u %14.0f %8.2fx %14.0f %8.2fx\n", threads, rate[0], rate[0] / base[0], rate[1],
+				rate[1] / base[1]);
+		}
+		if (threads == max_threads)
+		{
+			break;
+		}
+	}
+
+	memset(keys, 0, count * ETH_PRIV_KEY_SIZE);
+	free(keys);
+	free(addresses);
+	return ret;
+}
+
+// dTLB load misses of this thread, user space only; -1 where perf events
+// are unavailable (non-Linux, perf_event_paranoid, containers)
+static int dtlb_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+		PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static void dtlb_start(int fd)
+{
+#ifdef __linux__
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+#else
+	(void)fd;
+#endif
+}
+
+static long long dtlb_stop(int fd)
+{
+	long long misses = -1;
+#ifdef __linux__
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+		{
+			misses = -1;
+		}
+	}
+#else
+	(void)fd;
+#endif
+	return misses;
+}
+
+static void print_dtlb(long long misses, size_t ops)
+{
+	if (misses < 0)
+	{
+		printf(" %14s", "n/a");
+	}
+	else
+	{
+		printf(" %14.3f", (double)misses / ops);
+	}
+}
+
+// Keeps the lookup loop from being optimised away
+static volatile unsigned long long lookup_sink;
+
+static int cmd_bench_hugepages(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"mode", required_argument, NULL, 'm'},
+		{"lookups", required_argument, NULL, 'k'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 200000;
+	size_t lookups = 20000000;
+	const char *mode = "1g";
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:m:k:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'm':
+			mode = optarg;
+			break;
+		case 'k':
+			lookups = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0 || lookups == 0 || eth_huge_pages_select(mode) != 0)
+	{
+		fprintf(stderr, "usage: walgen bench-hugepages [-n COUNT] [--mode thp|2m|1g] [--lookups N]\n");
+		return 2;
+	}
+	int requested = eth_huge_pages_mode();
+
+	struct eth_generator *gen = eth_generator_create();
+	int fd = dtlb_open();
+	if (!gen)
+	{
+		return 1;
+	}
+	if (fd < 0)
+	{
+		fprintf(stderr, "perf events unavailable, dTLB misses not counted\n");
+	}
+
+	// Generation fills the arrays front to back; the lookup pass reads
+	// random records the way a dispenser or a sort would
+	printf("%zu wallets, %.1f MB of keys and addresses\n", count, count * ETH_WALLET_RECORD_SIZE / 1048576.0);
+	printf("%-5s %-10s %12s %14s %12s %14s\n", "mode", "obtained", "keys/s", "dTLB miss/key", "lookups/s",
+		"dTLB miss/op");
+	int ret = 0;
+	int modes[2] = {ETH_HUGE_OFF, requested};
+	for (int m = 0; m < 2 && ret == 0; m++)
+	{
+		struct eth_huge_buffer keys, addresses;
+		eth_huge_pages_set(modes[m]);
+		if (eth_huge_alloc(&keys, count * ETH_PRIV_KEY_SIZE) != 0)
+		{
+			ret = 1;
+			break;
+		}
+		if (eth_huge_alloc(&addresses, count * ETH_ADDRESS_SIZE) != 0)
+		{
+			eth_huge_free(&keys);
+			ret = 1;
+			break;
+		}
+
+		dtlb_start(fd);
+		double start = now_seconds();
+		for (size_t done = 0; done < count && ret == 0; done += 1024)
+		{
+			size_t n = count - done < 1024 ? count - done : 1024;
+			ret = eth_generator_fill(gen, (unsigned char *)keys.data + done * ETH_PRIV_KEY_SIZE,
+				(unsigned char *)addresses.data + done * ETH_ADDRESS_SIZE, n);
+		}
+		double fill = now_seconds() - start;
+		long long fill_misses = dtlb_stop(fd);
+
+		// xorshift indices so the hardware prefetcher cannot follow
+		unsigned long long x = 0x9e3779b97f4a7c15ULL, sum = 0;
+		const unsigned char *a = addresses.data;
+		dtlb_start(fd);
+		start = now_seconds();
+		for (size_t i = 0; i < lookups; i++)
+		{
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			sum += a[(x % count) * ETH_ADDRESS_SIZE];
+		}
+		double lookup = now_seconds() - start;
+		long long lookup_misses = dtlb_stop(fd);
+
+		char obtained[32];
+		size_t backed = eth_huge_backed(&addresses);
+		if (addresses.pages == ETH_PAGES_THP)
+		{
+			snprintf(obtained, sizeof(obtained), "thp %.0f%%", 100.0 * backed / addresses.mapped);
+		}
+		else
+		{
+			snprintf(obtained, sizeof(obtained), "%s", eth_huge_pages_name(addresses.pages));
+		}
+		printf("%-5s %-10s %12.0f", m == 0 ? "off" : mode, obtained, count / fill);
+		print_dtlb(fill_misses, count);
+		printf(" %12.0f", lookups / lookup);
+		print_dtlb(lookup_misses, lookups);
+		printf("\n");
+		lookup_sink = sum;
+
+		memset(keys.data, 0, keys.size);
+		eth_huge_free(&keys);
+		eth_huge_free(&addresses);
+	}
+	if (ret != 0)
+	{
+		fprintf(stderr, "Generation failed\n");
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	eth_generator_destroy(gen);
+	return ret != 0;
+}
+
+struct entropy_reader
+{
+	struct eth_entropy_source *source;
+	size_t slices;
+	int failed;
+};
+
+static void *entropy_reader_main(void *arg)
+{
+	struct entropy_reader *r = arg;
+	unsigned char slice[ETH_PRIV_KEY_SIZE];
+	while (r->source->read(r->source->ctx, slice, sizeof(slice)) == 0)
+	{
+		r->slices++;
+	}
+	memset(slice, 0, sizeof(slice));
+	return NULL;
+}
+
+// Threads draw 32-byte slices, the size of one key, until the file runs out
+static int cmd_bench_entropy(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"threads", required_argument, NULL, 't'},
+		{"mix", no_argument, NULL, 'x'},
+		{NULL, 0, NULL, 0},
+	};
+	unsigned int nthreads = 1;
+	int flags = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "t:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 't':
+			nthreads = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'x':
+			flags |= ETH_ENTROPY_MIX_OS;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (optind != argc - 1 || nthreads == 0)
+	{
+		fprintf(stderr, "usage: walgen bench-entropy [-t THREADS] [--mix] FILE\n");
+		return 2;
+	}
+
+	struct eth_entropy_source source;
+	if (eth_entropy_file_open(argv[optind], flags, &source) != 0)
+	{
+		fprintf(stderr, "Cannot open entropy source %s\n", argv[optind]);
+		return 1;
+	}
+	struct entropy_reader *readers = calloc(nthreads, sizeof(*readers));
+	pthread_t *tids = calloc(nthreads, sizeof(*tids));
+	if (!readers || !tids)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	double start = now_seconds();
+	unsigned int started = 0;
+	for (; started < nthreads; started++)
+	{
+		readers[started].source = &source;
+		if (pthread_create(&tids[started], NULL, entropy_reader_main, &readers[started]) != 0)
+		{
+			break;
+		}
+	}
+	size_t slices = 0;
+	for (unsigned int i = 0; i < started; i++)
+	{
+		pthread_join(tids[i], NULL);
+		slices += readers[i].slices;
+	}
+	double elapsed = now_seconds() - start;
+	source.close(source.ctx);
+
+	double bytes = (double)slices * ETH_PRIV_KEY_SIZE;
+	printf("%zu slices (%.1f MB) by %u threads in %.3f s: %.2f GB/s, %.0f keys/s\n", slices, bytes / 1048576.0,
+		started, elapsed, bytes / elapsed / 1e9, slices / elapsed);
+	free(tids);
+	free(readers);
+	return 0;
+}
+
+static int cmd_bench_writer(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"output", required_argument, NULL, 'o'},
+		{"size", required_argument, NULL, 's'},
+		{"buffer", required_argument, NULL, 'b'},
+		{"depth", required_argument, NULL, 'd'},
+		{"direct", no_argument, NULL, 'D'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *path = NULL;
+	size_t size_mb = 1024;
+	struct eth_writer_config config;
+	int c;
+
+	memset(&config, 0, sizeof(config));
+	while ((c = getopt_long(argc, argv, "o:s:b:d:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'o':
+			path = optarg;
+			break;
+		case 's':
+			size_mb = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			config.buffer_size = strtoull(optarg, NULL, 0) << 10;
+			break;
+		case 'd':
+			config.depth = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'D':
+			config.direct = 1;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (!path || size_mb == 0)
+	{
+		fprintf(stderr, "usage: walgen bench-writer -o FILE [-s MB] [-b BUFFER_KB] [-d DEPTH] [--direct]\n");
+		return 2;
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+	{
+		perror(path);
+		return 1;
+	}
+
+	// Hex lines as gen writes them; only the writer's cost is measured
+	static const char line[] = "0x4c0883a69102937d6231471b5dbb6204fe5129617082792ae468d01a3f362318 "
+		"0x2c7536e3605d9c16a7a3d7b1898e529396a65c23\n";
+	const size_t line_len = sizeof(line) - 1;
+	const size_t total = size_mb << 20;
+	unsigned char plain[1 << 20];
+	int ret = 0;
+
+	printf("%-40s %10s %8s %8s %10s\n", "backend", "MB/s", "writes", "stalls", "in flight");
+	for (int b = -1; b <= ETH_WRITER_PWRITEV && ret == 0; b++)
+	{
+		if (ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0)
+		{
+			ret = 1;
+			break;
+		}
+		double start = now_seconds();
+		if (b < 0)
+		{
+			// Baseline: what the pipeline does without a writer, one
+			// synchronous write per 1 MB buffer
+			size_t used = 0, done = 0;
+			while (done < total && ret == 0)
+			{
+				used = 0;
+				while (used + line_len <= sizeof(plain) && done + used + line_len <= total)
+				{
+					memcpy(plain + used, line, line_len);
+					used += line_len;
+				}
+				if (used == 0 || write(fd, plain, used) != (ssize_t)used)
+				{
+					ret = used == 0 ? 0 : 1;
+					break;
+				}
+				done += used;
+			}
+			if (fsync(fd) != 0)
+			{
+				ret = 1;
+			}
+			printf("%-40s %10.0f %8zu %8s %10s\n", "write", total / 1048576.0 / (now_seconds() - start),
+				(total + sizeof(plain) - 1) / sizeof(plain), "-", "1");
+			continue;
+		}
+		if (b == ETH_WRITER_AUTO)
+		{
+			continue;
+		}
+
+		config.fd = fd;
+		config.backend = b;
+		struct eth_writer *writer = eth_writer_create(&config);
+		if (!writer)
+		{
+			printf("%-40s %10s\n", b == ETH_WRITER_URING ? "io_uring" : "pwritev", "unavailable");
+			continue;
+		}
+		for (size_t done = 0; done + line_len <= total; done += line_len)
+		{
+			unsigned char *space;
+			if (eth_writer_reserve(writer, &space) >= line_len)
+			{
+				memcpy(space, line, line_len);
+				eth_writer_commit(writer, line_len);
+			}
+			else if (eth_writer_write(writer, line, line_len) != 0)
+			{
+				break;
+			}
+		}
+		if (eth_writer_finish(writer) != 0 || fsync(fd) != 0)
+		{
+			ret = 1;
+		}
+		double elapsed = now_seconds() - start;
+		struct eth_writer_stats stats;
+		eth_writer_stats(writer, &stats);
+		char name[48];
+		snprintf(name, sizeof(name), "%s%s", eth_writer_backend(writer), stats.direct ? " + O_DIRECT" : "");
+		printf("%-40s %10.0f %8llu %8llu %10u\n", name, stats.bytes / 1048576.0 / elapsed, stats.writes,
+			stats.stalls, stats.max_in_flight);
+		eth_writer_free(writer);
+	}
+	if (ret != 0)
+	{
+		perror("write");
+	}
+	close(fd);
+	return ret;
+}
+
+static int cmd_tune(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"cache", required_argument, NULL, 'c'},
+		{"force", no_argument, NULL, 'f'},
+		{NULL, 0, NULL, 0},
+	};
+	const char *cache = NULL;
+	int force = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "c:f", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'c':
+			cache = optarg;
+			break;
+		case 'f':
+			force = 1;
+			break;
+		default:
+			return 2;
+		}
+	}
+
+	struct eth_tune_params p;
+	if (eth_autotune(cache, force, &p) != 0)
+	{
+		fprintf(stderr, "Autotuning failed\n");
+		return 1;
+	}
+	printf("cpu_model    %s\n", p.cpu_model);
+	printf("cpus         %u\n", p.cpus);
+	printf("cached       %s\n", p.cached ? "yes" : "no");
+	printf("kernel       %s\n", p.kernel);
+	printf("lanes        %u\n", p.lanes);
+	printf("batch        %zu\n", p.batch);
+	printf("ring         %zu\n", p.ring_size);
+	printf("pipeline     %.0f wallets/s\n", p.rate);
+	printf("ec           %.0f keys/s per thread\n", p.ec_rate);
+	printf("keccak+hex   %.0f addresses/s per thread\n", p.keccak_rate);
+	printf("rng          %.0f keys/s per thread\n", p.rng_rate);
+	return 0;
+}
+
+// Pulls one wallet at a time: generate_eth_wallets() per call against the
+// stream with and without prefetch; every record is audited afterwards
+static int cmd_bench_stream(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"batch", required_argument, NULL, 'b'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 20000;
+	size_t batch = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:b:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0)
+	{
+		return 2;
+	}
+
+	unsigned char *records = malloc(count * ETH_WALLET_RECORD_SIZE);
+	if (!records)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+	int ret = 1;
+	for (int mode = 0; mode < 3; mode++)
+	{
+		static const char *const names[] = {"per call", "stream", "prefetch"};
+		struct eth_wallet_stream_config config = {.batch = batch, .prefetch = mode == 2};
+		struct eth_wallet_stream *stream = NULL;
+		if (mode > 0 && !(stream = eth_wallet_stream_open(&config)))
+		{
+			fprintf(stderr, "Cannot open wallet stream\n");
+			goto out;
+		}
+
+		double start = now_seconds();
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned char *record = records + i * ETH_WALLET_RECORD_SIZE;
+			int failed = stream ? eth_wallet_stream_read(stream, record, record + ETH_PRIV_KEY_SIZE)
+				: generate_eth_wallets(record, record + ETH_PRIV_KEY_SIZE);
+			if (failed)
+			{
+				fprintf(stderr, "%s failed\n", names[mode]);
+				eth_wallet_stream_close(stream);
+				goto out;
+			}
+		}
+		double elapsed = now_seconds() - start;
+		eth_wallet_stream_close(stream);
+
+		struct eth_audit_result audit;
+		if (eth_audit_buffer(records, count * ETH_WALLET_RECORD_SIZE, 0, NULL, NULL, NULL, &audit) != 0)
+		{
+			goto out;
+		}
+		printf("%-9s %.0f wallets/s   %s\n", names[mode], count / elapsed,
+			audit.mismatches || audit.invalid ? "MISMATCH" : "ok");
+	}
+	ret = 0;
+
+out:
+	memset(records, 0, count * ETH_WALLET_RECORD_SIZE);
+	free(records);
+	return ret;
+}
+
+// Records single-wallet, batch and signing latency, prints the quantiles and
+// optionally writes the Prometheus exposition; also times the recording
+static int cmd_bench_latency(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{"batch", required_argument, NULL, 'b'},
+		{"output", required_argument, NULL, 'o'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = 2000;
+	size_t batch = 64;
+	const char *output = NULL;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:b:o:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = strtoull(optarg, NULL, 0);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (count == 0 || batch == 0)
+	{
+		return 2;
+	}
+	if (!eth_latency_enabled())
+	{
+		fprintf(stderr, "Latency recording is off (WALGEN_LATENCY=0)\n");
+		return 1;
+	}
+
+	unsigned char *keys = malloc(batch * ETH_PRIV_KEY_SIZE);
+	unsigned char *addresses = malloc(batch * ETH_ADDRESS_SIZE);
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	struct eth_generator *gen = eth_generator_create();
+	struct eth_signer *signer = eth_random_private_key(priv_key) == 0 ? eth_signer_create(priv_key) : NULL;
+	int ret = 1;
+	if (!keys || !addresses || !gen || !signer)
+	{
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	unsigned char digest[32] = {1};
+	struct eth_sign_item item = {.data = digest, .len = sizeof(digest)};
+	unsigned char sig[ETH_SIGNATURE_SIZE];
+	for (size_t i = 0; i < count; i++)
+	{
+		if (generate_single_eth_address(priv_key, addresses) != 0 ||
+			(i % batch == 0 && eth_generator_fill(gen, keys, addresses, batch) != 0) ||
+			eth_sign(signer, ETH_SIGN_HASH, NULL, &item, sig) != 0)
+		{
+			fprintf(stderr, "Generation failed\n");
+			goto out;
+		}
+	}
+
+	printf("%-7s %10s %10s %10s %10s %10s %10s\n", "op", "count", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+	for (int op = 0; op < ETH_LATENCY_OPS; op++)
+	{
+		struct eth_latency_histogram h;
+		eth_latency_merge(op, &h);
+		if (h.count == 0)
+		{
+			continue;
+		}
+		printf("%-7s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", eth_latency_op_name(op), h.count,
+			eth_latency_quantile(&h, 0.5) / 1e3, eth_latency_quantile(&h, 0.9) / 1e3,
+			eth_latency_quantile(&h, 0.99) / 1e3, eth_latency_quantile(&h, 0.999) / 1e3, h.max_ns / 1e3);
+	}
+
+	if (output && eth_latency_expose_file(output) != 0)
+	{
+		fprintf(stderr, "Cannot write %s\n", output);
+		goto out;
+	}
+
+	// The cost left in production: a sample is a thread lookup and three
+	// counter bumps. Goes under an op this run does not otherwise use, after
+	// the exposition has been written.
+	const size_t samples = 10000000;
+	double start = now_seconds();
+	for (size_t i = 0; i < samples; i++)
+	{
+		eth_latency_record(ETH_LATENCY_FLUSH, i & 0xffff);
+	}
+	printf("recording: %.1f ns per sample\n", (now_seconds() - start) / samples * 1e9);
+	ret = 0;
+
+out:
+	memset(priv_key, 0, sizeof(priv_key));
+	eth_signer_destroy(signer);
+	eth_generator_destroy(gen);
+	if (keys)
+	{
+		memset(keys, 0, batch * ETH_PRIV_KEY_SIZE);
+	}
+	free(keys);
+	free(addresses);
+	return ret;
+}
+
+static int cmd_table(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"count", required_argument, NULL, 'n'},
+		{NULL, 0, NULL, 0},
+	};
+	size_t count = ETH_EC_TABLE_DEFAULT;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			count = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			return 2;
+		}
+	}
+	if (optind != argc - 1 || count == 0)
+	{
+		return 2;
+	}
+
+	double start = now_seconds();
+	if (eth_ec_table_create(argv[optind], count) != 0)
+	{
+		fprintf(stderr, "Cannot write %s\n", argv[optind]);
+		return 1;
+	}
+	double created = now_seconds() - start;
+	start = now_seconds();
+	if (eth_ec_table_load(argv[optind]) != 0)
+	{
+		fprintf(stderr, "%s does not verify\n", argv[optind]);
+		return 1;
+	}
+	printf("%s: %zu points, built in %.3f s, loads and verifies in %.3f ms\n", argv[optind], eth_ec_table_count(),
+		created, (now_seconds() - start) * 1e3);
+	eth_ec_table_load(NULL);
+	return 0;
+}
+
+// One fresh process deriving the first address of a walk, timed from fork to
+// exit; `table` is handed over through WALGEN_EC_TABLE
+static int startup_run(const char *table, unsigned long long seed, double *elapsed, char *address)
+{
+	char arg[32];
+	int fds[2];
+
+	snprintf(arg, sizeof(arg), "%llu", seed);
+	if (pipe(fds) != 0)
+	{
+		return -1;
+	}
+	double start = now_seconds();
+	pid_t child = fork();
+	if (child < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (child == 0)
+	{
+		char *args[] = {"walgen", "bench-startup", "--child", arg, NULL};
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		if (table)
+		{
+			setenv("WALGEN_EC_TABLE", table, 1);
+		}
+		else
+		{
+			unsetenv("WALGEN_EC_TABLE");
+		}
+		execv("/proc/self/exe", args);
+		_exit(127);
+	}
+	close(fds[1]);
+	ssize_t n = read(fds[0], address, 2 * ETH_ADDRESS_SIZE);
+	close(fds[0]);
+	int status;
+	waitpid(child, &status, 0);
+	*elapsed = now_seconds() - start;
+	address[n > 0 ? n : 0] = '\0';
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 && n == 2 * ETH_ADDRESS_SIZE ? 0 : -1;
+}
+
+// Cold start: time to the first address of a fresh process with and without
+// the precomputed table, each run on a new key
+static int cmd_bench_startup(int argc, char **argv)
+{
+	static const struct option options[] = {
+		{"runs", required_argument, NULL, 'r'},
+		{"table", required_argument, NULL, 'T'},
+		{"child", required_argument, NULL, 'C'},
+		{NULL, 0, NULL, 0},
+	};
+	unsigned int runs = 10;
+	const char *table = NULL;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "r:", options, NULL)) != -1)
+	{
+		switch (c)
+		{
+		case 'r':
+			runs = (unsigned int)strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			table = optarg;
+			break;
+		case 'C':
+		{
+			// Child side: start a walk and print its first address
+			unsigned char key[ETH_PRIV_KEY_SIZE] = {0};
+			unsigned char address[ETH_ADDRESS_SIZE];
+			char hex[2 * ETH_ADDRESS_SIZE];
+			unsigned long long seed = strtoull(optarg, NULL, 0);
+			for (int i = 0; i < 8; i++)
+			{
+				key[31 - i] = (unsigned char)(seed >> (8 * i));
+			}
+			if (eth_sequential_addresses(key, 1, address) != 0)
+			{
+				return 1;
+			}
+			eth_hex_encode(address, ETH_ADDRESS_SIZE, hex);
+			return fwrite(hex, 1, sizeof(hex), stdout) == sizeof(hex) ? 0 : 1;
+		}
+		default:
+			return 2;
+		}
+	}
+	if (runs == 0 || !table)
+	{
+		return 2;
+	}
+
+	double *times = calloc(2 * (size_t)runs, sizeof(*times));
+	if (!times)
+	{
+		return 1;
+	}
+	int ret = 0;
+	for (unsigned int r = 0; r < runs && ret == 0; r++)
+	{
+		unsigned char seed[ETH_PRIV_KEY_SIZE];
+		unsigned long long value = 0;
+		char plain[2 * ETH_ADDRESS_SIZE + 1], tabled[2 * ETH_ADDRESS_SIZE + 1];
+
+		if (eth_random_private_key(seed) != 0)
+		{
+			ret = 1;
+			break;
+		}
+		memcpy(&value, seed, sizeof(value));
+		value |= 1; // never the zero key
+		if (startup_run(NULL, value, &times[r], plain) != 0 ||
+			startup_run(table, value, &times[runs + r], tabled) != 0)
+		{
+			fprintf(stderr, "Child run failed\n");
+			ret = 1;
+		}
+		else if (strcmp(plain, tabled) != 0)
+		{
+			fprintf(stderr, "Address mismatch: %s vs %s\n", plain, tabled);
+			ret = 1;
+		}
+	}
+	if (ret == 0)
+	{
+		for (int mode = 0; mode < 2; mode++)
+		{
+			double *t = times + (size_t)mode * runs;
+			qsort(t, runs, sizeof(*t), compare_double);
+			printf("%-9s time to first key: median %.2f ms, best %.2f ms\n", mode ? "table" : "no table",
+				t[runs / 2] * 1e3, t[0] * 1e3);
+		}
+	}
+	free(times);
+	return ret;
+}
+
+struct command
+{
+	const char *name;
+	int (*run)(int argc, char **argv);
+	const char *help;
+};
+
+static const struct command commands[] = {
+	{"gen", cmd_gen, "gen -n COUNT [-l LANES] [-b BATCH] [--ring SIZE] [-o FILE | --shm NAME] [-r | --multichain] [--no-pin] [--hugepages MODE] [--writer auto|uring|pwritev] [--direct] [--autotune | --retune] [--entropy FILE [--entropy-mix]] [--latency FILE]"},
+	{"tune", cmd_tune, "tune [--cache FILE] [--force]"},
+	{"shm-read", cmd_shm_read, "shm-read [-o FILE] [-r] NAME"},
+	{"search", cmd_search, "search --prefix HEX [--suffix HEX] [--eip55] [-t THREADS] [--checkpoint FILE [--interval SEC]] | --resume FILE"},
+	{"coordinate", cmd_coordinate, "coordinate --listen HOST:PORT|unix:PATH --prefix HEX [--suffix HEX] [--eip55]"},
+	{"bench-sign", cmd_bench_sign, "bench-sign [-n COUNT] [-t THREADS] [--typed]"},
+	{"bench-recover", cmd_bench_recover, "bench-recover [-n COUNT] [-t THREADS]"},
+	{"addresses", cmd_addresses, "addresses -i PUBKEYS -o ADDRESSES [-t THREADS]"},
+	{"audit", cmd_audit, "audit [-t THREADS] [-q] FILE"},
+	{"sort", cmd_sort, "sort -o OUTPUT [--tmp DIR] [-m MB] [-t THREADS] [--fan-in N] [--dedup] [--report FILE] INPUT"},
+	{"bench-kernels", cmd_bench_kernels, "bench-kernels [-n COUNT]"},
+	{"bench-backends", cmd_bench_backends, "bench-backends [-n COUNT]"},
+	{"bench-stream", cmd_bench_stream, "bench-stream [-n COUNT] [-b BATCH]"},
+	{"bench-latency", cmd_bench_latency, "bench-latency [-n COUNT] [-b BATCH] [-o FILE]"},
+	{"table", cmd_table, "table [-n COUNT] FILE"},
+	{"bench-startup", cmd_bench_startup, "bench-startup --table FILE [-r RUNS]"},
+	{"bench-ec", cmd_bench_ec, "bench-ec [-n COUNT] [--check COUNT]"},
+	{"dispense", cmd_dispense, "dispense --listen PATH [--pool N] [--low N] [--high N] [-t THREADS] [--hugepages MODE]"},
+	{"bench-dispense", cmd_bench_dispense, "bench-dispense --connect PATH [-n REQUESTS] [-c CLIENTS] [-b WALLETS]"},
+	{"bench-shm", cmd_bench_shm, "bench-shm [-n COUNT] [--ring SIZE] [-b BATCH]"},
+	{"selector", cmd_selector, "selector --name NAME [--params '(TYPES)'] [--zero-bytes N] [--match HEX] [-t THREADS]"},
+	{"bench-numa", cmd_bench_numa, "bench-numa [-n COUNT] [-t MAX_THREADS]"},
+	{"bench-hugepages", cmd_bench_hugepages, "bench-hugepages [-n COUNT] [--mode thp|2m|1g] [--lookups N]"},
+	{"bench-writer", cmd_bench_writer, "bench-writer -o FILE [-s MB] [-b BUFFER_KB] [-d DEPTH] [--direct]"},
+	{"bench-entropy", cmd_bench_entropy, "bench-entropy [-t THREADS] [--mix] FILE  (uses the file up)"},
+	{"work", cmd_work, "work --connect HOST:PORT|unix:PATH [-t THREADS]"},
+};
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: walgen                 generate a single wallet\n");
+	for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	{
+		fprintf(stderr, "       walgen %s\n", commands[i].help);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		return cmd_single();
+	}
+
+	for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+	{
+		if (strcmp(argv[1], commands[i].name) == 0)
+		{
+			return commands[i].run(argc - 1, argv + 1);
+		}
+	}
+	usage();
+	return 2;
 }
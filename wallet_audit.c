@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Records derived between progress and counter updates
+#define AUDIT_BLOCK 256
+
+struct audit
+{
+	const unsigned char *data;
+	size_t record_size;
+	size_t records;
+	eth_audit_fn report;
+	eth_audit_progress_fn progress;
+	void *arg;
+
+	pthread_mutex_t lock; // serialises the callbacks
+	atomic_size_t done;
+	atomic_size_t mismatches;
+	atomic_size_t invalid;
+	atomic_llong next_progress_ms;
+};
+
+static long long audit_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int audit_hex(const unsigned char *hex, unsigned char *out, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		int hi = eth_hex_value((char)hex[2 * i]);
+		int lo = eth_hex_value((char)hex[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+		{
+			return -1;
+		}
+		out[i] = (unsigned char)(hi << 4 | lo);
+	}
+	return 0;
+}
+
+// The two fixed-size layouts walgen gen writes: raw key || address records
+// and "0x<key> 0x<address>\n" lines
+static int audit_record(const struct audit *a, size_t index, unsigned char *priv_key, unsigned char *address)
+{
+	const unsigned char *rec = a->data + index * a->record_size;
+
+	if (a->record_size == ETH_WALLET_RECORD_SIZE)
+	{
+		memcpy(priv_key, rec, ETH_PRIV_KEY_SIZE);
+		memcpy(address, rec + ETH_PRIV_KEY_SIZE, ETH_ADDRESS_SIZE);
+		return 0;
+	}
+	if (rec[0] != '0' || rec[1] != 'x' || rec[66] != ' ' || rec[67] != '0' || rec[68] != 'x' || rec[109] != '\n' ||
+		audit_hex(rec + 2, priv_key, ETH_PRIV_KEY_SIZE) != 0 ||
+		audit_hex(rec + 69, address, ETH_ADDRESS_SIZE) != 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static void audit_problem(struct audit *a, size_t index, int problem, const unsigned char *expected,
+	const unsigned char *derived)
+{
+	atomic_fetch_add_explicit(problem == ETH_AUDIT_MISMATCH ? &a->mismatches : &a->invalid, 1, memory_order_relaxed);
+	if (a->report)
+	{
+		pthread_mutex_lock(&a->lock);
+		a->report(a->arg, index, problem, expected, derived);
+		pthread_mutex_unlock(&a->lock);
+	}
+}
+
+// At most one progress call a second, from whichever thread notices first
+static void audit_tick(struct audit *a, size_t n)
+{
+	size_t done = atomic_fetch_add_explicit(&a->done, n, memory_order_relaxed) + n;
+	if (!a->progress)
+	{
+		return;
+	}
+	long long now = audit_now_ms();
+	long long next = atomic_load_explicit(&a->next_progress_ms, memory_order_relaxed);
+	if (now >= next && atomic_compare_exchange_strong(&a->next_progress_ms, &next, now + 1000))
+	{
+		pthread_mutex_lock(&a->lock);
+		a->progress(a->arg, done, a->records);
+		pthread_mutex_unlock(&a->lock);
+	}
+}
+
+static int audit_range(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct audit *a = arg;
+	unsigned char seed[32];
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	unsigned char expected[ETH_ADDRESS_SIZE];
+	unsigned char derived[ETH_ADDRESS_SIZE];
+	(void)thread;
+
+	// The keys are secrets, so derive them with a blinded context like signing does
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!ctx)
+	{
+		return -1;
+	}
+	secure_random(seed, sizeof(seed));
+	int ok = secp256k1_context_randomize(ctx, seed);
+	OPENSSL_cleanse(seed, sizeof(seed));
+	if (!ok)
+	{
+		secp256k1_context_destroy(ctx);
+		return -1;
+	}
+
+	for (size_t base = first; base < first + count; base += AUDIT_BLOCK)
+	{
+		size_t n = first + count - base < AUDIT_BLOCK ? first + count - base : AUDIT_BLOCK;
+		for (size_t i = base; i < base + n; i++)
+		{
+			if (audit_record(a, i, priv_key, expected) != 0)
+			{
+				audit_problem(a, i, ETH_AUDIT_MALFORMED, NULL, NULL);
+			}
+			else if (!secp256k1_ec_seckey_verify(ctx, priv_key) ||
+				eth_seckey_to_address(ctx, priv_key, derived) != 0)
+			{
+				audit_problem(a, i, ETH_AUDIT_INVALID_KEY, expected, NULL);
+			}
+			else if (memcmp(derived, expected, ETH_ADDRESS_SIZE) != 0)
+			{
+				audit_problem(a, i, ETH_AUDIT_MISMATCH, expected, derived);
+			}
+		}
+		audit_tick(a, n);
+	}
+
+	OPENSSL_cleanse(priv_key, sizeof(priv_key));
+	secp256k1_context_destroy(ctx);
+	return 0;
+}
+
+int eth_audit_buffer(const unsigned char *data, size_t size, unsigned int threads, eth_audit_fn report,
+	eth_audit_progress_fn progress, void *arg, struct eth_audit_result *result)
+{
+	size_t record_size;
+
+	if (!data && size)
+	{
+		return -1;
+	}
+	if (size >= ETH_WALLET_HEX_LINE_SIZE && size % ETH_WALLET_HEX_LINE_SIZE == 0 &&
+		data[0] == '0' && data[1] == 'x' && data[ETH_WALLET_HEX_LINE_SIZE - 1] == '\n')
+	{
+		record_size = ETH_WALLET_HEX_LINE_SIZE;
+	}
+	else if (size % ETH_WALLET_RECORD_SIZE == 0)
+	{
+		record_size = ETH_WALLET_RECORD_SIZE;
+	}
+	else
+	{
+		return -1;
+	}
+
+	struct audit a = {
+		.data = data,
+		.record_size = record_size,
+		.records = size / record_size,
+		.report = report,
+		.progress = progress,
+		.arg = arg,
+	};
+	pthread_mutex_init(&a.lock, NULL);
+	atomic_init(&a.done, 0);
+	atomic_init(&a.mismatches, 0);
+	atomic_init(&a.invalid, 0);
+	atomic_init(&a.next_progress_ms, audit_now_ms() + 1000);
+
+	int ret = eth_parallel_ranges(a.records, threads, audit_range, &a);
+	if (progress)
+	{
+		progress(arg, atomic_load(&a.done), a.records);
+	}
+	if (result)
+	{
+		result->records = a.records;
+		result->mismatches = atomic_load(&a.mismatches);
+		result->invalid = atomic_load(&a.invalid);
+	}
+	pthread_mutex_destroy(&a.lock);
+	return ret;
+}
+
+int eth_audit_file(const char *path, unsigned int threads, eth_audit_fn report,
+	eth_audit_progress_fn progress, void *arg, struct eth_audit_result *result)
+{
+	struct stat st;
+
+	if (!path)
+	{
+		return -1;
+	}
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+	if (fstat(fd, &st) != 0)
+	{
+		perror(path);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return eth_audit_buffer(NULL, 0, threads, report, progress, arg, result);
+	}
+
+	unsigned char *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		perror("mmap");
+		return -1;
+	}
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	int ret = eth_audit_buffer(data, (size_t)st.st_size, threads, report, progress, arg, result);
+	munmap(data, (size_t)st.st_size);
+	return ret;
+}
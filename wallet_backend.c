@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <secp256k1.h>
+#include <libkeccak.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/ec.h>
+#include <openssl/bn.h>
+#include <openssl/obj_mac.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Index 0 of each kind is the default and never needs the backend state
+static const char *const ec_names[] = {"secp256k1", "openssl"};
+static const char *const keccak_names[] = {"kernels", "libkeccak", "openssl"};
+
+#define EC_OPENSSL 1
+#define KECCAK_LIBKECCAK 1
+#define KECCAK_OPENSSL 2
+
+static int ec_backend;
+static int keccak_backend;
+
+// Shared read-only after setup; per-thread scratch lives in backend_thread
+static EC_GROUP *ossl_group;
+static EVP_MD *ossl_keccak;
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct backend_thread
+{
+	BN_CTX *bn;
+	BIGNUM *scalar;
+	EC_POINT *point;
+	EVP_MD_CTX *md;
+	struct libkeccak_state keccak;
+	int keccak_ready;
+};
+
+static pthread_key_t backend_key;
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+
+static void backend_thread_free(void *arg)
+{
+	struct backend_thread *t = arg;
+	BN_clear_free(t->scalar);
+	EC_POINT_clear_free(t->point);
+	BN_CTX_free(t->bn);
+	EVP_MD_CTX_free(t->md);
+	if (t->keccak_ready)
+	{
+		libkeccak_state_destroy(&t->keccak);
+	}
+	free(t);
+}
+
+static void backend_key_init(void)
+{
+	pthread_key_create(&backend_key, backend_thread_free);
+}
+
+// Created on a thread's first call, so callers keep their signatures and
+// threads that only use the defaults never allocate one
+static struct backend_thread *backend_thread(void)
+{
+	pthread_once(&backend_once, backend_key_init);
+	struct backend_thread *t = pthread_getspecific(backend_key);
+	if (!t)
+	{
+		t = calloc(1, sizeof(*t));
+		if (t && pthread_setspecific(backend_key, t) != 0)
+		{
+			free(t);
+			t = NULL;
+		}
+	}
+	return t;
+}
+
+// Set up whatever the backend needs once; 0 if it can run here
+static int backend_prepare(int kind, int index)
+{
+	int ret = 0;
+	pthread_mutex_lock(&backend_lock);
+	if (kind == ETH_BACKEND_EC && index == EC_OPENSSL && !ossl_group)
+	{
+		ossl_group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+		ret = ossl_group ? 0 : -1;
+	}
+	else if (kind == ETH_BACKEND_KECCAK && index == KECCAK_OPENSSL && !ossl_keccak)
+	{
+		// Provided by OpenSSL 3.2 and later; older versions fail the fetch
+		ossl_keccak = EVP_MD_fetch(NULL, "KECCAK-256", NULL);
+		ret = ossl_keccak ? 0 : -1;
+	}
+	pthread_mutex_unlock(&backend_lock);
+	return ret;
+}
+
+static int backend_index(int kind, const char *name)
+{
+	const char *const *names = kind == ETH_BACKEND_EC ? ec_names : keccak_names;
+	size_t count = kind == ETH_BACKEND_EC ? sizeof(ec_names) / sizeof(ec_names[0])
+		: sizeof(keccak_names) / sizeof(keccak_names[0]);
+	for (size_t i = 0; name && i < count; i++)
+	{
+		if (strcmp(names[i], name) == 0)
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+// WALGEN_EC_BACKEND / WALGEN_KECCAK_BACKEND pick the starting backends
+__attribute__((constructor)) static void backend_init(void)
+{
+	const char *ec = getenv("WALGEN_EC_BACKEND");
+	const char *keccak = getenv("WALGEN_KECCAK_BACKEND");
+	if (ec)
+	{
+		eth_backend_select(ETH_BACKEND_EC, ec);
+	}
+	if (keccak)
+	{
+		eth_backend_select(ETH_BACKEND_KECCAK, keccak);
+	}
+}
+
+int eth_backend_select(int kind, const char *name)
+{
+	if (kind != ETH_BACKEND_EC && kind != ETH_BACKEND_KECCAK)
+	{
+		return -1;
+	}
+	int index = backend_index(kind, name);
+	if (index < 0 || backend_prepare(kind, index) != 0)
+	{
+		return -1;
+	}
+	if (kind == ETH_BACKEND_EC)
+	{
+		ec_backend = index;
+	}
+	else
+	{
+		keccak_backend = index;
+	}
+	return 0;
+}
+
+int eth_backend_available(int kind, const char *name)
+{
+	int index = (kind == ETH_BACKEND_EC || kind == ETH_BACKEND_KECCAK) ? backend_index(kind, name) : -1;
+	return index >= 0 && backend_prepare(kind, index) == 0;
+}
+
+const char *eth_backend_name(int kind)
+{
+	if (kind == ETH_BACKEND_EC)
+	{
+		return ec_names[ec_backend];
+	}
+	return kind == ETH_BACKEND_KECCAK ? keccak_names[keccak_backend] : NULL;
+}
+
+const char *eth_backend_variant(int kind, unsigned int index)
+{
+	if (kind == ETH_BACKEND_EC)
+	{
+		return index < sizeof(ec_names) / sizeof(ec_names[0]) ? ec_names[index] : NULL;
+	}
+	if (kind == ETH_BACKEND_KECCAK)
+	{
+		return index < sizeof(keccak_names) / sizeof(keccak_names[0]) ? keccak_names[index] : NULL;
+	}
+	return NULL;
+}
+
+int eth_backend_default(int kind)
+{
+	return kind == ETH_BACKEND_EC ? ec_backend == 0 : keccak_backend == 0;
+}
+
+// k * G with OpenSSL's constant-time ladder (the scalar is flagged secret)
+static int ossl_pubkey64(struct backend_thread *t, const unsigned char *priv_key, unsigned char *pub64)
+{
+	unsigned char pub[65];
+
+	if (!t->bn && !(t->bn = BN_CTX_secure_new()))
+	{
+		return -1;
+	}
+	if (!t->scalar && !(t->scalar = BN_secure_new()))
+	{
+		return -1;
+	}
+	if (!t->point && !(t->point = EC_POINT_new(ossl_group)))
+	{
+		return -1;
+	}
+	BN_set_flags(t->scalar, BN_FLG_CONSTTIME);
+	int ok = BN_bin2bn(priv_key, ETH_PRIV_KEY_SIZE, t->scalar) &&
+		EC_POINT_mul(ossl_group, t->point, t->scalar, NULL, NULL, t->bn) &&
+		EC_POINT_point2oct(ossl_group, t->point, POINT_CONVERSION_UNCOMPRESSED, pub, sizeof(pub), t->bn) ==
+			sizeof(pub);
+	BN_clear(t->scalar);
+	if (!ok)
+	{
+		return -1;
+	}
+	memcpy(pub64, pub + 1, 64);
+	return 0;
+}
+
+int eth_backend_pubkey64(const unsigned char *priv_key, unsigned char *pub64)
+{
+	struct backend_thread *t = backend_thread();
+	// Same contract as secp256k1_ec_pubkey_create: zero or >= n is rejected
+	if (!t || !secp256k1_ec_seckey_verify(secp256k1_context_static, priv_key))
+	{
+		return -1;
+	}
+	return ossl_pubkey64(t, priv_key, pub64);
+}
+
+int eth_backend_keccak(const void *data, size_t len, unsigned char *hash)
+{
+	struct backend_thread *t = backend_thread();
+	if (!t)
+	{
+		return -1;
+	}
+	if (keccak_backend == KECCAK_OPENSSL)
+	{
+		unsigned int size = 32;
+		if (!t->md && !(t->md = EVP_MD_CTX_new()))
+		{
+			return -1;
+		}
+		return EVP_DigestInit_ex(t->md, ossl_keccak, NULL) && EVP_DigestUpdate(t->md, data, len) &&
+			EVP_DigestFinal_ex(t->md, hash, &size) ? 0 : -1;
+	}
+	if (!t->keccak_ready)
+	{
+		if (eth_keccak256_init(&t->keccak) != 0)
+		{
+			return -1;
+		}
+		t->keccak_ready = 1;
+	}
+	return eth_keccak256(&t->keccak, data, len, hash);
+}
+
+int eth_pubkey64_to_addresses(const unsigned char *pubkeys, size_t count, unsigned char *addresses)
+{
+	if ((!pubkeys || !addresses) && count)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		if (eth_pubkey_to_address(pubkeys + i * 64, addresses + i * ETH_ADDRESS_SIZE) != 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
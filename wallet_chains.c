@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define TRON_PREFIX 0x41
+// 0x41 || address || 4-byte checksum
+#define TRON_PAYLOAD_SIZE (1 + ETH_ADDRESS_SIZE + 4)
+// Payload as seven big-endian 32-bit words (three leading zero bytes)
+#define B58_WORDS 7
+// Digits are computed in limbs of 58^5, which fit 32 bits
+#define B58_LIMBS 7
+#define B58_R 656356768U
+
+static const char b58_alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+// b58_table[i][j]: limb j (most significant first) of 2^(32 * (6 - i)) in base 58^5
+static const uint32_t b58_table[B58_WORDS][B58_LIMBS] = {
+	{78508U, 646269101U, 118408823U, 91512303U, 209184527U, 413102373U, 153715680U},
+	{0U, 11997U, 486083817U, 3737691U, 294005210U, 247894721U, 289024608U},
+	{0U, 0U, 1833U, 324463681U, 385795061U, 551597588U, 21339008U},
+	{0U, 0U, 0U, 280U, 127692781U, 389432875U, 357132832U},
+	{0U, 0U, 0U, 0U, 42U, 537767569U, 410450016U},
+	{0U, 0U, 0U, 0U, 0U, 6U, 356826688U},
+	{0U, 0U, 0U, 0U, 0U, 0U, 1U},
+};
+
+static void b58_carry(uint64_t *limb)
+{
+	for (int j = B58_LIMBS - 1; j > 0; j--)
+	{
+		limb[j - 1] += limb[j] / B58_R;
+		limb[j] %= B58_R;
+	}
+}
+
+// Base58 of a 25-byte payload with a non-zero first byte: a fixed matrix
+// product into base-58^5 limbs instead of a digit-at-a-time bignum division.
+// Products are below 2^62, so limbs are normalised every third row.
+static size_t base58_25(const unsigned char *in, char *out)
+{
+	uint32_t words[B58_WORDS];
+	uint64_t limb[B58_LIMBS] = {0};
+	unsigned char padded[4 * B58_WORDS] = {0};
+	char digits[5 * B58_LIMBS];
+
+	memcpy(padded + sizeof(padded) - TRON_PAYLOAD_SIZE, in, TRON_PAYLOAD_SIZE);
+	for (int i = 0; i < B58_WORDS; i++)
+	{
+		words[i] = (uint32_t)padded[4 * i] << 24 | (uint32_t)padded[4 * i + 1] << 16 |
+			(uint32_t)padded[4 * i + 2] << 8 | padded[4 * i + 3];
+	}
+	for (int i = 0; i < B58_WORDS; i++)
+	{
+		for (int j = i; j < B58_LIMBS; j++)
+		{
+			limb[j] += (uint64_t)words[i] * b58_table[i][j];
+		}
+		if (i % 3 == 2 || i == B58_WORDS - 1)
+		{
+			b58_carry(limb);
+		}
+	}
+
+	for (int j = 0; j < B58_LIMBS; j++)
+	{
+		uint32_t v = (uint32_t)limb[j];
+		for (int k = 4; k >= 0; k--)
+		{
+			digits[5 * j + k] = b58_alphabet[v % 58];
+			v /= 58;
+		}
+	}
+	// No leading zero bytes, so only leading zero digits are dropped
+	size_t skip = 0;
+	while (skip < sizeof(digits) - 1 && digits[skip] == '1')
+	{
+		skip++;
+	}
+	memcpy(out, digits + skip, sizeof(digits) - skip);
+	return sizeof(digits) - skip;
+}
+
+int eth_tron_address(const unsigned char *addresses, size_t count, char *out)
+{
+	unsigned char payload[TRON_PAYLOAD_SIZE];
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+
+	if ((!addresses || !out) && count)
+	{
+		return -1;
+	}
+	payload[0] = TRON_PREFIX;
+	for (size_t i = 0; i < count; i++)
+	{
+		memcpy(payload + 1, addresses + i * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+		SHA256(payload, 1 + ETH_ADDRESS_SIZE, digest);
+		SHA256(digest, sizeof(digest), digest);
+		memcpy(payload + 1 + ETH_ADDRESS_SIZE, digest, 4);
+		// 0x41 || 160 bits always lands in [58^33, 58^34): 34 characters
+		if (base58_25(payload, out + i * ETH_TRON_ADDRESS_SIZE) != ETH_TRON_ADDRESS_SIZE)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int generate_multichain_wallets(size_t count, const struct eth_multichain_output *out)
+{
+	if (!out || (!out->priv_keys && count))
+	{
+		return -1;
+	}
+
+	unsigned char *addresses = out->addresses;
+	if (!addresses && count)
+	{
+		addresses = malloc(count * ETH_ADDRESS_SIZE);
+		if (!addresses)
+		{
+			return -1;
+		}
+	}
+
+	// One multiplication and one Keccak hash per key; every encoding below
+	// starts from the same 20 bytes
+	struct eth_generator *gen = eth_generator_create();
+	int ret = gen ? eth_generator_fill(gen, out->priv_keys, addresses, count) : -1;
+	eth_generator_destroy(gen);
+
+	if (ret == 0 && out->eth)
+	{
+		ret = eth_address_eip55(addresses, count, out->eth);
+	}
+	if (ret == 0 && out->tron)
+	{
+		ret = eth_tron_address(addresses, count, out->tron);
+	}
+	if (ret != 0 && count)
+	{
+		OPENSSL_cleanse(out->priv_keys, count * ETH_PRIV_KEY_SIZE);
+	}
+	if (addresses != out->addresses)
+	{
+		free(addresses);
+	}
+	return ret;
+}
@@ -0,0 +1,519 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Wire format: the client sends a 2-byte big-endian wallet count
+// (1..ETH_DISPENSE_MAX); the daemon answers with the same 2-byte count
+// followed by that many raw key || address records, or a count of 0 if the
+// request was malformed.
+#define DISPENSE_DEFAULT_CAPACITY 65536
+#define DISPENSE_MAX_CLIENTS 256
+// Wallets each refill thread generates outside the pool lock
+#define DISPENSE_REFILL_BATCH 64
+
+#ifdef MSG_NOSIGNAL
+#define DISPENSE_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DISPENSE_SEND_FLAGS 0
+#endif
+
+struct eth_dispenser
+{
+	struct eth_dispenser_config config;
+	unsigned char *pool; // capacity records, used as a stack
+	size_t pool_bytes;
+	struct eth_huge_buffer pool_mem;
+	int locked;
+	size_t count;
+	int refilling; // refill threads run until count reaches high_water
+	unsigned int running; // refill threads that have not failed
+	int shutdown;
+	unsigned long long served;
+	unsigned long long generated;
+	unsigned long long empty_waits;
+	atomic_int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t refill;    // refill threads wait here
+	pthread_cond_t available; // takers wait here when the pool runs dry
+	pthread_t *threads;
+	unsigned int started;
+};
+
+// A request may arrive a byte at a time; the daemon never blocks on it
+struct dispense_client
+{
+	unsigned char request[2];
+	size_t have;
+};
+
+static void *dispense_refill_main(void *arg)
+{
+	struct eth_dispenser *d = arg;
+	struct eth_generator *gen = eth_generator_create();
+	unsigned char keys[DISPENSE_REFILL_BATCH * ETH_PRIV_KEY_SIZE];
+	unsigned char addresses[DISPENSE_REFILL_BATCH * ETH_ADDRESS_SIZE];
+
+	pthread_mutex_lock(&d->lock);
+	while (gen && !d->shutdown)
+	{
+		if (!d->refilling || d->count >= d->config.high_water)
+		{
+			d->refilling = 0;
+			pthread_cond_wait(&d->refill, &d->lock);
+			continue;
+		}
+		size_t n = d->config.high_water - d->count;
+		if (n > DISPENSE_REFILL_BATCH)
+		{
+			n = DISPENSE_REFILL_BATCH;
+		}
+		pthread_mutex_unlock(&d->lock);
+
+		// All EC work happens outside the lock; takers only wait on memcpy
+		int ok = eth_generator_fill(gen, keys, addresses, n) == 0;
+
+		pthread_mutex_lock(&d->lock);
+		if (!ok)
+		{
+			eth_generator_destroy(gen);
+			gen = NULL;
+			break;
+		}
+		if (n > d->config.capacity - d->count)
+		{
+			n = d->config.capacity - d->count;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned char *record = d->pool + (d->count + i) * ETH_WALLET_RECORD_SIZE;
+			memcpy(record, keys + i * ETH_PRIV_KEY_SIZE, ETH_PRIV_KEY_SIZE);
+			memcpy(record + ETH_PRIV_KEY_SIZE, addresses + i * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+		}
+		d->count += n;
+		d->generated += n;
+		pthread_cond_broadcast(&d->available);
+	}
+	// A thread that cannot generate says so, so takers do not wait on it
+	if (!gen)
+	{
+		d->running--;
+		pthread_cond_broadcast(&d->available);
+	}
+	pthread_mutex_unlock(&d->lock);
+
+	OPENSSL_cleanse(keys, sizeof(keys));
+	eth_generator_destroy(gen);
+	return NULL;
+}
+
+struct eth_dispenser *eth_dispenser_create(const struct eth_dispenser_config *config)
+{
+	struct eth_dispenser *d = calloc(1, sizeof(*d));
+	if (!d)
+	{
+		return NULL;
+	}
+	if (config)
+	{
+		d->config = *config;
+	}
+	if (d->config.capacity == 0)
+	{
+		d->config.capacity = DISPENSE_DEFAULT_CAPACITY;
+	}
+	if (d->config.high_water == 0 || d->config.high_water > d->config.capacity)
+	{
+		d->config.high_water = d->config.capacity;
+	}
+	if (d->config.low_water == 0 || d->config.low_water >= d->config.high_water)
+	{
+		d->config.low_water = d->config.high_water / 4;
+	}
+	if (d->config.threads == 0)
+	{
+		d->config.threads = 1;
+	}
+
+	// Anonymous mapping so the pool can be locked and kept out of core dumps
+	d->pool_bytes = d->config.capacity * ETH_WALLET_RECORD_SIZE;
+	if (eth_huge_alloc(&d->pool_mem, d->pool_bytes) != 0)
+	{
+		free(d);
+		return NULL;
+	}
+	d->pool = d->pool_mem.data;
+	d->locked = mlock(d->pool, d->pool_bytes) == 0;
+#ifdef MADV_DONTDUMP
+	madvise(d->pool, d->pool_bytes, MADV_DONTDUMP);
+#endif
+
+	d->threads = calloc(d->config.threads, sizeof(*d->threads));
+	if (!d->threads)
+	{
+		eth_huge_free(&d->pool_mem);
+		free(d);
+		return NULL;
+	}
+	pthread_mutex_init(&d->lock, NULL);
+	pthread_cond_init(&d->refill, NULL);
+	pthread_cond_init(&d->available, NULL);
+	d->refilling = 1;
+	d->running = d->config.threads;
+
+	for (; d->started < d->config.threads; d->started++)
+	{
+		if (pthread_create(&d->threads[d->started], NULL, dispense_refill_main, d) != 0)
+		{
+			break;
+		}
+	}
+	pthread_mutex_lock(&d->lock);
+	d->running -= d->config.threads - d->started;
+	pthread_mutex_unlock(&d->lock);
+	if (d->started == 0)
+	{
+		eth_dispenser_destroy(d);
+		return NULL;
+	}
+	return d;
+}
+
+void eth_dispenser_destroy(struct eth_dispenser *d)
+{
+	if (!d)
+	{
+		return;
+	}
+	pthread_mutex_lock(&d->lock);
+	d->shutdown = 1;
+	pthread_cond_broadcast(&d->refill);
+	pthread_cond_broadcast(&d->available);
+	pthread_mutex_unlock(&d->lock);
+	for (unsigned int i = 0; i < d->started; i++)
+	{
+		pthread_join(d->threads[i], NULL);
+	}
+
+	OPENSSL_cleanse(d->pool, d->pool_bytes);
+	if (d->locked)
+	{
+		munlock(d->pool, d->pool_bytes);
+	}
+	eth_huge_free(&d->pool_mem);
+	pthread_cond_destroy(&d->available);
+	pthread_cond_destroy(&d->refill);
+	pthread_mutex_destroy(&d->lock);
+	free(d->threads);
+	free(d);
+}
+
+int eth_dispenser_take(struct eth_dispenser *d, unsigned char *records, size_t count)
+{
+	if (!d || !records || count == 0 || count > d->config.high_water)
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock(&d->lock);
+	if (d->count < count)
+	{
+		d->empty_waits++;
+	}
+	while (d->count < count && !d->shutdown && d->running > 0)
+	{
+		d->refilling = 1;
+		pthread_cond_signal(&d->refill);
+		pthread_cond_wait(&d->available, &d->lock);
+	}
+	// Shut down, or every refill thread failed with the pool short
+	if (d->shutdown || d->count < count)
+	{
+		pthread_mutex_unlock(&d->lock);
+		return -1;
+	}
+
+	// Hand out the top of the stack and wipe the slots behind it
+	d->count -= count;
+	unsigned char *top = d->pool + d->count * ETH_WALLET_RECORD_SIZE;
+	memcpy(records, top, count * ETH_WALLET_RECORD_SIZE);
+	OPENSSL_cleanse(top, count * ETH_WALLET_RECORD_SIZE);
+	d->served += count;
+	if (d->count < d->config.low_water && !d->refilling)
+	{
+		d->refilling = 1;
+		pthread_cond_broadcast(&d->refill);
+	}
+	pthread_mutex_unlock(&d->lock);
+	return 0;
+}
+
+void eth_dispenser_stats(struct eth_dispenser *d, struct eth_dispenser_status *status)
+{
+	pthread_mutex_lock(&d->lock);
+	status->available = d->count;
+	status->capacity = d->config.capacity;
+	status->served = d->served;
+	status->generated = d->generated;
+	status->empty_waits = d->empty_waits;
+	status->locked = d->locked;
+	status->pages = d->pool_mem.pages;
+	pthread_mutex_unlock(&d->lock);
+}
+
+void eth_dispenser_stop(struct eth_dispenser *d)
+{
+	atomic_store(&d->stop, 1);
+}
+
+static int dispense_read_full(int fd, unsigned char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t ret = recv(fd, buf, len, 0);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+		buf += ret;
+		len -= (size_t)ret;
+	}
+	return 0;
+}
+
+static int dispense_write_full(int fd, const unsigned char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t ret = send(fd, buf, len, DISPENSE_SEND_FLAGS);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+		buf += ret;
+		len -= (size_t)ret;
+	}
+	return 0;
+}
+
+static int dispense_socket(const char *path, struct sockaddr_un *sun)
+{
+	memset(sun, 0, sizeof(*sun));
+	sun->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(sun->sun_path))
+	{
+		return -1;
+	}
+	strcpy(sun->sun_path, path);
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+// Reads what a readable client sent without blocking and answers once a
+// whole request is in; -1 drops the client
+static int dispense_answer(struct eth_dispenser *d, int fd, struct dispense_client *client, unsigned char *reply)
+{
+	unsigned char *request = client->request;
+	ssize_t got;
+	do
+	{
+		got = recv(fd, request + client->have, sizeof(client->request) - client->have, MSG_DONTWAIT);
+	} while (got < 0 && errno == EINTR);
+	if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+		return 0;
+	}
+	if (got <= 0)
+	{
+		return -1;
+	}
+	client->have += (size_t)got;
+	if (client->have < sizeof(client->request))
+	{
+		return 0;
+	}
+	client->have = 0;
+
+	size_t count = (size_t)request[0] << 8 | request[1];
+	if (count == 0 || count > ETH_DISPENSE_MAX || eth_dispenser_take(d, reply + 2, count) != 0)
+	{
+		reply[0] = reply[1] = 0;
+		dispense_write_full(fd, reply, 2);
+		return -1;
+	}
+	reply[0] = request[0];
+	reply[1] = request[1];
+	int ret = dispense_write_full(fd, reply, 2 + count * ETH_WALLET_RECORD_SIZE);
+	OPENSSL_cleanse(reply + 2, count * ETH_WALLET_RECORD_SIZE);
+	return ret;
+}
+
+int eth_dispenser_serve(struct eth_dispenser *d, const char *path, eth_dispenser_progress_fn progress, void *arg)
+{
+	struct sockaddr_un sun;
+	unsigned char *reply = NULL;
+
+	if (!d || !path)
+	{
+		return -1;
+	}
+	int lfd = dispense_socket(path, &sun);
+	if (lfd < 0)
+	{
+		return -1;
+	}
+	// Wallets are handed out in the clear: only the owner may connect
+	mode_t mask = umask(0177);
+	int bound = eth_unix_socket_clear(sun.sun_path) == 0 &&
+		bind(lfd, (struct sockaddr *)&sun, sizeof(sun)) == 0;
+	umask(mask);
+	if (!bound || listen(lfd, DISPENSE_MAX_CLIENTS) != 0)
+	{
+		close(lfd);
+		return -1;
+	}
+
+	// Reply buffer for the largest request, locked like the pool
+	size_t reply_size = 2 + ETH_DISPENSE_MAX * ETH_WALLET_RECORD_SIZE;
+	reply = malloc(reply_size);
+	if (!reply)
+	{
+		close(lfd);
+		unlink(sun.sun_path);
+		return -1;
+	}
+	int reply_locked = mlock(reply, reply_size) == 0;
+
+	struct pollfd pfds[DISPENSE_MAX_CLIENTS + 1];
+	struct dispense_client clients[DISPENSE_MAX_CLIENTS]; // client i is polled at pfds[i + 1]
+	unsigned int nclients = 0;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	time_t last_report = ts.tv_sec;
+
+	int ret = 0;
+	pfds[0].fd = lfd;
+	pfds[0].events = POLLIN;
+	while (!atomic_load(&d->stop))
+	{
+		// Nothing left to hand out and no thread able to generate more
+		pthread_mutex_lock(&d->lock);
+		int dead = d->running == 0 && d->count == 0;
+		pthread_mutex_unlock(&d->lock);
+		if (dead)
+		{
+			ret = -1;
+			break;
+		}
+
+		int n = poll(pfds, nclients + 1, 250);
+		if (n < 0 && errno != EINTR)
+		{
+			break;
+		}
+
+		for (unsigned int i = 0; n > 0 && i < nclients; i++)
+		{
+			if (!(pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			{
+				continue;
+			}
+			if (dispense_answer(d, pfds[i + 1].fd, &clients[i], reply) != 0)
+			{
+				close(pfds[i + 1].fd);
+				clients[i] = clients[nclients - 1];
+				pfds[i + 1] = pfds[nclients--];
+				i--;
+			}
+		}
+		if (n > 0 && (pfds[0].revents & POLLIN) && nclients < DISPENSE_MAX_CLIENTS)
+		{
+			int fd = accept(lfd, NULL, NULL);
+			if (fd >= 0)
+			{
+				clients[nclients].have = 0;
+				nclients++;
+				pfds[nclients].fd = fd;
+				pfds[nclients].events = POLLIN;
+				pfds[nclients].revents = 0;
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		if (progress && ts.tv_sec != last_report)
+		{
+			struct eth_dispenser_status status;
+			eth_dispenser_stats(d, &status);
+			status.clients = nclients;
+			progress(&status, arg);
+			last_report = ts.tv_sec;
+		}
+	}
+
+	for (unsigned int i = 0; i < nclients; i++)
+	{
+		close(pfds[i + 1].fd);
+	}
+	close(lfd);
+	unlink(sun.sun_path);
+	OPENSSL_cleanse(reply, reply_size);
+	if (reply_locked)
+	{
+		munlock(reply, reply_size);
+	}
+	free(reply);
+	return ret;
+}
+
+int eth_dispenser_connect(const char *path)
+{
+	struct sockaddr_un sun;
+	int fd = path ? dispense_socket(path, &sun) : -1;
+	if (fd < 0)
+	{
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int eth_dispenser_request(int fd, unsigned char *records, size_t count)
+{
+	unsigned char header[2];
+	if (count == 0 || count > ETH_DISPENSE_MAX)
+	{
+		return -1;
+	}
+	header[0] = (unsigned char)(count >> 8);
+	header[1] = (unsigned char)count;
+	if (dispense_write_full(fd, header, sizeof(header)) != 0 ||
+		dispense_read_full(fd, header, sizeof(header)) != 0 ||
+		((size_t)header[0] << 8 | header[1]) != count)
+	{
+		return -1;
+	}
+	return dispense_read_full(fd, records, count * ETH_WALLET_RECORD_SIZE);
+}
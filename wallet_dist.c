@@ -0,0 +1,609 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Wire format: every frame is a 4-byte big-endian type, a 4-byte big-endian
+// payload length and the payload. Integers in payloads are big-endian too.
+// Version 1 had a 4-byte hello (threads only) and no letter-case fields in
+// the job; any change to a payload bumps DIST_VERSION.
+#define DIST_VERSION 2
+#define DIST_HELLO 1  // worker -> coordinator: u32 version, u32 threads
+#define DIST_JOB 2    // coordinator -> worker: pattern value, mask, case value, case mask, base key, u64 shard
+#define DIST_RATE 3   // worker -> coordinator: u64 total attempts
+#define DIST_FOUND 4  // worker -> coordinator: private key
+#define DIST_STOP 5   // coordinator -> worker
+#define DIST_REJECT 6 // coordinator -> worker: u32 version the coordinator speaks
+
+#define DIST_MAX_PAYLOAD 128
+#define DIST_MAX_FRAME (8 + DIST_MAX_PAYLOAD)
+#define DIST_MAX_WORKERS 256
+#define DIST_JOB_SIZE (4 * ETH_ADDRESS_SIZE + ETH_PRIV_KEY_SIZE + 8)
+
+#ifdef MSG_NOSIGNAL
+#define DIST_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define DIST_SEND_FLAGS 0
+#endif
+
+struct dist_worker
+{
+	int fd;
+	unsigned int threads;
+	unsigned long long shard;
+	unsigned long long attempts;
+	// Bytes received but not yet a whole frame: the coordinator never
+	// blocks on one worker's half-sent frame
+	unsigned char in[DIST_MAX_FRAME];
+	size_t have;
+};
+
+static void put_u32(unsigned char *p, unsigned int v)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		p[i] = (unsigned char)(v >> (24 - 8 * i));
+	}
+}
+
+static void put_u64(unsigned char *p, unsigned long long v)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		p[i] = (unsigned char)(v >> (56 - 8 * i));
+	}
+}
+
+static unsigned int get_u32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+static unsigned long long get_u64(const unsigned char *p)
+{
+	unsigned long long v = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		v = (v << 8) | p[i];
+	}
+	return v;
+}
+
+static double dist_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int dist_send(int fd, unsigned int type, const unsigned char *payload, size_t len)
+{
+	unsigned char frame[DIST_MAX_FRAME];
+	put_u32(frame, type);
+	put_u32(frame + 4, (unsigned int)len);
+	if (len > 0)
+	{
+		memcpy(frame + 8, payload, len);
+	}
+
+	size_t off = 0;
+	while (off < 8 + len)
+	{
+		ssize_t ret = send(fd, frame + off, 8 + len - off, DIST_SEND_FLAGS);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			OPENSSL_cleanse(frame, sizeof(frame));
+			return -1;
+		}
+		off += (size_t)ret;
+	}
+	OPENSSL_cleanse(frame, sizeof(frame));
+	return 0;
+}
+
+static int dist_read_full(int fd, unsigned char *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t ret = recv(fd, buf, len, 0);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+		buf += ret;
+		len -= (size_t)ret;
+	}
+	return 0;
+}
+
+// Returns the payload length, -1 on EOF, error or an oversized frame
+static int dist_recv(int fd, unsigned int *type, unsigned char *payload)
+{
+	unsigned char header[8];
+	if (dist_read_full(fd, header, sizeof(header)) != 0)
+	{
+		return -1;
+	}
+	*type = get_u32(header);
+	unsigned int len = get_u32(header + 4);
+	if (len > DIST_MAX_PAYLOAD || dist_read_full(fd, payload, len) != 0)
+	{
+		return -1;
+	}
+	return (int)len;
+}
+
+// Appends what the worker has sent to its buffer without blocking;
+// -1 once the connection is closed or broken
+static int dist_fill(struct dist_worker *w)
+{
+	for (;;)
+	{
+		ssize_t ret = recv(w->fd, w->in + w->have, sizeof(w->in) - w->have, MSG_DONTWAIT);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return 0;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+		w->have += (size_t)ret;
+		return 0;
+	}
+}
+
+int eth_unix_socket_clear(const char *path)
+{
+	struct sockaddr_un sun;
+	struct stat st;
+
+	if (lstat(path, &st) != 0)
+	{
+		return errno == ENOENT ? 0 : -1;
+	}
+	if (!S_ISSOCK(st.st_mode) || strlen(path) >= sizeof(sun.sun_path))
+	{
+		return -1;
+	}
+
+	// Only a socket nobody accepts on is stale
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	int stale = connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0 && errno == ECONNREFUSED;
+	close(fd);
+	if (!stale)
+	{
+		return -1;
+	}
+	return unlink(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+// "unix:/path" for a local socket, otherwise "host:port" or ":port"
+static int dist_socket(const char *address, int listening)
+{
+	if (strncmp(address, "unix:", 5) == 0)
+	{
+		struct sockaddr_un sun;
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		if (strlen(address + 5) >= sizeof(sun.sun_path))
+		{
+			return -1;
+		}
+		strcpy(sun.sun_path, address + 5);
+
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0)
+		{
+			return -1;
+		}
+		if (listening)
+		{
+			if (eth_unix_socket_clear(sun.sun_path) == 0 && bind(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0 && listen(fd, DIST_MAX_WORKERS) == 0)
+			{
+				return fd;
+			}
+		}
+		else if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) == 0)
+		{
+			return fd;
+		}
+		close(fd);
+		return -1;
+	}
+
+	const char *colon = strrchr(address, ':');
+	if (!colon)
+	{
+		return -1;
+	}
+	char host[256];
+	size_t hlen = (size_t)(colon - address);
+	if (hlen >= sizeof(host))
+	{
+		return -1;
+	}
+	memcpy(host, address, hlen);
+	host[hlen] = '\0';
+
+	struct addrinfo hints, *res, *ai;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = listening ? AI_PASSIVE : 0;
+	if (getaddrinfo(hlen ? host : NULL, colon + 1, &hints, &res) != 0)
+	{
+		return -1;
+	}
+
+	int fd = -1;
+	for (ai = res; ai; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0)
+		{
+			continue;
+		}
+		int one = 1;
+		if (listening)
+		{
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+			if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, DIST_MAX_WORKERS) == 0)
+			{
+				break;
+			}
+		}
+		else if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+		{
+			setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+static int dist_send_job(struct dist_worker *w, const struct eth_search_pattern *pattern, const unsigned char *base_key)
+{
+	unsigned char job[DIST_JOB_SIZE];
+	memcpy(job, pattern->value, ETH_ADDRESS_SIZE);
+	memcpy(job + ETH_ADDRESS_SIZE, pattern->mask, ETH_ADDRESS_SIZE);
+	memcpy(job + 2 * ETH_ADDRESS_SIZE, pattern->case_value, ETH_ADDRESS_SIZE);
+	memcpy(job + 3 * ETH_ADDRESS_SIZE, pattern->case_mask, ETH_ADDRESS_SIZE);
+	memcpy(job + 4 * ETH_ADDRESS_SIZE, base_key, ETH_PRIV_KEY_SIZE);
+	put_u64(job + 4 * ETH_ADDRESS_SIZE + ETH_PRIV_KEY_SIZE, w->shard);
+	int ret = dist_send(w->fd, DIST_JOB, job, sizeof(job));
+	OPENSSL_cleanse(job, sizeof(job));
+	return ret;
+}
+
+// Re-derive the claimed key from scratch; a worker's word is not enough
+static int dist_confirm(const struct eth_search_pattern *pattern, const unsigned char *priv_key,
+	struct eth_search_result *result)
+{
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	unsigned char address[ETH_ADDRESS_SIZE];
+	int ok = 0;
+
+	if (!ctx)
+	{
+		return 0;
+	}
+	if (secp256k1_ec_seckey_verify(ctx, priv_key) &&
+		eth_seckey_to_address(ctx, priv_key, address) == 0 &&
+		eth_search_pattern_match(pattern, address))
+	{
+		memcpy(result->priv_key, priv_key, ETH_PRIV_KEY_SIZE);
+		memcpy(result->address, address, ETH_ADDRESS_SIZE);
+		ok = 1;
+	}
+	secp256k1_context_destroy(ctx);
+	return ok;
+}
+
+int eth_dist_coordinate(const char *address, const struct eth_search_pattern *pattern,
+	eth_dist_progress_fn progress, void *arg, struct eth_search_result *result)
+{
+	if (!address || !pattern || !result)
+	{
+		return -1;
+	}
+
+	int lfd = dist_socket(address, 1);
+	if (lfd < 0)
+	{
+		return -1;
+	}
+
+	unsigned char base_key[ETH_PRIV_KEY_SIZE];
+	if (eth_random_private_key(base_key) != 0)
+	{
+		close(lfd);
+		return -1;
+	}
+
+	struct pollfd pfds[DIST_MAX_WORKERS + 1];
+	struct dist_worker workers[DIST_MAX_WORKERS];
+	unsigned int nworkers = 0;
+	unsigned long long next_shard = 0;
+	unsigned long long retired = 0; // attempts of workers that left
+	unsigned long long last_total = 0;
+	double last_report = dist_now();
+	int found = 0;
+
+	while (!found)
+	{
+		pfds[0].fd = lfd;
+		pfds[0].events = POLLIN;
+		for (unsigned int i = 0; i < nworkers; i++)
+		{
+			pfds[i + 1].fd = workers[i].fd;
+			pfds[i + 1].events = POLLIN;
+			pfds[i + 1].revents = 0;
+		}
+
+		int n = poll(pfds, nworkers + 1, 250);
+		if (n < 0 && errno != EINTR)
+		{
+			break;
+		}
+
+		if (n > 0 && (pfds[0].revents & POLLIN) && nworkers < DIST_MAX_WORKERS)
+		{
+			int fd = accept(lfd, NULL, NULL);
+			if (fd >= 0)
+			{
+				workers[nworkers].fd = fd;
+				workers[nworkers].threads = 0;
+				workers[nworkers].shard = 0;
+				workers[nworkers].attempts = 0;
+				workers[nworkers].have = 0;
+				// Not polled yet: clear the slot so neither the loop below nor
+				// a swap into a dropped worker's place reads stale events
+				pfds[nworkers + 1].fd = fd;
+				pfds[nworkers + 1].revents = 0;
+				nworkers++;
+			}
+		}
+
+		for (unsigned int i = 0; n > 0 && i < nworkers && !found; i++)
+		{
+			struct dist_worker *w = &workers[i];
+			if (!(pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+			{
+				continue;
+			}
+
+			// Whole frames first: a worker may send its last ones and close
+			int closed = dist_fill(w) != 0;
+			int drop = 0;
+			while (!drop && !found && w->have >= 8)
+			{
+				unsigned int type = get_u32(w->in);
+				unsigned int len = get_u32(w->in + 4);
+				const unsigned char *payload = w->in + 8;
+				if (len > DIST_MAX_PAYLOAD)
+				{
+					drop = 1;
+					break;
+				}
+				if (w->have < 8 + len)
+				{
+					break;
+				}
+
+				if (type == DIST_HELLO && w->threads == 0 && (len != 8 || get_u32(payload) != DIST_VERSION))
+				{
+					// Another protocol version (a version 1 hello is 4 bytes):
+					// say which one this side speaks rather than misread the job
+					unsigned char version[4];
+					put_u32(version, DIST_VERSION);
+					dist_send(w->fd, DIST_REJECT, version, sizeof(version));
+					drop = 1;
+				}
+				else if (type == DIST_HELLO && w->threads == 0)
+				{
+					w->threads = get_u32(payload + 4);
+					w->shard = next_shard++;
+					drop = w->threads == 0 || dist_send_job(w, pattern, base_key) != 0;
+				}
+				else if (type == DIST_RATE && len == 8)
+				{
+					w->attempts = get_u64(payload);
+				}
+				else if (type == DIST_FOUND && len == ETH_PRIV_KEY_SIZE)
+				{
+					found = dist_confirm(pattern, payload, result);
+					drop = !found;
+				}
+				else
+				{
+					drop = 1;
+				}
+
+				w->have -= 8 + len;
+				memmove(w->in, w->in + 8 + len, w->have);
+				OPENSSL_cleanse(w->in + w->have, 8 + len);
+			}
+			drop |= closed;
+
+			if (drop && !found)
+			{
+				retired += w->attempts;
+				OPENSSL_cleanse(w->in, sizeof(w->in));
+				close(w->fd);
+				workers[i] = workers[--nworkers];
+				pfds[i + 1] = pfds[nworkers + 1];
+				i--;
+			}
+		}
+
+		double now = dist_now();
+		if (progress && (now - last_report >= 1.0 || found))
+		{
+			struct eth_dist_status status = {.workers = nworkers};
+			status.attempts = retired;
+			for (unsigned int i = 0; i < nworkers; i++)
+			{
+				status.attempts += workers[i].attempts;
+			}
+			status.rate = (status.attempts - last_total) / (now - last_report);
+			last_total = status.attempts;
+			last_report = now;
+			progress(&status, arg);
+		}
+	}
+
+	for (unsigned int i = 0; i < nworkers; i++)
+	{
+		if (found)
+		{
+			dist_send(workers[i].fd, DIST_STOP, NULL, 0);
+		}
+		close(workers[i].fd);
+	}
+	OPENSSL_cleanse(workers, sizeof(workers));
+	close(lfd);
+	if (strncmp(address, "unix:", 5) == 0)
+	{
+		unlink(address + 5);
+	}
+	OPENSSL_cleanse(base_key, sizeof(base_key));
+	return found ? 0 : -1;
+}
+
+int eth_dist_work(const char *address, unsigned int threads)
+{
+	if (!address)
+	{
+		return -1;
+	}
+
+	struct eth_search_config config;
+	memset(&config, 0, sizeof(config));
+	config.threads = threads ? threads : eth_online_cpus();
+
+	int fd = dist_socket(address, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	unsigned char payload[DIST_MAX_PAYLOAD];
+	unsigned int type;
+	put_u32(payload, DIST_VERSION);
+	put_u32(payload + 4, config.threads);
+	int len = dist_send(fd, DIST_HELLO, payload, 8) == 0 ? dist_recv(fd, &type, payload) : -1;
+	if (len == 4 && type == DIST_REJECT)
+	{
+		close(fd);
+		return ETH_DIST_VERSION_MISMATCH;
+	}
+	if (len != DIST_JOB_SIZE || type != DIST_JOB)
+	{
+		close(fd);
+		return -1;
+	}
+	memcpy(config.pattern.value, payload, ETH_ADDRESS_SIZE);
+	memcpy(config.pattern.mask, payload + ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+	memcpy(config.pattern.case_value, payload + 2 * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+	memcpy(config.pattern.case_mask, payload + 3 * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+	memcpy(config.base_key, payload + 4 * ETH_ADDRESS_SIZE, ETH_PRIV_KEY_SIZE);
+	config.shard = get_u64(payload + 4 * ETH_ADDRESS_SIZE + ETH_PRIV_KEY_SIZE);
+	OPENSSL_cleanse(payload, sizeof(payload));
+
+	struct eth_search *search = eth_search_start(&config);
+	OPENSSL_cleanse(&config, sizeof(config));
+	if (!search)
+	{
+		close(fd);
+		return -1;
+	}
+
+	int ret = -1;
+	int reported = 0;
+	double last_rate = 0;
+	for (;;)
+	{
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		int n = poll(&pfd, 1, 100);
+		if (n < 0 && errno != EINTR)
+		{
+			break;
+		}
+		if (n > 0)
+		{
+			// STOP, or the coordinator went away
+			int len = dist_recv(fd, &type, payload);
+			ret = len == 0 && type == DIST_STOP ? 0 : -1;
+			break;
+		}
+
+		struct eth_search_result result;
+		int polled = reported ? 0 : eth_search_poll(search, &result);
+		if (polled < 0)
+		{
+			break;
+		}
+		if (polled)
+		{
+			int sent = dist_send(fd, DIST_FOUND, result.priv_key, ETH_PRIV_KEY_SIZE);
+			OPENSSL_cleanse(&result, sizeof(result));
+			if (sent != 0)
+			{
+				break;
+			}
+			reported = 1;
+		}
+
+		double now = dist_now();
+		if (now - last_rate >= 1.0)
+		{
+			unsigned char rate[8];
+			put_u64(rate, eth_search_attempts(search));
+			if (dist_send(fd, DIST_RATE, rate, sizeof(rate)) != 0)
+			{
+				break;
+			}
+			last_rate = now;
+		}
+	}
+
+	eth_search_free(search);
+	close(fd);
+	return ret;
+}
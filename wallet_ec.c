@@ -0,0 +1,278 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define FE_M52 0xFFFFFFFFFFFFFULL
+#define FE_M48 0xFFFFFFFFFFFFULL
+#define FE_K 0x1000003D1ULL
+
+// Points per walk in eth_sequential_addresses
+#define SEQUENTIAL_WALK 256
+
+static uint64_t load64_be(const unsigned char *p)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		v = v << 8 | p[i];
+	}
+	return v;
+}
+
+static void store64_be(unsigned char *p, uint64_t v)
+{
+	for (int i = 7; i >= 0; i--)
+	{
+		p[i] = (unsigned char)v;
+		v >>= 8;
+	}
+}
+
+static void fe_from_bytes(uint64_t *r, const unsigned char *b32)
+{
+	uint64_t w0 = load64_be(b32 + 24), w1 = load64_be(b32 + 16), w2 = load64_be(b32 + 8), w3 = load64_be(b32);
+	r[0] = w0 & FE_M52;
+	r[1] = (w0 >> 52 | w1 << 12) & FE_M52;
+	r[2] = (w1 >> 40 | w2 << 24) & FE_M52;
+	r[3] = (w2 >> 28 | w3 << 36) & FE_M52;
+	r[4] = w3 >> 16;
+}
+
+// Weak form (below 2p) to the canonical value below p, as big-endian bytes
+static void fe_to_bytes(unsigned char *b32, const uint64_t *a)
+{
+	uint64_t t[5];
+	uint64_t c = a[0] + FE_K;
+
+	// a >= p exactly when a + (2^256 - p) reaches 2^256
+	t[0] = c & FE_M52;
+	for (int i = 1; i < 5; i++)
+	{
+		c = a[i] + (c >> 52);
+		t[i] = c & FE_M52;
+	}
+	const uint64_t *v = (t[4] >> 48) ? t : a;
+	uint64_t l4 = v[4] & FE_M48;
+
+	store64_be(b32 + 24, v[0] | v[1] << 52);
+	store64_be(b32 + 16, v[1] >> 12 | v[2] << 40);
+	store64_be(b32 + 8, v[2] >> 24 | v[3] << 28);
+	store64_be(b32, v[3] >> 36 | l4 << 16);
+}
+
+int eth_ec_walk_init(struct eth_ec_walk *walk, size_t n, const unsigned char *step64)
+{
+	memset(walk, 0, sizeof(*walk));
+	if (n == 0 || n % ETH_EC_WALK_LANES != 0)
+	{
+		return -1;
+	}
+	walk->n = n;
+	walk->x = calloc(5 * n, sizeof(uint64_t));
+	walk->y = calloc(5 * n, sizeof(uint64_t));
+	walk->scratch = calloc(10 * n, sizeof(uint64_t));
+	if (!walk->x || !walk->y || !walk->scratch)
+	{
+		eth_ec_walk_free(walk);
+		return -1;
+	}
+	fe_from_bytes(walk->qx, step64);
+	fe_from_bytes(walk->qy, step64 + 32);
+	return 0;
+}
+
+void eth_ec_walk_free(struct eth_ec_walk *walk)
+{
+	free(walk->x);
+	free(walk->y);
+	free(walk->scratch);
+	memset(walk, 0, sizeof(*walk));
+}
+
+void eth_ec_walk_set(struct eth_ec_walk *walk, size_t i, const unsigned char *pub64)
+{
+	uint64_t x[5], y[5];
+	fe_from_bytes(x, pub64);
+	fe_from_bytes(y, pub64 + 32);
+	for (int j = 0; j < 5; j++)
+	{
+		walk->x[j * walk->n + i] = x[j];
+		walk->y[j * walk->n + i] = y[j];
+	}
+}
+
+void eth_ec_walk_get(const struct eth_ec_walk *walk, size_t i, unsigned char *pub64)
+{
+	uint64_t x[5], y[5];
+	for (int j = 0; j < 5; j++)
+	{
+		x[j] = walk->x[j * walk->n + i];
+		y[j] = walk->y[j * walk->n + i];
+	}
+	fe_to_bytes(pub64, x);
+	fe_to_bytes(pub64 + 32, y);
+}
+
+int eth_ec_walk_step(struct eth_ec_walk *walk)
+{
+	return eth_ec_walk_kernel(walk->x, walk->y, walk->n, walk->qx, walk->qy, walk->scratch);
+}
+
+int eth_ec_pubkey64(const secp256k1_context *ctx, const unsigned char *priv_key, unsigned char *pub64)
+{
+	secp256k1_pubkey pubkey;
+	unsigned char pub_key[65];
+	size_t pubkey_len = 65;
+
+	if (!eth_backend_default(ETH_BACKEND_EC))
+	{
+		return eth_backend_pubkey64(priv_key, pub64);
+	}
+	if (!secp256k1_ec_pubkey_create(ctx, &pubkey, priv_key))
+	{
+		return -1;
+	}
+	secp256k1_ec_pubkey_serialize(ctx, pub_key, &pubkey_len, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+	memcpy(pub64, pub_key + 1, 64);
+	return 0;
+}
+
+// key + offset as a 256-bit scalar; fails only if that wraps to zero
+static int sequential_key(const unsigned char *start_key, unsigned long long offset, unsigned char *key)
+{
+	unsigned char tweak[32] = {0};
+	memcpy(key, start_key, ETH_PRIV_KEY_SIZE);
+	if (offset == 0)
+	{
+		return 1;
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		tweak[31 - i] = (unsigned char)(offset >> (8 * i));
+	}
+	return secp256k1_ec_seckey_tweak_add(secp256k1_context_static, key, tweak);
+}
+
+// With a precomputed table of iG: P = (start_key + base) * G is the only
+// multiplication. Lane i starts at iG and one walk step with P as the
+// addend gives P + iG; lane 0, which would need the point at infinity,
+// starts at nG instead and is set to P afterwards.
+static int walk_reset_table(struct eth_ec_walk *walk, const secp256k1_context *ctx, const unsigned char *start_key,
+	unsigned long long base, const unsigned char *table)
+{
+	unsigned char key[ETH_PRIV_KEY_SIZE];
+	unsigned char pub64[64];
+	uint64_t qx[5], qy[5];
+
+	int ok = sequential_key(start_key, base, key) && eth_ec_pubkey64(ctx, key, pub64) == 0;
+	OPENSSL_cleanse(key, sizeof(key));
+	if (!ok)
+	{
+		return -1;
+	}
+	eth_ec_walk_set(walk, 0, table + (walk->n - 1) * 64);
+	for (size_t i = 1; i < walk->n; i++)
+	{
+		eth_ec_walk_set(walk, i, table + (i - 1) * 64);
+	}
+	memcpy(qx, walk->qx, sizeof(qx));
+	memcpy(qy, walk->qy, sizeof(qy));
+	fe_from_bytes(walk->qx, pub64);
+	fe_from_bytes(walk->qy, pub64 + 32);
+	int ret = eth_ec_walk_step(walk);
+	memcpy(walk->qx, qx, sizeof(qx));
+	memcpy(walk->qy, qy, sizeof(qy));
+	if (ret == 0)
+	{
+		eth_ec_walk_set(walk, 0, pub64);
+	}
+	return ret;
+}
+
+// (Re)load walk point i with start_key + base + i: from the precomputed
+// table if one is loaded, otherwise (or if P is one of the table's points)
+// by one full multiplication per point
+int eth_ec_walk_reset(struct eth_ec_walk *walk, const secp256k1_context *ctx, const unsigned char *start_key,
+	unsigned long long base)
+{
+	unsigned char key[ETH_PRIV_KEY_SIZE];
+	unsigned char pub64[64];
+	int ret = 0;
+
+	const unsigned char *table = eth_ec_table_points(walk->n);
+	if (table && walk_reset_table(walk, ctx, start_key, base, table) == 0)
+	{
+		return 0;
+	}
+
+	for (size_t i = 0; i < walk->n && ret == 0; i++)
+	{
+		if (!sequential_key(start_key, base + i, key) || eth_ec_pubkey64(ctx, key, pub64) != 0)
+		{
+			ret = -1;
+			break;
+		}
+		eth_ec_walk_set(walk, i, pub64);
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	return ret;
+}
+
+int eth_sequential_addresses(const unsigned char *start_key, size_t count, unsigned char *addresses)
+{
+	struct eth_ec_walk walk;
+	unsigned char step[32] = {0};
+	unsigned char step64[64];
+	unsigned char pub64[64];
+	unsigned long long done = 0;
+	int ret = -1;
+
+	if (!start_key || (!addresses && count))
+	{
+		return -1;
+	}
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!ctx)
+	{
+		return -1;
+	}
+
+	// Point i holds start + done + i; each step adds SEQUENTIAL_WALK * G
+	step[31] = SEQUENTIAL_WALK & 0xff;
+	step[30] = SEQUENTIAL_WALK >> 8;
+	if (eth_ec_pubkey64(ctx, step, step64) != 0 || eth_ec_walk_init(&walk, SEQUENTIAL_WALK, step64) != 0)
+	{
+		secp256k1_context_destroy(ctx);
+		return -1;
+	}
+	if (eth_ec_walk_reset(&walk, ctx, start_key, 0) != 0)
+	{
+		goto out;
+	}
+
+	while (done < count)
+	{
+		size_t n = count - done < SEQUENTIAL_WALK ? count - done : SEQUENTIAL_WALK;
+		for (size_t i = 0; i < n; i++)
+		{
+			eth_ec_walk_get(&walk, i, pub64);
+			eth_pubkey_to_address(pub64, addresses + (done + i) * ETH_ADDRESS_SIZE);
+		}
+		done += n;
+		if (done < count && eth_ec_walk_step(&walk) != 0 &&
+			eth_ec_walk_reset(&walk, ctx, start_key, done) != 0)
+		{
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	eth_ec_walk_free(&walk);
+	secp256k1_context_destroy(ctx);
+	return ret;
+}
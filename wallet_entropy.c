@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// File bytes claimed per ledger update, so the lock and fsync are paid once
+// per 64 MB rather than per draw
+#define ENTROPY_RESERVE (64UL << 20)
+#define LEDGER_MAGIC "walgen-entropy-used"
+
+static pthread_mutex_t entropy_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct eth_entropy_source entropy_source;
+static int entropy_installed;
+static atomic_ullong entropy_used;
+
+int eth_entropy_install(const struct eth_entropy_source *source)
+{
+	struct eth_entropy_source old;
+	int had;
+
+	if (source && !source->read)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&entropy_lock);
+	old = entropy_source;
+	had = entropy_installed;
+	if (source)
+	{
+		entropy_source = *source;
+	}
+	entropy_installed = source != NULL;
+	atomic_store(&entropy_used, 0);
+	pthread_mutex_unlock(&entropy_lock);
+
+	if (had && old.close)
+	{
+		old.close(old.ctx);
+	}
+	return 0;
+}
+
+int eth_entropy_installed(void)
+{
+	return entropy_installed;
+}
+
+int eth_entropy_detach(struct eth_entropy_source *source, unsigned long long *used)
+{
+	pthread_mutex_lock(&entropy_lock);
+	int had = entropy_installed;
+	*source = entropy_source;
+	*used = atomic_load(&entropy_used);
+	entropy_installed = 0;
+	pthread_mutex_unlock(&entropy_lock);
+	return had;
+}
+
+void eth_entropy_attach(const struct eth_entropy_source *source, unsigned long long used)
+{
+	pthread_mutex_lock(&entropy_lock);
+	entropy_source = *source;
+	entropy_installed = 1;
+	atomic_store(&entropy_used, used);
+	pthread_mutex_unlock(&entropy_lock);
+}
+
+unsigned long long eth_entropy_used(void)
+{
+	return atomic_load(&entropy_used);
+}
+
+int eth_key_material(unsigned char *buf, size_t len)
+{
+	// Installing is documented as a before-generation step, so the hot path
+	// reads the source without taking the lock
+	if (!entropy_installed)
+	{
+		secure_random(buf, len);
+		return 0;
+	}
+	if (entropy_source.read(entropy_source.ctx, buf, len) != 0)
+	{
+		OPENSSL_cleanse(buf, len);
+		return -1;
+	}
+	atomic_fetch_add_explicit(&entropy_used, len, memory_order_relaxed);
+	return 0;
+}
+
+// File backend: a regular file is mapped and cut into slices by one atomic
+// add, so threads never contend on a lock for their draws. The slices come
+// from chunks of up to ENTROPY_RESERVE bytes claimed through the ledger
+// (`<file>.used`), which records how far the file may have been handed out.
+// A claim holds an exclusive flock on the ledger across reading, advancing
+// and syncing it, so processes sharing the file get disjoint chunks. Closing
+// gives back the unused tail of the last chunk when no one claimed after
+// it. A crash therefore skips some unused entropy but never hands the same
+// bytes out twice, across runs and processes included. Pipes and devices
+// are read under a lock instead; reading them consumes the bytes anyway.
+struct entropy_chunk
+{
+	size_t base;
+	size_t limit;
+	atomic_size_t used; // bytes drawn from base, may run past limit
+	struct entropy_chunk *prev;
+};
+
+struct entropy_file
+{
+	int fd;
+	int ledger;
+	int flags;
+	unsigned char *map;
+	size_t size;
+	_Alignas(64) _Atomic(struct entropy_chunk *) chunk;
+	pthread_mutex_t lock;
+};
+
+static int ledger_read(int fd, size_t *used)
+{
+	char text[64];
+	unsigned long long value;
+	ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+
+	if (n == 0)
+	{
+		*used = 0;
+		return 0;
+	}
+	if (n < 0)
+	{
+		return -1;
+	}
+	text[n] = '\0';
+	if (sscanf(text, LEDGER_MAGIC " %llu", &value) != 1)
+	{
+		return -1;
+	}
+	*used = (size_t)value;
+	return 0;
+}
+
+static int ledger_write(int fd, size_t used)
+{
+	char text[64];
+	int n = snprintf(text, sizeof(text), "%s %020llu\n", LEDGER_MAGIC, (unsigned long long)used);
+	return pwrite(fd, text, (size_t)n, 0) == n && fdatasync(fd) == 0 ? 0 : -1;
+}
+
+// Slow path of a draw: `seen` has no room for `len` more bytes. Another
+// thread may have claimed a chunk meanwhile; otherwise claim one from the
+// ledger, with the draw at its start.
+static int entropy_claim(struct entropy_file *f, struct entropy_chunk *seen, size_t len, size_t *pos)
+{
+	int ret = -1;
+
+	pthread_mutex_lock(&f->lock);
+	struct entropy_chunk *c = atomic_load(&f->chunk);
+	if (c != seen)
+	{
+		size_t off = atomic_fetch_add(&c->used, len);
+		if (off <= c->limit - c->base && len <= c->limit - c->base - off)
+		{
+			*pos = c->base + off;
+			pthread_mutex_unlock(&f->lock);
+			return 0;
+		}
+	}
+
+	struct entropy_chunk *next = malloc(sizeof(*next));
+	size_t mark;
+	if (next && flock(f->ledger, LOCK_EX) == 0)
+	{
+		if (ledger_read(f->ledger, &mark) == 0 && mark <= f->size && len <= f->size - mark)
+		{
+			size_t want = len > ENTROPY_RESERVE ? len : ENTROPY_RESERVE;
+			next->base = mark;
+			next->limit = want < f->size - mark ? mark + want : f->size;
+			atomic_init(&next->used, len);
+			next->prev = c;
+			if (ledger_write(f->ledger, next->limit) == 0)
+			{
+				atomic_store(&f->chunk, next);
+				*pos = mark;
+				next = NULL;
+				ret = 0;
+			}
+		}
+		flock(f->ledger, LOCK_UN);
+	}
+	free(next);
+	pthread_mutex_unlock(&f->lock);
+	return ret;
+}
+
+static void entropy_mix(struct entropy_file *f, unsigned char *buf, const unsigned char *src, size_t len)
+{
+	if (!(f->flags & ETH_ENTROPY_MIX_OS))
+	{
+		memcpy(buf, src, len);
+		return;
+	}
+	secure_random(buf, len);
+	for (size_t i = 0; i < len; i++)
+	{
+		buf[i] ^= src[i];
+	}
+}
+
+static int entropy_stream_read(struct entropy_file *f, unsigned char *buf, size_t len)
+{
+	unsigned char chunk[4096];
+	int ret = 0;
+
+	pthread_mutex_lock(&f->lock);
+	for (size_t done = 0; done < len && ret == 0;)
+	{
+		size_t want = len - done < sizeof(chunk) ? len - done : sizeof(chunk);
+		ssize_t n = read(f->fd, chunk, want);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			ret = -1; // writer closed or failed: out of entropy
+			break;
+		}
+		entropy_mix(f, buf + done, chunk, (size_t)n);
+		done += (size_t)n;
+	}
+	pthread_mutex_unlock(&f->lock);
+	OPENSSL_cleanse(chunk, sizeof(chunk));
+	return ret;
+}
+
+static int entropy_file_read(void *ctx, unsigned char *buf, size_t len)
+{
+	struct entropy_file *f = ctx;
+	if (!f->map)
+	{
+		return entropy_stream_read(f, buf, len);
+	}
+
+	struct entropy_chunk *c = atomic_load_explicit(&f->chunk, memory_order_acquire);
+	size_t off = atomic_fetch_add_explicit(&c->used, len, memory_order_relaxed);
+	if (off <= c->limit - c->base && len <= c->limit - c->base - off)
+	{
+		off += c->base;
+	}
+	else if (entropy_claim(f, c, len, &off) != 0)
+	{
+		return -1;
+	}
+	entropy_mix(f, buf, f->map + off, len);
+	return 0;
+}
+
+static void entropy_file_close(void *ctx)
+{
+	struct entropy_file *f = ctx;
+	if (f->map)
+	{
+		munmap(f->map, f->size);
+	}
+	struct entropy_chunk *c = atomic_load(&f->chunk);
+	// Give back the unused tail of the last chunk unless someone claimed
+	// past it; only a crash or a later claim loses it
+	if (c && c->limit > c->base && flock(f->ledger, LOCK_EX) == 0)
+	{
+		size_t mark;
+		size_t used = atomic_load(&c->used);
+		if (ledger_read(f->ledger, &mark) == 0 && mark == c->limit && used < c->limit - c->base)
+		{
+			ledger_write(f->ledger, c->base + used);
+		}
+		flock(f->ledger, LOCK_UN);
+	}
+	while (c)
+	{
+		struct entropy_chunk *prev = c->prev;
+		free(c);
+		c = prev;
+	}
+	if (f->ledger >= 0)
+	{
+		close(f->ledger);
+	}
+	close(f->fd);
+	pthread_mutex_destroy(&f->lock);
+	free(f);
+}
+
+int eth_entropy_file_open(const char *path, int flags, struct eth_entropy_source *source)
+{
+	struct stat st;
+	if (!path || !source)
+	{
+		return -1;
+	}
+
+	struct entropy_file *f = calloc(1, sizeof(*f));
+	if (!f)
+	{
+		return -1;
+	}
+	f->fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY | O_CLOEXEC);
+	f->ledger = -1;
+	f->flags = flags;
+	pthread_mutex_init(&f->lock, NULL);
+	if (f->fd < 0 || fstat(f->fd, &st) != 0)
+	{
+		goto fail;
+	}
+
+	if (S_ISREG(st.st_mode))
+	{
+		size_t plen = strlen(path);
+		char *ledger = malloc(plen + 6);
+		size_t used = 0;
+		if (!ledger)
+		{
+			goto fail;
+		}
+		memcpy(ledger, path, plen);
+		memcpy(ledger + plen, ".used", 6);
+		f->ledger = open(ledger, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+		free(ledger);
+		if (f->ledger < 0 || ledger_read(f->ledger, &used) != 0)
+		{
+			goto fail;
+		}
+
+		f->size = (size_t)st.st_size;
+		if (used >= f->size)
+		{
+			goto fail; // already used up
+		}
+		f->map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+		if (f->map == MAP_FAILED)
+		{
+			f->map = NULL;
+			goto fail;
+		}
+		madvise(f->map, f->size, MADV_SEQUENTIAL);
+		// Empty, so the first draw claims a chunk
+		struct entropy_chunk *empty = calloc(1, sizeof(*empty));
+		if (!empty)
+		{
+			goto fail;
+		}
+		atomic_init(&f->chunk, empty);
+	}
+	else if (!S_ISFIFO(st.st_mode) && !S_ISCHR(st.st_mode) && !S_ISSOCK(st.st_mode))
+	{
+		goto fail;
+	}
+
+	source->read = entropy_file_read;
+	source->close = entropy_file_close;
+	source->ctx = f;
+	return 0;
+
+fail:
+	if (f->map)
+	{
+		munmap(f->map, f->size);
+	}
+	if (f->fd >= 0)
+	{
+		close(f->fd);
+	}
+	if (f->ledger >= 0)
+	{
+		close(f->ledger);
+	}
+	pthread_mutex_destroy(&f->lock);
+	free(f);
+	return -1;
+}
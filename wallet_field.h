@@ -0,0 +1,429 @@
+// secp256k1 field arithmetic and batched affine point stepping, compiled
+// by wallet_kernels.c like wallet_kernels.h: the 64-bit code once, the IFMA
+// code (KERNEL_IFMA with KERNEL_VECTOR_ONLY) once more.
+//
+// Elements are 5 limbs of 52 bits, least significant first, kept in a weak
+// form: limbs 0-3 below 2^52, limb 4 below 2^49, value below 2p. Every
+// operation returns that form, so inputs always fit a 52-bit multiplier.
+
+#define KERNEL_CAT_(a, b) a##_##b
+#define KERNEL_CAT(a, b) KERNEL_CAT_(a, b)
+#define KERNEL_FN(name) KERNEL_CAT(name, KERNEL_SUFFIX)
+
+#ifndef KERNEL_VECTOR_ONLY
+static KERNEL_TARGET inline void KERNEL_FN(fe_carry)(uint64_t *r)
+{
+	r[1] += r[0] >> 52;
+	r[0] &= FE_M52;
+	r[2] += r[1] >> 52;
+	r[1] &= FE_M52;
+	r[3] += r[2] >> 52;
+	r[2] &= FE_M52;
+	r[4] += r[3] >> 52;
+	r[3] &= FE_M52;
+	// Bits from 2^256 up come back in as multiples of 2^256 mod p
+	r[0] += (r[4] >> 48) * FE_K;
+	r[4] &= FE_M48;
+	r[1] += r[0] >> 52;
+	r[0] &= FE_M52;
+	r[2] += r[1] >> 52;
+	r[1] &= FE_M52;
+	r[3] += r[2] >> 52;
+	r[2] &= FE_M52;
+	r[4] += r[3] >> 52;
+	r[3] &= FE_M52;
+}
+
+static KERNEL_TARGET inline void KERNEL_FN(fe_sub)(uint64_t *r, const uint64_t *a, const uint64_t *b)
+{
+	// a + 2p - b; each limb of 2p is at least the matching limb of b
+	for (int i = 0; i < 5; i++)
+	{
+		r[i] = a[i] + fe_2p[i] - b[i];
+	}
+	KERNEL_FN(fe_carry)(r);
+}
+
+static KERNEL_TARGET void KERNEL_FN(fe_mul)(uint64_t *r, const uint64_t *a, const uint64_t *b)
+{
+	unsigned __int128 t[9] = {0};
+	unsigned __int128 c = 0;
+	uint64_t l[10];
+
+#pragma GCC unroll 5
+	for (int i = 0; i < 5; i++)
+	{
+#pragma GCC unroll 5
+		for (int j = 0; j < 5; j++)
+		{
+			t[i + j] += (unsigned __int128)a[i] * b[j];
+		}
+	}
+	for (int k = 0; k < 9; k++)
+	{
+		c += t[k];
+		l[k] = (uint64_t)c & FE_M52;
+		c >>= 52;
+	}
+	l[9] = (uint64_t)c;
+
+	// Limb k >= 5 weighs 2^(52 (k - 5)) * 2^260, and 2^260 = FE_R mod p
+	c = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		c += l[i] + (unsigned __int128)l[i + 5] * FE_R;
+		r[i] = (uint64_t)c & FE_M52;
+		c >>= 52;
+	}
+	uint64_t top = (uint64_t)(c << 4) | (r[4] >> 48);
+	r[4] &= FE_M48;
+	c = r[0] + (unsigned __int128)top * FE_K;
+	r[0] = (uint64_t)c & FE_M52;
+	c >>= 52;
+	for (int i = 1; i < 4; i++)
+	{
+		c += r[i];
+		r[i] = (uint64_t)c & FE_M52;
+		c >>= 52;
+	}
+	r[4] += (uint64_t)c;
+}
+
+static KERNEL_TARGET void KERNEL_FN(fe_sqr_n)(uint64_t *r, const uint64_t *a, int n)
+{
+	KERNEL_FN(fe_mul)(r, a, a);
+	while (--n > 0)
+	{
+		KERNEL_FN(fe_mul)(r, r, r);
+	}
+}
+
+// a^(p - 2), libsecp256k1's addition chain: 255 squarings, 15 multiplications
+static KERNEL_TARGET void KERNEL_FN(fe_inv)(uint64_t *r, const uint64_t *a)
+{
+	uint64_t x2[5], x3[5], x6[5], x9[5], x11[5], x22[5], x44[5], x88[5], x176[5], x220[5], x223[5], t[5];
+
+	KERNEL_FN(fe_sqr_n)(x2, a, 1);
+	KERNEL_FN(fe_mul)(x2, x2, a);
+	KERNEL_FN(fe_sqr_n)(x3, x2, 1);
+	KERNEL_FN(fe_mul)(x3, x3, a);
+	KERNEL_FN(fe_sqr_n)(x6, x3, 3);
+	KERNEL_FN(fe_mul)(x6, x6, x3);
+	KERNEL_FN(fe_sqr_n)(x9, x6, 3);
+	KERNEL_FN(fe_mul)(x9, x9, x3);
+	KERNEL_FN(fe_sqr_n)(x11, x9, 2);
+	KERNEL_FN(fe_mul)(x11, x11, x2);
+	KERNEL_FN(fe_sqr_n)(x22, x11, 11);
+	KERNEL_FN(fe_mul)(x22, x22, x11);
+	KERNEL_FN(fe_sqr_n)(x44, x22, 22);
+	KERNEL_FN(fe_mul)(x44, x44, x22);
+	KERNEL_FN(fe_sqr_n)(x88, x44, 44);
+	KERNEL_FN(fe_mul)(x88, x88, x44);
+	KERNEL_FN(fe_sqr_n)(x176, x88, 88);
+	KERNEL_FN(fe_mul)(x176, x176, x88);
+	KERNEL_FN(fe_sqr_n)(x220, x176, 44);
+	KERNEL_FN(fe_mul)(x220, x220, x44);
+	KERNEL_FN(fe_sqr_n)(x223, x220, 3);
+	KERNEL_FN(fe_mul)(x223, x223, x3);
+	KERNEL_FN(fe_sqr_n)(t, x223, 23);
+	KERNEL_FN(fe_mul)(t, t, x22);
+	KERNEL_FN(fe_sqr_n)(t, t, 5);
+	KERNEL_FN(fe_mul)(t, t, a);
+	KERNEL_FN(fe_sqr_n)(t, t, 3);
+	KERNEL_FN(fe_mul)(t, t, x2);
+	KERNEL_FN(fe_sqr_n)(t, t, 2);
+	KERNEL_FN(fe_mul)(r, t, a);
+}
+
+// P_i += Q for every point, with one inversion for the whole batch
+// (Montgomery's trick). Points are SoA: limb j of point i at x[j * n + i].
+// Fails, leaving the points untouched, if some P_i has the x of Q.
+static KERNEL_TARGET int KERNEL_FN(ec_walk_step)(uint64_t *x, uint64_t *y, size_t n, const uint64_t *qx,
+	const uint64_t *qy, uint64_t *scratch)
+{
+	uint64_t *dx = scratch;
+	uint64_t *prod = scratch + 5 * n;
+	uint64_t xi[5], yi[5], c[5], inv[5], ik[5], lam[5], x3[5], y3[5], t[5];
+
+	for (size_t i = 0; i < n; i++)
+	{
+		for (int j = 0; j < 5; j++)
+		{
+			xi[j] = x[j * n + i];
+		}
+		KERNEL_FN(fe_sub)(dx + 5 * i, qx, xi);
+		if (i == 0)
+		{
+			memcpy(c, dx, sizeof(c));
+		}
+		else
+		{
+			KERNEL_FN(fe_mul)(c, c, dx + 5 * i);
+		}
+		memcpy(prod + 5 * i, c, sizeof(c));
+	}
+	if (fe_is_zero(c))
+	{
+		return -1;
+	}
+	KERNEL_FN(fe_inv)(inv, c);
+
+	for (size_t i = n; i-- > 0;)
+	{
+		if (i > 0)
+		{
+			KERNEL_FN(fe_mul)(ik, inv, prod + 5 * (i - 1));
+			KERNEL_FN(fe_mul)(inv, inv, dx + 5 * i);
+		}
+		else
+		{
+			memcpy(ik, inv, sizeof(ik));
+		}
+		for (int j = 0; j < 5; j++)
+		{
+			xi[j] = x[j * n + i];
+			yi[j] = y[j * n + i];
+		}
+		// lambda = (qy - y) / (qx - x), x' = lambda^2 - x - qx, y' = lambda (x - x') - y
+		KERNEL_FN(fe_sub)(t, qy, yi);
+		KERNEL_FN(fe_mul)(lam, t, ik);
+		KERNEL_FN(fe_mul)(x3, lam, lam);
+		KERNEL_FN(fe_sub)(x3, x3, xi);
+		KERNEL_FN(fe_sub)(x3, x3, qx);
+		KERNEL_FN(fe_sub)(t, xi, x3);
+		KERNEL_FN(fe_mul)(y3, lam, t);
+		KERNEL_FN(fe_sub)(y3, y3, yi);
+		for (int j = 0; j < 5; j++)
+		{
+			x[j * n + i] = x3[j];
+			y[j * n + i] = y3[j];
+		}
+	}
+	return 0;
+}
+
+#endif
+
+#ifdef KERNEL_IFMA
+// The same arithmetic on eight independent elements per vector, with the
+// 52-bit multiply-accumulate of AVX-512 IFMA doing the limb products
+typedef struct
+{
+	__m512i n[5];
+} fe8;
+
+static KERNEL_TARGET inline fe8 fe8_load(const uint64_t *p, size_t stride)
+{
+	fe8 r;
+	for (int j = 0; j < 5; j++)
+	{
+		r.n[j] = _mm512_loadu_si512((const void *)(p + j * stride));
+	}
+	return r;
+}
+
+static KERNEL_TARGET inline void fe8_store(uint64_t *p, size_t stride, fe8 a)
+{
+	for (int j = 0; j < 5; j++)
+	{
+		_mm512_storeu_si512((void *)(p + j * stride), a.n[j]);
+	}
+}
+
+static KERNEL_TARGET inline fe8 fe8_set1(const uint64_t *a)
+{
+	fe8 r;
+	for (int j = 0; j < 5; j++)
+	{
+		r.n[j] = _mm512_set1_epi64((long long)a[j]);
+	}
+	return r;
+}
+
+static KERNEL_TARGET inline void fe8_carry(fe8 *r)
+{
+	const __m512i m52 = _mm512_set1_epi64(FE_M52);
+	const __m512i m48 = _mm512_set1_epi64(FE_M48);
+	const __m512i k = _mm512_set1_epi64(FE_K);
+
+	for (int j = 0; j < 4; j++)
+	{
+		r->n[j + 1] = _mm512_add_epi64(r->n[j + 1], _mm512_srli_epi64(r->n[j], 52));
+		r->n[j] = _mm512_and_si512(r->n[j], m52);
+	}
+	// top < 2^15 here, so the low half of top * K is the whole product
+	r->n[0] = _mm512_madd52lo_epu64(r->n[0], _mm512_srli_epi64(r->n[4], 48), k);
+	r->n[4] = _mm512_and_si512(r->n[4], m48);
+	for (int j = 0; j < 4; j++)
+	{
+		r->n[j + 1] = _mm512_add_epi64(r->n[j + 1], _mm512_srli_epi64(r->n[j], 52));
+		r->n[j] = _mm512_and_si512(r->n[j], m52);
+	}
+}
+
+static KERNEL_TARGET inline fe8 fe8_sub(fe8 a, fe8 b)
+{
+	fe8 r;
+	for (int j = 0; j < 5; j++)
+	{
+		r.n[j] = _mm512_sub_epi64(_mm512_add_epi64(a.n[j], _mm512_set1_epi64((long long)fe_2p[j])), b.n[j]);
+	}
+	fe8_carry(&r);
+	return r;
+}
+
+static KERNEL_TARGET inline fe8 fe8_mul(fe8 a, fe8 b)
+{
+	const __m512i m52 = _mm512_set1_epi64(FE_M52);
+	const __m512i m48 = _mm512_set1_epi64(FE_M48);
+	const __m512i fr = _mm512_set1_epi64(FE_R);
+	const __m512i k = _mm512_set1_epi64(FE_K);
+	__m512i t[10];
+	fe8 r;
+
+	for (int i = 0; i < 10; i++)
+	{
+		t[i] = _mm512_setzero_si512();
+	}
+#pragma GCC unroll 5
+	for (int i = 0; i < 5; i++)
+	{
+#pragma GCC unroll 5
+		for (int j = 0; j < 5; j++)
+		{
+			t[i + j] = _mm512_madd52lo_epu64(t[i + j], a.n[i], b.n[j]);
+			t[i + j + 1] = _mm512_madd52hi_epu64(t[i + j + 1], a.n[i], b.n[j]);
+		}
+	}
+	for (int i = 0; i < 9; i++)
+	{
+		t[i + 1] = _mm512_add_epi64(t[i + 1], _mm512_srli_epi64(t[i], 52));
+		t[i] = _mm512_and_si512(t[i], m52);
+	}
+
+	// Fold limbs 5-9 down by 2^260 = FE_R mod p
+	__m512i u5 = _mm512_setzero_si512();
+	for (int i = 0; i < 5; i++)
+	{
+		r.n[i] = t[i];
+	}
+	for (int i = 0; i < 5; i++)
+	{
+		r.n[i] = _mm512_madd52lo_epu64(r.n[i], t[i + 5], fr);
+		if (i < 4)
+		{
+			r.n[i + 1] = _mm512_madd52hi_epu64(r.n[i + 1], t[i + 5], fr);
+		}
+		else
+		{
+			u5 = _mm512_madd52hi_epu64(u5, t[i + 5], fr);
+		}
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		r.n[i + 1] = _mm512_add_epi64(r.n[i + 1], _mm512_srli_epi64(r.n[i], 52));
+		r.n[i] = _mm512_and_si512(r.n[i], m52);
+	}
+	u5 = _mm512_add_epi64(u5, _mm512_srli_epi64(r.n[4], 52));
+	r.n[4] = _mm512_and_si512(r.n[4], m52);
+
+	__m512i top = _mm512_or_si512(_mm512_slli_epi64(u5, 4), _mm512_srli_epi64(r.n[4], 48));
+	r.n[4] = _mm512_and_si512(r.n[4], m48);
+	r.n[0] = _mm512_madd52lo_epu64(r.n[0], top, k);
+	r.n[1] = _mm512_madd52hi_epu64(r.n[1], top, k);
+	for (int i = 0; i < 4; i++)
+	{
+		r.n[i + 1] = _mm512_add_epi64(r.n[i + 1], _mm512_srli_epi64(r.n[i], 52));
+		r.n[i] = _mm512_and_si512(r.n[i], m52);
+	}
+	return r;
+}
+
+static KERNEL_TARGET fe8 fe8_sqr_n(fe8 a, int n)
+{
+	do
+	{
+		a = fe8_mul(a, a);
+	} while (--n > 0);
+	return a;
+}
+
+static KERNEL_TARGET fe8 fe8_inv(fe8 a)
+{
+	fe8 x2 = fe8_mul(fe8_sqr_n(a, 1), a);
+	fe8 x3 = fe8_mul(fe8_sqr_n(x2, 1), a);
+	fe8 x6 = fe8_mul(fe8_sqr_n(x3, 3), x3);
+	fe8 x9 = fe8_mul(fe8_sqr_n(x6, 3), x3);
+	fe8 x11 = fe8_mul(fe8_sqr_n(x9, 2), x2);
+	fe8 x22 = fe8_mul(fe8_sqr_n(x11, 11), x11);
+	fe8 x44 = fe8_mul(fe8_sqr_n(x22, 22), x22);
+	fe8 x88 = fe8_mul(fe8_sqr_n(x44, 44), x44);
+	fe8 x176 = fe8_mul(fe8_sqr_n(x88, 88), x88);
+	fe8 x220 = fe8_mul(fe8_sqr_n(x176, 44), x44);
+	fe8 x223 = fe8_mul(fe8_sqr_n(x220, 3), x3);
+	fe8 t = fe8_mul(fe8_sqr_n(x223, 23), x22);
+	t = fe8_mul(fe8_sqr_n(t, 5), a);
+	t = fe8_mul(fe8_sqr_n(t, 3), x2);
+	return fe8_mul(fe8_sqr_n(t, 2), a);
+}
+
+// As ec_walk_step, as eight interleaved chains: point i belongs to lane
+// i % 8, so each lane does its own batch inversion over n / 8 points.
+// Other batch sizes take the scalar one-chain path.
+static KERNEL_TARGET int KERNEL_FN(ec_walk_step8)(uint64_t *x, uint64_t *y, size_t n, const uint64_t *qx,
+	const uint64_t *qy, uint64_t *scratch)
+{
+	if (n == 0 || n % 8 != 0)
+	{
+		return ec_walk_step_scalar(x, y, n, qx, qy, scratch);
+	}
+	const size_t m = n / 8;
+	uint64_t *dx = scratch;
+	uint64_t *prod = scratch + 5 * n;
+	const fe8 QX = fe8_set1(qx);
+	const fe8 QY = fe8_set1(qy);
+	fe8 c;
+
+	// Scratch entries are 5 limbs x 8 lanes, one per chain position
+	for (size_t k = 0; k < m; k++)
+	{
+		fe8 d = fe8_sub(QX, fe8_load(x + 8 * k, n));
+		fe8_store(dx + 40 * k, 8, d);
+		c = k == 0 ? d : fe8_mul(c, d);
+		fe8_store(prod + 40 * k, 8, c);
+	}
+	uint64_t lanes[40];
+	fe8_store(lanes, 8, c);
+	for (int l = 0; l < 8; l++)
+	{
+		uint64_t e[5] = {lanes[l], lanes[8 + l], lanes[16 + l], lanes[24 + l], lanes[32 + l]};
+		if (fe_is_zero(e))
+		{
+			return -1;
+		}
+	}
+
+	fe8 inv = fe8_inv(c);
+	for (size_t k = m; k-- > 0;)
+	{
+		fe8 ik = inv;
+		if (k > 0)
+		{
+			ik = fe8_mul(inv, fe8_load(prod + 40 * (k - 1), 8));
+			inv = fe8_mul(inv, fe8_load(dx + 40 * k, 8));
+		}
+		fe8 xk = fe8_load(x + 8 * k, n);
+		fe8 yk = fe8_load(y + 8 * k, n);
+		fe8 lam = fe8_mul(fe8_sub(QY, yk), ik);
+		fe8 x3 = fe8_sub(fe8_sub(fe8_mul(lam, lam), xk), QX);
+		fe8 y3 = fe8_sub(fe8_mul(lam, fe8_sub(xk, x3)), yk);
+		fe8_store(x + 8 * k, n, x3);
+		fe8_store(y + 8 * k, n, y3);
+	}
+	return 0;
+}
+#endif
+
+#undef KERNEL_FN
+#undef KERNEL_CAT
+#undef KERNEL_CAT_
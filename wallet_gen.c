@@ -1,19 +1,25 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <openssl/rand.h>
 #include <secp256k1.h>
 #include <openssl/evp.h>
+#include <openssl/crypto.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <libkeccak.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
 
 #ifdef __linux__
 #include <sys/random.h>
 #include <fcntl.h>
 #include <errno.h>
 
-static void secure_random(unsigned char *buf, size_t len)
+void secure_random(unsigned char *buf, size_t len)
 {
 	ssize_t ret;
 	while (len > 0)
@@ -33,7 +39,7 @@ static void secure_random(unsigned char *buf, size_t len)
 	}
 }
 #else
-static void secure_random(unsigned char *buf, size_t len)
+void secure_random(unsigned char *buf, size_t len)
 {
 	if (RAND_bytes(buf, len) != 1)
 	{
@@ -43,41 +49,130 @@ static void secure_random(unsigned char *buf, size_t len)
 }
 #endif
 
+#ifdef __linux__
+#include <sched.h>
 
-int generate_single_eth_address(unsigned char *priv_key, unsigned char *address)
+void eth_pin_thread(unsigned int cpu)
 {
-	if (!priv_key || !address)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % eth_online_cpus(), &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+#else
+void eth_pin_thread(unsigned int cpu)
+{
+	(void)cpu;
+}
+#endif
+
+unsigned int eth_online_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned int)n : 1;
+}
+
+struct range_job
+{
+	eth_range_fn fn;
+	void *arg;
+	size_t first;
+	size_t count;
+	unsigned int thread;
+	int ret;
+};
+
+static void *range_thread_main(void *arg)
+{
+	struct range_job *job = arg;
+	job->ret = job->fn(job->arg, job->first, job->count, job->thread);
+	return NULL;
+}
+
+int eth_parallel_ranges(size_t count, unsigned int threads, eth_range_fn fn, void *arg)
+{
+	if (threads == 0)
 	{
-		return -1;
+		threads = eth_online_cpus();
+	}
+	if (threads > count)
+	{
+		threads = count ? (unsigned int)count : 1;
 	}
 
-	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
-	if (!ctx)
+	struct range_job *jobs = calloc(threads, sizeof(*jobs));
+	pthread_t *tids = calloc(threads, sizeof(*tids));
+	if (!jobs || !tids)
 	{
+		free(jobs);
+		free(tids);
 		return -1;
 	}
 
-	do
+	size_t first = 0;
+	for (unsigned int t = 0; t < threads; t++)
 	{
-		secure_random(priv_key, 32);
-	} while (!secp256k1_ec_seckey_verify(ctx, priv_key));
+		jobs[t].fn = fn;
+		jobs[t].arg = arg;
+		jobs[t].first = first;
+		jobs[t].count = count / threads + (t < count % threads);
+		jobs[t].thread = t;
+		first += jobs[t].count;
+	}
 
-	secp256k1_pubkey pubkey;
-	if (!secp256k1_ec_pubkey_create(ctx, &pubkey, priv_key))
+	// The calling thread takes the first range itself; if a thread cannot
+	// be created its range runs inline instead
+	unsigned int started = 0;
+	for (unsigned int t = 1; t < threads; t++)
 	{
-		secp256k1_context_destroy(ctx);
-		return -1;
+		if (pthread_create(&tids[t], NULL, range_thread_main, &jobs[t]) != 0)
+		{
+			for (unsigned int r = t; r < threads; r++)
+			{
+				range_thread_main(&jobs[r]);
+			}
+			break;
+		}
+		started = t;
 	}
+	range_thread_main(&jobs[0]);
 
-	unsigned char pub_key[65];
-	size_t pubkey_len = 65;
-	secp256k1_ec_pubkey_serialize(ctx, pub_key, &pubkey_len, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+	int ret = 0;
+	for (unsigned int t = 1; t <= started; t++)
+	{
+		pthread_join(tids[t], NULL);
+	}
+	for (unsigned int t = 0; t < threads; t++)
+	{
+		if (jobs[t].ret != 0)
+		{
+			ret = -1;
+		}
+	}
+	free(jobs);
+	free(tids);
+	return ret;
+}
 
-	// Use Keccak-256
-	unsigned char hash[32];
+int eth_hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
 
-	// Ensure that the libkeccak library is linked and properly initialized
-	struct libkeccak_state state;
+int eth_keccak256_init(struct libkeccak_state *state)
+{
 	struct libkeccak_spec spec;
 
 	// Set parameters for Keccak-256 (same as in Ethereum)
@@ -85,34 +180,89 @@ int generate_single_eth_address(unsigned char *priv_key, unsigned char *address)
 	spec.capacity = 512;
 	spec.output = 256;
 
-	if (libkeccak_state_initialise(&state, &spec) != 0)
+	return libkeccak_state_initialise(state, &spec);
+}
+
+int eth_keccak256(struct libkeccak_state *state, const void *data, size_t len, unsigned char *hash)
+{
+	libkeccak_state_reset(state);
+	return libkeccak_digest(state, data, len, 0, NULL, hash);
+}
+
+int eth_pubkey_to_address(const unsigned char *pub64, unsigned char *address)
+{
+	unsigned char hash[32];
+	if (!eth_backend_default(ETH_BACKEND_KECCAK))
 	{
-		secp256k1_context_destroy(ctx);
-		return -1;
+		if (eth_backend_keccak(pub64, 64, hash) != 0)
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		eth_keccak256_64(pub64, hash);
 	}
+	// Take the last 20 bytes of the hash (Ethereum address)
+	memcpy(address, hash + 12, 20);
+	return 0;
+}
 
-	// Hash only 64 bytes of the public key (skip the first byte 0x04)
-	if (libkeccak_update(&state, pub_key + 1, 64) != 0)
+int eth_seckey_to_address(const secp256k1_context *ctx, const unsigned char *priv_key, unsigned char *address)
+{
+	unsigned char pub64[64];
+	if (eth_ec_pubkey64(ctx, priv_key, pub64) != 0)
 	{
-		libkeccak_state_fast_destroy(&state);
-		secp256k1_context_destroy(ctx);
 		return -1;
 	}
+	return eth_pubkey_to_address(pub64, address);
+}
 
-	// Get the hash
-	if (libkeccak_digest(&state, NULL, 0, 0, NULL, hash) != 0)
+static int single_eth_address(unsigned char *priv_key, unsigned char *address)
+{
+	if (!priv_key || !address)
 	{
-		libkeccak_state_fast_destroy(&state);
-		secp256k1_context_destroy(ctx);
 		return -1;
 	}
 
-	libkeccak_state_fast_destroy(&state);
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!ctx)
+	{
+		return -1;
+	}
 
-	// Take the last 20 bytes of the hash (Ethereum address)
-	memcpy(address, hash + 12, 20);
+	do
+	{
+		if (eth_key_material(priv_key, 32) != 0)
+		{
+			secp256k1_context_destroy(ctx);
+			return -1;
+		}
+	} while (!secp256k1_ec_seckey_verify(ctx, priv_key));
 
+	// Same derivation, and so the same backends, as every other path
+	int ret = eth_seckey_to_address(ctx, priv_key, address);
 	secp256k1_context_destroy(ctx);
+	return ret;
+}
+
+int generate_single_eth_address(unsigned char *priv_key, unsigned char *address)
+{
+	unsigned long long start = eth_latency_start();
+	int ret = single_eth_address(priv_key, address);
+	eth_latency_end(ETH_LATENCY_SINGLE, start);
+	return ret;
+}
+
+int eth_random_private_key(unsigned char *priv_key)
+{
+	do
+	{
+		if (eth_key_material(priv_key, ETH_PRIV_KEY_SIZE) != 0)
+		{
+			return -1;
+		}
+	} while (!secp256k1_ec_seckey_verify(secp256k1_context_static, priv_key));
 	return 0;
 }
 
@@ -121,4 +271,116 @@ int generate_eth_wallets(
 	unsigned char *address)
 {
 	return generate_single_eth_address(priv_key, address);
-}
\ No newline at end of file
+}
+
+struct eth_generator
+{
+	secp256k1_context *ctx;
+};
+
+struct eth_generator *eth_generator_create(void)
+{
+	unsigned char seed[32];
+	struct eth_generator *gen = calloc(1, sizeof(*gen));
+	if (!gen)
+	{
+		return NULL;
+	}
+	gen->ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!gen->ctx)
+	{
+		free(gen);
+		return NULL;
+	}
+	secure_random(seed, sizeof(seed));
+	int ok = secp256k1_context_randomize(gen->ctx, seed);
+	OPENSSL_cleanse(seed, sizeof(seed));
+	if (!ok)
+	{
+		secp256k1_context_destroy(gen->ctx);
+		free(gen);
+		return NULL;
+	}
+	return gen;
+}
+
+void eth_generator_destroy(struct eth_generator *gen)
+{
+	if (!gen)
+	{
+		return;
+	}
+	secp256k1_context_destroy(gen->ctx);
+	free(gen);
+}
+
+static int generator_fill(struct eth_generator *gen, unsigned char *priv_keys, unsigned char *addresses, size_t count)
+{
+	if (!gen || ((!priv_keys || !addresses) && count))
+	{
+		return -1;
+	}
+	// One entropy draw for the whole batch; the rare key outside the
+	// curve order is redrawn on its own
+	if (eth_key_material(priv_keys, count * ETH_PRIV_KEY_SIZE) != 0)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned char *priv_key = priv_keys + i * ETH_PRIV_KEY_SIZE;
+		while (!secp256k1_ec_seckey_verify(gen->ctx, priv_key))
+		{
+			if (eth_key_material(priv_key, ETH_PRIV_KEY_SIZE) != 0)
+			{
+				return -1;
+			}
+		}
+		if (eth_seckey_to_address(gen->ctx, priv_key, addresses + i * ETH_ADDRESS_SIZE) != 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int eth_generator_fill(struct eth_generator *gen, unsigned char *priv_keys, unsigned char *addresses, size_t count)
+{
+	unsigned long long start = eth_latency_start();
+	int ret = generator_fill(gen, priv_keys, addresses, count);
+	eth_latency_end(ETH_LATENCY_BATCH, start);
+	return ret;
+}
+
+void eth_checksum_hex(const unsigned char *address, char *hex)
+{
+	unsigned char hash[32];
+
+	eth_hex_encode(address, ETH_ADDRESS_SIZE, hex);
+	eth_keccak256_short(hex, 2 * ETH_ADDRESS_SIZE, hash);
+	// A letter is upper case where the matching hash nibble is >= 8
+	for (int i = 0; i < 2 * ETH_ADDRESS_SIZE; i++)
+	{
+		unsigned char nibble = i & 1 ? hash[i / 2] & 15 : hash[i / 2] >> 4;
+		if (hex[i] >= 'a' && nibble >= 8)
+		{
+			hex[i] -= 'a' - 'A';
+		}
+	}
+}
+
+int eth_address_eip55(const unsigned char *addresses, size_t count, char *out)
+{
+	if ((!addresses || !out) && count)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		char *dst = out + i * ETH_EIP55_SIZE;
+		dst[0] = '0';
+		dst[1] = 'x';
+		eth_checksum_hex(addresses + i * ETH_ADDRESS_SIZE, dst + 2);
+	}
+	return 0;
+}
@@ -3,12 +3,727 @@
 
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define ETH_PRIV_KEY_SIZE 32
 #define ETH_ADDRESS_SIZE 20
 
+// Raw output record: private key followed by address
+#define ETH_WALLET_RECORD_SIZE (ETH_PRIV_KEY_SIZE + ETH_ADDRESS_SIZE)
+// Hex output line: "0x<key> 0x<address>\n"
+#define ETH_WALLET_HEX_LINE_SIZE (2 + 2 * ETH_PRIV_KEY_SIZE + 3 + 2 * ETH_ADDRESS_SIZE + 1)
+
+#define ETH_OUTPUT_HEX 0
+#define ETH_OUTPUT_RAW 1
+// "0x<key> 0x<EIP-55 address> <TRON address>\n"
+#define ETH_OUTPUT_MULTICHAIN 2
+#define ETH_MULTICHAIN_LINE_SIZE (2 + 2 * ETH_PRIV_KEY_SIZE + 1 + ETH_EIP55_SIZE + 1 + ETH_TRON_ADDRESS_SIZE + 1)
+
 int generate_eth_wallets(
 	unsigned char *priv_key,
 	unsigned char *address);
 int generate_single_eth_address(unsigned char *priv_key, unsigned char *address);
+// Fresh random key that passes secp256k1_ec_seckey_verify; -1 when an
+// installed entropy source has run out
+int eth_random_private_key(unsigned char *priv_key);
+
+// Reusable generator for batch callers: owns a blinded secp256k1 context,
+// so filling a batch allocates nothing. Not thread-safe; use one per thread.
+struct eth_generator;
+
+struct eth_generator *eth_generator_create(void);
+void eth_generator_destroy(struct eth_generator *gen);
+// `priv_keys` gets count * ETH_PRIV_KEY_SIZE bytes, `addresses` count * ETH_ADDRESS_SIZE
+int eth_generator_fill(struct eth_generator *gen, unsigned char *priv_keys, unsigned char *addresses, size_t count);
+
+// EIP-55 mixed-case form: "0x" + 40 hex characters, no terminator
+#define ETH_EIP55_SIZE (2 + 2 * ETH_ADDRESS_SIZE)
+// Writes count * ETH_EIP55_SIZE characters to `out`
+int eth_address_eip55(const unsigned char *addresses, size_t count, char *out);
+
+// TRON form: Base58Check of 0x41 || address, always 34 characters ("T...")
+#define ETH_TRON_ADDRESS_SIZE 34
+// Writes count * ETH_TRON_ADDRESS_SIZE characters to `out`, no terminators
+int eth_tron_address(const unsigned char *addresses, size_t count, char *out);
+
+// Several chains from one key: the EC multiplication and Keccak hash run
+// once and every requested encoding is derived from the same address. The
+// EIP-55 form is the address on Ethereum and EVM L2s alike. NULL buffers
+// are skipped; priv_keys is required.
+struct eth_multichain_output
+{
+	unsigned char *priv_keys; // count * ETH_PRIV_KEY_SIZE
+	unsigned char *addresses; // count * ETH_ADDRESS_SIZE, raw
+	char *eth;                // count * ETH_EIP55_SIZE
+	char *tron;               // count * ETH_TRON_ADDRESS_SIZE
+};
+
+int generate_multichain_wallets(size_t count, const struct eth_multichain_output *out);
+
+struct eth_shm_ring;
+struct eth_writer;
+
+// Pipelined bulk generation: random + seckey verify -> EC multiply ->
+// Keccak -> encode + write, connected by lock-free SPSC rings.
+// Zero fields select defaults, or the tuned values after eth_autotune().
+struct eth_pipeline_config
+{
+	size_t count;        // wallets to generate
+	unsigned int lanes;  // parallel stage chains, 0 = one per three online CPUs
+	size_t ring_size;    // records per ring, power of two
+	size_t batch;        // records each stage moves at once
+	int fd;              // output file descriptor
+	int format;          // ETH_OUTPUT_HEX or ETH_OUTPUT_RAW
+	int pin;             // pin stage threads to CPUs
+	struct eth_shm_ring *shm; // publish raw records here instead of writing fd
+	struct eth_writer *writer; // or write through this; the caller finishes it
+};
+
+int generate_eth_wallets_pipeline(const struct eth_pipeline_config *config);
+
+// Vanity search: nibble pattern on the address, matched as
+// (address & mask) == value. Case constraints apply to the EIP-55 checksum
+// hash (Keccak-256 of the lowercase hex address) and only use bit 3 of each
+// nibble, which makes the letter at that position upper case.
+struct eth_search_pattern
+{
+	unsigned char value[ETH_ADDRESS_SIZE];
+	unsigned char mask[ETH_ADDRESS_SIZE];
+	unsigned char case_value[ETH_ADDRESS_SIZE];
+	unsigned char case_mask[ETH_ADDRESS_SIZE];
+};
+
+struct eth_search_result
+{
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	unsigned char address[ETH_ADDRESS_SIZE];
+};
+
+#define ETH_SEARCH_MAX_THREADS 1024
+
+// Each thread walks base_key + shard * 2^64 + thread * 2^48 + i, so
+// different shards never overlap
+struct eth_search_config
+{
+	struct eth_search_pattern pattern;
+	unsigned int threads;                         // 0 = one per online CPU
+	unsigned char base_key[ETH_PRIV_KEY_SIZE];    // keyspace origin, a valid private key
+	unsigned long long shard;
+	const char *checkpoint_path;                  // written periodically when set
+	unsigned int checkpoint_interval;             // seconds, 0 = 60
+};
+
+// Everything needed to continue a search: its origin, each thread's
+// position, time spent so far and the closest address seen
+struct eth_search_checkpoint
+{
+	struct eth_search_pattern pattern;
+	unsigned int threads;
+	unsigned char base_key[ETH_PRIV_KEY_SIZE];
+	unsigned long long shard;
+	double elapsed;                               // seconds searched, across resumes
+	int found;                                    // best is a full match
+	int best_score;                               // pattern nibbles (and letter cases) best.address matches
+	struct eth_search_result best;
+	unsigned long long steps[ETH_SEARCH_MAX_THREADS];
+};
+
+struct eth_search;
+
+// Hex prefix and/or suffix (either may be NULL)
+int eth_search_pattern_compile(struct eth_search_pattern *pattern, const char *prefix, const char *suffix);
+// Same, but the letters must also appear in the given case in the EIP-55
+// form of the address; each one halves the odds
+int eth_search_pattern_compile_eip55(struct eth_search_pattern *pattern, const char *prefix, const char *suffix);
+int eth_search_pattern_match(const struct eth_search_pattern *pattern, const unsigned char *address);
+// Expected number of attempts per hit
+double eth_search_pattern_difficulty(const struct eth_search_pattern *pattern);
+
+struct eth_search *eth_search_start(const struct eth_search_config *config);
+// Continue from a checkpoint, optionally checkpointing again to `checkpoint_path`
+struct eth_search *eth_search_resume(const struct eth_search_checkpoint *checkpoint,
+	const char *checkpoint_path, unsigned int checkpoint_interval);
+unsigned long long eth_search_attempts(struct eth_search *search);
+// 1 and fills `result` once a match was found, 0 otherwise, -1 once every
+// search thread has failed without one
+int eth_search_poll(struct eth_search *search, struct eth_search_result *result);
+void eth_search_stop(struct eth_search *search);
+// Stops, joins, writes a final checkpoint if enabled and wipes the search
+void eth_search_free(struct eth_search *search);
+
+// Never blocks the search threads; positions may trail them by a few
+// thousand keys, which a resume simply re-checks
+int eth_search_snapshot(struct eth_search *search, struct eth_search_checkpoint *checkpoint);
+// Atomic replace (temporary file + fsync + rename), mode 0600
+int eth_search_checkpoint_save(const char *path, const struct eth_search_checkpoint *checkpoint);
+int eth_search_checkpoint_load(const char *path, struct eth_search_checkpoint *checkpoint);
+
+// Distributed search: a coordinator hands every connecting worker its own
+// keyspace shard, aggregates attempt rates and, once a worker reports a hit,
+// re-derives the key itself before broadcasting stop. Addresses are
+// "host:port" (TCP) or "unix:/path". Keys travel in the clear, so keep the
+// transport on a trusted network.
+struct eth_dist_status
+{
+	unsigned int workers;
+	unsigned long long attempts;
+	double rate; // attempts per second since the previous report
+};
+
+typedef void (*eth_dist_progress_fn)(const struct eth_dist_status *status, void *arg);
+
+// Runs until a confirmed hit, returns 0 and fills `result`
+int eth_dist_coordinate(const char *address, const struct eth_search_pattern *pattern,
+	eth_dist_progress_fn progress, void *arg, struct eth_search_result *result);
+// Searches the shard it is given until the coordinator says stop. Returns
+// ETH_DIST_VERSION_MISMATCH if the coordinator speaks another protocol
+// version, -1 on other failures.
+#define ETH_DIST_VERSION_MISMATCH -2
+int eth_dist_work(const char *address, unsigned int threads);
+
+// Message signing with one long-lived, blinded secp256k1 context per key.
+// Signatures are 65 bytes r || s || v with v = 27 + recovery id.
+#define ETH_SIGNATURE_SIZE 65
+
+#define ETH_SIGN_HASH 0     // items are ready 32-byte digests
+#define ETH_SIGN_PERSONAL 1 // EIP-191 personal_sign over the raw message
+#define ETH_SIGN_TYPED 2    // EIP-712, items are 32-byte struct hashes
+
+struct eth_signer;
+
+struct eth_sign_item
+{
+	const unsigned char *data;
+	size_t len;
+};
+
+struct eth_eip712_domain
+{
+	const char *name;                          // NULL to omit
+	const char *version;                       // NULL to omit
+	int has_chain_id;
+	unsigned long long chain_id;
+	const unsigned char *verifying_contract;   // 20 bytes or NULL
+	const unsigned char *salt;                 // 32 bytes or NULL
+};
+
+struct eth_signer *eth_signer_create(const unsigned char *priv_key);
+void eth_signer_destroy(struct eth_signer *signer);
+void eth_signer_address(const struct eth_signer *signer, unsigned char *address);
+
+// keccak256("\x19Ethereum Signed Message:\n" || len || message)
+int eth_personal_message_hash(const void *message, size_t len, unsigned char *hash);
+// Compute once per domain and keep it; every typed signature reuses it
+int eth_eip712_domain_separator(const struct eth_eip712_domain *domain, unsigned char *separator);
+int eth_eip712_type_hash(const char *type, unsigned char *hash);
+// keccak256(type_hash || encoded), `encoded` being `words` 32-byte EIP-712 words
+int eth_eip712_hash_struct(const unsigned char *type_hash, const unsigned char *encoded, size_t words,
+	unsigned char *hash);
+
+// `domain_separator` is only used for ETH_SIGN_TYPED
+int eth_sign(struct eth_signer *signer, int mode, const unsigned char *domain_separator,
+	const struct eth_sign_item *item, unsigned char *sig);
+// `sigs` holds count * ETH_SIGNATURE_SIZE bytes; threads == 0 uses every online CPU
+int eth_sign_batch(struct eth_signer *signer, int mode, const unsigned char *domain_separator,
+	const struct eth_sign_item *items, size_t count, unsigned char *sigs, unsigned int threads);
+
+// Recovery (ecrecover). The v byte of a 65-byte signature may be 0/1 or
+// 27/28; EIP-155 values (chainId * 2 + 35/36) overflow a byte for most
+// chains, so they are rejected there. eth_ecrecover_v and eth_ecrecover_batch_v
+// take r || s and the full v, EIP-155 included.
+#define ETH_RECOVER_OK 0
+#define ETH_RECOVER_MISMATCH 1 // recovered, but not the expected address
+#define ETH_RECOVER_INVALID 2  // malformed signature or no key recovers
+
+int eth_ecrecover(const unsigned char *hash, const unsigned char *sig, unsigned char *address);
+int eth_ecrecover_v(const unsigned char *hash, const unsigned char *sig, unsigned long long v, unsigned char *address);
+// `hashes` holds count 32-byte digests and `sigs` count * ETH_SIGNATURE_SIZE bytes.
+// `addresses`, `expected` (count * ETH_ADDRESS_SIZE) and `status` (count bytes)
+// may each be NULL; `failures` receives the number of non-OK entries.
+// threads == 0 uses every online CPU.
+int eth_ecrecover_batch(const unsigned char *hashes, const unsigned char *sigs, size_t count,
+	unsigned char *addresses, const unsigned char *expected, unsigned char *status,
+	size_t *failures, unsigned int threads);
+// Same with the full v of each entry in `v`, EIP-155 included; `sigs` then
+// holds count 64-byte r || s
+int eth_ecrecover_batch_v(const unsigned char *hashes, const unsigned char *sigs, const unsigned long long *v,
+	size_t count, unsigned char *addresses, const unsigned char *expected, unsigned char *status,
+	size_t *failures, unsigned int threads);
+
+// Addresses of existing public keys: `pubkeys` holds count records of
+// key_size bytes (33 compressed or 65 uncompressed). Invalid keys get a zero
+// address and ETH_RECOVER_INVALID in `status` (may be NULL).
+int eth_pubkeys_to_addresses(const unsigned char *pubkeys, size_t key_size, size_t count,
+	unsigned char *addresses, unsigned char *status, size_t *failures, unsigned int threads);
+// Same over a memory-mapped file of fixed-size keys, writing raw 20-byte
+// addresses in input order to a mapped `out_path`
+int eth_pubkey_file_to_addresses(const char *in_path, const char *out_path, size_t *count,
+	size_t *failures, unsigned int threads);
+
+// Key-custody audit: re-derive the address of every stored key and compare.
+// Input is walgen gen output, raw 52-byte records or 110-byte hex lines.
+#define ETH_AUDIT_MISMATCH 1    // valid key, different address
+#define ETH_AUDIT_INVALID_KEY 2 // zero or >= the curve order
+#define ETH_AUDIT_MALFORMED 3   // hex line that does not parse
+
+struct eth_audit_result
+{
+	size_t records;
+	size_t mismatches;
+	size_t invalid; // invalid keys and malformed records
+};
+
+// Called once per problem record, serialised across threads; `expected` is
+// NULL for malformed records and `derived` NULL unless it is a mismatch
+typedef void (*eth_audit_fn)(void *arg, size_t record, int problem, const unsigned char *expected,
+	const unsigned char *derived);
+// Called about once a second and once at the end
+typedef void (*eth_audit_progress_fn)(void *arg, size_t done, size_t total);
+
+int eth_audit_buffer(const unsigned char *data, size_t size, unsigned int threads, eth_audit_fn report,
+	eth_audit_progress_fn progress, void *arg, struct eth_audit_result *result);
+int eth_audit_file(const char *path, unsigned int threads, eth_audit_fn report,
+	eth_audit_progress_fn progress, void *arg, struct eth_audit_result *result);
+
+// Vectorised kernels (multi-lane Keccak-256, IFMA point walk) are built for several
+// instruction sets; single-message Keccak, hex encoding and the one-chain walk are
+// scalar in every variant. The variant used is this host's autotune cache entry,
+// or else the widest the CPU supports. WALGEN_KERNEL forces a supported variant.
+const char *eth_kernel_name(void);
+// Names of all built variants by index, NULL past the end
+const char *eth_kernel_variant(unsigned int index);
+// Switch variants (for benchmarks; not safe while other threads hash).
+// Fails if the variant is unknown or the CPU lacks it.
+int eth_kernel_select(const char *name);
+void eth_keccak256_64(const unsigned char *data, unsigned char *hash);
+// Lower-case hex, 2 * len characters, no prefix or terminator
+void eth_hex_encode(const unsigned char *src, size_t len, char *dst);
+
+// Addresses of the `count` consecutive keys start_key, start_key + 1, ...
+// The first 256 public keys are full multiplications (one in all, when a
+// precomputed table is loaded, see eth_ec_table_load()); the rest come from
+// a batched point walk with one field inversion per 256 keys.
+int eth_sequential_addresses(const unsigned char *start_key, size_t count, unsigned char *addresses);
+
+// Wallet dispenser: a pool of pre-generated wallets in locked memory, kept
+// between low and high watermarks by background refill threads, so handing
+// one out costs a memcpy rather than EC context setup and a multiplication.
+// Records are ETH_WALLET_RECORD_SIZE bytes, key || address. Zero fields
+// select defaults.
+struct eth_dispenser_config
+{
+	size_t capacity;       // pool size in wallets, 0 = 65536
+	size_t low_water;      // refill starts below this, 0 = high_water / 4
+	size_t high_water;     // and stops here, 0 = capacity
+	unsigned int threads;  // refill threads, 0 = 1
+};
+
+struct eth_dispenser_status
+{
+	size_t available;
+	size_t capacity;
+	unsigned long long served;
+	unsigned long long generated;
+	unsigned long long empty_waits; // takes that had to wait for a refill
+	unsigned int clients;           // connected clients (serve only)
+	int locked;                     // pool is mlocked
+	int pages;                      // ETH_PAGES_* backing the pool
+};
+
+typedef void (*eth_dispenser_progress_fn)(const struct eth_dispenser_status *status, void *arg);
+
+// Most wallets one socket request may ask for
+#define ETH_DISPENSE_MAX 256
+
+struct eth_dispenser;
+
+struct eth_dispenser *eth_dispenser_create(const struct eth_dispenser_config *config);
+void eth_dispenser_destroy(struct eth_dispenser *dispenser);
+// Copies `count` records out of the pool, waiting for a refill if it is short.
+// Thread-safe; count may not exceed the high watermark. Fails rather than
+// waits once every refill thread has failed and the pool is short.
+int eth_dispenser_take(struct eth_dispenser *dispenser, unsigned char *records, size_t count);
+void eth_dispenser_stats(struct eth_dispenser *dispenser, struct eth_dispenser_status *status);
+// Serves the pool on a Unix socket (mode 0600) until eth_dispenser_stop;
+// `progress` runs about once a second. Returns -1 if it cannot listen, or
+// once the pool is empty and every refill thread has failed.
+int eth_dispenser_serve(struct eth_dispenser *dispenser, const char *path, eth_dispenser_progress_fn progress,
+	void *arg);
+// Only sets a flag, so it may be called from a signal handler
+void eth_dispenser_stop(struct eth_dispenser *dispenser);
+
+// Client side: a connected socket, then any number of requests on it
+int eth_dispenser_connect(const char *path);
+int eth_dispenser_request(int fd, unsigned char *records, size_t count);
+
+// Shared-memory handoff: a single-producer/single-consumer ring of raw
+// ETH_WALLET_RECORD_SIZE records in a POSIX shared-memory object (mode 0600),
+// with lock-free indices and futex wakeups, so a consumer process reads
+// records in place instead of parsing a pipe. Consumed slots are wiped on
+// release. Names are shm_open names; a missing leading '/' is added.
+// Producer: capacity is in records, a power of two. Fails if the name
+// exists; a ring left behind by a crash has to be removed first.
+struct eth_shm_ring *eth_shm_ring_create(const char *name, size_t capacity);
+// Up to `want` contiguous free slots at *records, waiting for space; 0 once
+// the consumer has detached or its process has exited
+size_t eth_shm_ring_reserve(struct eth_shm_ring *ring, size_t want, unsigned char **records);
+void eth_shm_ring_commit(struct eth_shm_ring *ring, size_t count);
+// No more records will follow
+void eth_shm_ring_close(struct eth_shm_ring *ring);
+// Wait until the consumer has taken everything (timeout_ms < 0: forever)
+int eth_shm_ring_drain(struct eth_shm_ring *ring, int timeout_ms);
+
+// Consumer
+struct eth_shm_ring *eth_shm_ring_open(const char *name);
+// Up to `max` ready records, in place at *records (contiguous, so a batch may
+// stop at the ring's end). Waits up to timeout_ms (< 0: forever, 0: not at
+// all); 0 on timeout or once the producer closed and the ring is empty.
+size_t eth_shm_ring_acquire(struct eth_shm_ring *ring, size_t max, const unsigned char **records, int timeout_ms);
+// Hands the oldest `count` acquired records back to the producer
+void eth_shm_ring_release(struct eth_shm_ring *ring, size_t count);
+// Closed by the producer and fully consumed
+int eth_shm_ring_finished(struct eth_shm_ring *ring);
+// Producer: closes and unlinks the name (the memory lives on until the
+// consumer unmaps it). Consumer: detaches, unblocking the producer.
+void eth_shm_ring_free(struct eth_shm_ring *ring);
+
+// Function-selector / event-topic mining: tries name + "_" + suffix + params
+// (e.g. "transfer" and "(address,uint256)") for enumerated identifier
+// suffixes until Keccak-256 of the signature matches (hash & mask) == value.
+// The selector is hash[0..3], an event topic the whole hash.
+#define ETH_SELECTOR_MAX_SIGNATURE 136
+
+struct eth_selector_config
+{
+	const char *name;
+	const char *params;                // parenthesised parameter types
+	unsigned char value[32];
+	unsigned char mask[32];
+	unsigned int threads;              // 0 = one per online CPU
+	unsigned long long max_attempts;   // 0 = until found
+};
+
+struct eth_selector_result
+{
+	char signature[ETH_SELECTOR_MAX_SIGNATURE]; // NUL-terminated
+	unsigned char hash[32];
+	unsigned long long counter;        // suffix number
+	unsigned long long attempts;
+};
+
+// Target: `zero_bytes` leading zero bytes and/or leading hex nibbles (NULL for none)
+int eth_selector_target(struct eth_selector_config *config, unsigned int zero_bytes, const char *hex);
+// 0 on a match, 1 if max_attempts ran out, -1 on bad input
+int eth_selector_mine(const struct eth_selector_config *config, struct eth_selector_result *result);
+
+// NUMA-aware generation: workers are spread round-robin over the NUMA nodes
+// and pinned to CPUs of their node, and each builds its own context, random
+// buffers and output slice there. Slices are merged into the caller's arrays
+// at the end. ETH_NUMA_NONE runs the same workers unpinned with slices
+// allocated by the caller's thread, as a baseline.
+#define ETH_NUMA_LOCAL 0
+#define ETH_NUMA_NONE 1
+
+struct eth_numa_config
+{
+	size_t count;
+	unsigned int threads;              // 0 = one per online CPU
+	int placement;                     // ETH_NUMA_*
+};
+
+int generate_eth_wallets_numa(const struct eth_numa_config *config, unsigned char *priv_keys,
+	unsigned char *addresses);
+// NUMA nodes with CPUs; 1 on machines without NUMA information
+unsigned int eth_numa_nodes(void);
+
+// Huge-page backing for bulk buffers (pipeline rings, the dispenser pool,
+// NUMA output slices, and callers' key/address arrays). The process-wide mode
+// starts from WALGEN_HUGEPAGES=off|thp|2m|1g, default off. Each mode falls
+// back to the next smaller one: explicit MAP_HUGETLB pages need a reserved
+// pool (vm.nr_hugepages), then madvise(MADV_HUGEPAGE), then 4 KB pages.
+// Buffers smaller than one page of a size never use that size.
+#define ETH_HUGE_OFF 0
+#define ETH_HUGE_THP 1
+#define ETH_HUGE_2M 2
+#define ETH_HUGE_1G 3
+
+// What a buffer actually got
+#define ETH_PAGES_4K 0
+#define ETH_PAGES_THP 1 // advised; eth_huge_backed() tells how much is huge
+#define ETH_PAGES_2M 2
+#define ETH_PAGES_1G 3
+#define ETH_PAGES_KINDS 4
+
+struct eth_huge_buffer
+{
+	void *data;
+	size_t size;   // requested
+	size_t mapped; // rounded up to the page size
+	int pages;     // ETH_PAGES_*
+};
+
+struct eth_huge_stats
+{
+	size_t mapped[ETH_PAGES_KINDS]; // bytes currently mapped, by page kind
+	size_t peak[ETH_PAGES_KINDS];   // most ever mapped at once
+	unsigned long fallbacks;        // attempts that fell back to a smaller size
+};
+
+int eth_huge_pages_set(int mode);
+// By name: "off", "thp", "2m" or "1g"
+int eth_huge_pages_select(const char *name);
+int eth_huge_pages_mode(void);
+const char *eth_huge_pages_name(int pages);
+// Zero-filled, page-aligned memory; callers wipe secrets before freeing
+int eth_huge_alloc(struct eth_huge_buffer *buf, size_t size);
+void eth_huge_free(struct eth_huge_buffer *buf);
+// Bytes of the buffer currently backed by huge pages
+size_t eth_huge_backed(const struct eth_huge_buffer *buf);
+void eth_huge_stats(struct eth_huge_stats *stats);
+
+// Bulk output writer: the caller fills large page-aligned buffers in place
+// while earlier ones are written out asynchronously. ETH_WRITER_URING keeps
+// up to `depth` writes in flight on an io_uring with registered buffers;
+// ETH_WRITER_PWRITEV hands buffers to a writer thread that coalesces them
+// into pwritev calls. AUTO picks io_uring when the kernel allows it and the
+// fd is seekable. With `direct`, full buffers bypass the page cache
+// (O_DIRECT) and the partial last buffer is written buffered. One thread
+// fills a writer at a time.
+#define ETH_WRITER_AUTO 0
+#define ETH_WRITER_URING 1
+#define ETH_WRITER_PWRITEV 2
+
+struct eth_writer_config
+{
+	int fd;                 // written from its current offset
+	size_t buffer_size;     // rounded up to 4 KB; 0 = 4 MB
+	unsigned int depth;     // buffers; 0 = 8
+	int direct;
+	int backend;            // ETH_WRITER_*
+};
+
+struct eth_writer_stats
+{
+	unsigned long long bytes;
+	unsigned long long writes;      // write requests issued
+	unsigned long long stalls;      // times the filler waited for a buffer
+	unsigned int max_in_flight;     // most buffers queued or being written at once
+	int direct;                     // O_DIRECT was in effect
+};
+
+struct eth_writer;
+
+// NULL on bad input, or if ETH_WRITER_URING was demanded but is unavailable
+struct eth_writer *eth_writer_create(const struct eth_writer_config *config);
+// Contiguous free space in the current buffer (at least 1 byte) at *space,
+// waiting for a completed write if every buffer is busy
+size_t eth_writer_reserve(struct eth_writer *writer, unsigned char **space);
+// Appends `len` bytes written at the reserved space; a full buffer is submitted
+int eth_writer_commit(struct eth_writer *writer, size_t len);
+// Copying convenience over reserve/commit
+int eth_writer_write(struct eth_writer *writer, const void *data, size_t len);
+// Submits the partial buffer and waits for every write; 0 if all succeeded
+int eth_writer_finish(struct eth_writer *writer);
+void eth_writer_stats(const struct eth_writer *writer, struct eth_writer_stats *stats);
+const char *eth_writer_backend(const struct eth_writer *writer);
+// Wipes the buffers (they usually hold keys) and frees the writer
+void eth_writer_free(struct eth_writer *writer);
+
+// External merge sort of raw key || address records by address, for files
+// far larger than memory. Chunks of `memory / 2` are radix-sorted on the
+// leading address bytes (in parallel) into temporary runs. The runs are then
+// merged `fan_in` at a time with large sequential reads. The final merge
+// writes the output and reports every record whose address repeats the
+// previous one. Run files are unlinked as soon as they are created, but
+// they hold keys until the sort ends: put tmp_dir on storage as trusted as
+// the input.
+struct eth_sort_config
+{
+	const char *input;
+	const char *output;     // created mode 0600
+	const char *tmp_dir;    // NULL = the output's directory
+	size_t memory;          // bytes for sorting and merge buffers, 0 = 1 GB
+	unsigned int threads;   // 0 = one per online CPU
+	unsigned int fan_in;    // runs merged at once, 0 = 64
+	int dedup;              // keep only the first record of each address
+};
+
+struct eth_sort_result
+{
+	size_t records;             // read
+	size_t written;
+	size_t runs;
+	unsigned int merge_passes;
+	size_t duplicate_addresses; // records repeating an earlier record's address
+	size_t duplicate_keys;      // of those, with the same key too
+};
+
+// `record` repeats the address of `first`, the first record seen with it
+typedef void (*eth_sort_dup_fn)(void *arg, const unsigned char *record, const unsigned char *first);
+
+// -1 on I/O errors, if the input is not a whole number of records or if the
+// output is the input file
+int eth_sort_records(const struct eth_sort_config *config, eth_sort_dup_fn report, void *arg,
+	struct eth_sort_result *result);
+
+// Autotuning: short single-thread benchmarks of the generation stages (RNG,
+// EC, Keccak + hex, each kernel variant) followed by pipeline trials into
+// /dev/null pick the kernel variant, lane count and batch size for this
+// host. Results are cached per CPU model and CPU count, so later runs apply
+// them without measuring. Call before generating; switching the kernel
+// variant is not safe while other threads hash.
+struct eth_tune_params
+{
+	char cpu_model[128];
+	unsigned int cpus;    // online CPUs when tuned
+	char kernel[16];      // kernel variant, see eth_kernel_variant()
+	unsigned int lanes;   // pipeline lanes
+	size_t batch;         // pipeline batch
+	size_t ring_size;     // pipeline ring records
+	double rate;          // pipeline wallets/s with these settings
+	double ec_rate;       // public keys/s, one thread
+	double keccak_rate;   // addresses hashed and hex-encoded/s, one thread
+	double rng_rate;      // 32-byte random draws/s, one thread
+	int cached;           // read from the cache rather than measured
+};
+
+// Loads this host's entry from `cache_path` (NULL = eth_tune_cache_path())
+// or, when there is none or `force` is set, measures and stores it.
+// The trials draw keys from the OS RNG, never from an installed entropy
+// source. Selects the kernel variant (unless WALGEN_KERNEL is set)
+// and makes the pipeline use the tuned values for fields left zero.
+int eth_autotune(const char *cache_path, int force, struct eth_tune_params *params);
+// The parameters eth_autotune() applied; -1 if it has not run
+int eth_tune_query(struct eth_tune_params *params);
+// $XDG_CACHE_HOME/walgen/tune, else $HOME/.cache/walgen/tune
+int eth_tune_cache_path(char *path, size_t size);
+
+// Entropy sources: every private key the library generates draws its bytes
+// from the installed source instead of getrandom (RAND_bytes elsewhere).
+// Context blinding seeds keep using the OS. Install before generating;
+// swapping sources while other threads generate is not supported.
+struct eth_entropy_source
+{
+	// Fill `len` bytes never handed out before; non-zero once exhausted
+	int (*read)(void *ctx, unsigned char *buf, size_t len);
+	void (*close)(void *ctx); // optional, called when replaced or removed
+	void *ctx;
+};
+
+// XOR getrandom output into everything the file hands out
+#define ETH_ENTROPY_MIX_OS 1
+
+// Takes ownership of `source`; NULL closes it and returns to the OS RNG.
+// Generation fails (rather than falling back) once the source runs dry.
+int eth_entropy_install(const struct eth_entropy_source *source);
+// Bytes drawn from the installed source since it was installed
+unsigned long long eth_entropy_used(void);
+// Entropy from a file ("-" = stdin). A regular file is memory-mapped and
+// handed out in disjoint slices with one atomic add per draw; how far it
+// has been used is kept in `<path>.used`, synced ahead of use, so no byte
+// is handed out twice, even across runs or after a crash. Pipes, FIFOs and
+// character devices are read sequentially under a lock.
+int eth_entropy_file_open(const char *path, int flags, struct eth_entropy_source *source);
+
+// Crypto backends for address derivation, chosen at run time. Scalar
+// multiplication: "secp256k1" (default) or "openssl" (EC_POINT_mul on
+// secp256k1). Keccak-256 of the public key: "kernels" (the built-in
+// dispatched kernels, default), "libkeccak" or "openssl" (the EVP
+// KECCAK-256 digest, OpenSSL 3.2 and later). The vanity-search point walk
+// and multi-lane selector hashing keep their own kernels. Select before
+// generating; WALGEN_EC_BACKEND and WALGEN_KECCAK_BACKEND set the start.
+#define ETH_BACKEND_EC 0
+#define ETH_BACKEND_KECCAK 1
+
+// Fails if the name is unknown or the backend cannot run here
+int eth_backend_select(int kind, const char *name);
+int eth_backend_available(int kind, const char *name);
+const char *eth_backend_name(int kind);
+// Names of all backends of a kind by index, NULL past the end
+const char *eth_backend_variant(int kind, unsigned int index);
+// Addresses of 64-byte public key bodies (uncompressed, without the 0x04
+// prefix), hashed by the selected Keccak backend; no curve check
+int eth_pubkey64_to_addresses(const unsigned char *pubkeys, size_t count, unsigned char *addresses);
+
+// Pull-based wallet stream: wallets are generated in batches and next()
+// hands out pointers into the ready batch, so the per-wallet cost is a
+// pointer bump. With `prefetch` a background thread fills a second batch
+// while the first is consumed. The buffers are locked and excluded from
+// core dumps; one stream serves one consumer thread.
+struct eth_wallet_stream;
+
+struct eth_wallet_stream_config
+{
+	size_t batch; // wallets per batch, 0 = 1024
+	int prefetch; // generate the next batch on a background thread
+};
+
+// `config` may be NULL for the defaults
+struct eth_wallet_stream *eth_wallet_stream_open(const struct eth_wallet_stream_config *config);
+// The pointers stay valid until the next call on the stream
+int eth_wallet_stream_next(struct eth_wallet_stream *stream, const unsigned char **priv_key,
+	const unsigned char **address);
+// Copying form of next()
+int eth_wallet_stream_read(struct eth_wallet_stream *stream, unsigned char *priv_key, unsigned char *address);
+// Joins the prefetch thread and wipes the buffers
+void eth_wallet_stream_close(struct eth_wallet_stream *stream);
+
+// Latency histograms, recorded per thread without locks and merged on
+// demand. Buckets are log-linear (8 per octave, at most 12.5% wide), in
+// nanoseconds. Recording is on unless WALGEN_LATENCY=0; it costs two clock
+// reads per operation.
+#define ETH_LATENCY_SINGLE 0 // generate_single_eth_address()
+#define ETH_LATENCY_BATCH 1  // eth_generator_fill()
+#define ETH_LATENCY_SIGN 2   // one signature, alone or in a batch
+#define ETH_LATENCY_FLUSH 3  // one write of an output buffer
+#define ETH_LATENCY_OPS 4
+#define ETH_LATENCY_BUCKETS 336
+
+struct eth_latency_histogram
+{
+	unsigned long long count;
+	unsigned long long sum_ns;
+	unsigned long long max_ns;
+	unsigned long long buckets[ETH_LATENCY_BUCKETS];
+};
+
+void eth_latency_enable(int on);
+int eth_latency_enabled(void);
+const char *eth_latency_op_name(int op);
+// Adds one sample to the calling thread's histogram for `op`
+void eth_latency_record(int op, unsigned long long ns);
+// Sum over all threads, past ones included
+int eth_latency_merge(int op, struct eth_latency_histogram *histogram);
+// Largest value that falls into `bucket`
+unsigned long long eth_latency_bucket_upper(unsigned int bucket);
+unsigned long long eth_latency_quantile(const struct eth_latency_histogram *histogram, double q);
+// Prometheus text exposition: a `walgen_latency_seconds` histogram with one
+// `le` per octave from about 1 us, plus quantile and maximum gauges taken at
+// full resolution. The file form ("-" = stdout) is renamed into place.
+typedef int (*eth_latency_write_fn)(void *ctx, const char *text, size_t len);
+int eth_latency_expose(eth_latency_write_fn write, void *ctx);
+int eth_latency_expose_file(const char *path);
+
+// Precomputed multiples of G (1G .. count*G) in a versioned, checksummed
+// file that processes map read-only and so share through the page cache.
+// Walks (vanity search, distributed workers, eth_sequential_addresses)
+// then start with one multiplication instead of one per point, which is
+// most of their start-up time; ETH_EC_TABLE_DEFAULT covers their width.
+// libsecp256k1's own multiplication tables are static data in the library
+// and already shared. Load before starting walks; WALGEN_EC_TABLE names a
+// table to load on first use.
+#define ETH_EC_TABLE_DEFAULT 256
+
+int eth_ec_table_create(const char *path, size_t count);
+// Checks the checksum and recomputes the first and last points; NULL unloads
+int eth_ec_table_load(const char *path);
+// Points in the loaded table, 0 if none
+size_t eth_ec_table_count(void);
+
+#ifdef __cplusplus
+}
+#endif
 
-#endif // WALLET_GEN_H
\ No newline at end of file
+#endif // WALLET_GEN_H
@@ -0,0 +1,312 @@
+#ifndef WALLET_GEN_HPP
+#define WALLET_GEN_HPP
+
+// Header-only C++20 wrapper over libwallet. Link with -lwallet -lcrypto.
+
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+
+namespace walgen
+{
+
+using PrivKey = std::array<unsigned char, ETH_PRIV_KEY_SIZE>;
+using Address = std::array<unsigned char, ETH_ADDRESS_SIZE>;
+
+// Batches are handed to the C API as flat byte arrays
+static_assert(sizeof(PrivKey) == ETH_PRIV_KEY_SIZE && sizeof(Address) == ETH_ADDRESS_SIZE);
+
+// Fixed-size, move-only buffer for key material: locked into RAM where the
+// limit allows and wiped before it is freed
+template <class T>
+class SecureBuffer
+{
+public:
+	SecureBuffer() = default;
+	explicit SecureBuffer(std::size_t size) : size_(size)
+	{
+		data_ = static_cast<T *>(std::calloc(size ? size : 1, sizeof(T)));
+		if (!data_)
+		{
+			throw std::bad_alloc();
+		}
+		locked_ = size && mlock(data_, bytes()) == 0;
+	}
+	~SecureBuffer() { reset(); }
+
+	SecureBuffer(const SecureBuffer &) = delete;
+	SecureBuffer &operator=(const SecureBuffer &) = delete;
+	SecureBuffer(SecureBuffer &&other) noexcept
+		: data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+		  locked_(std::exchange(other.locked_, false))
+	{
+	}
+	SecureBuffer &operator=(SecureBuffer &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			data_ = std::exchange(other.data_, nullptr);
+			size_ = std::exchange(other.size_, 0);
+			locked_ = std::exchange(other.locked_, false);
+		}
+		return *this;
+	}
+
+	T *data() noexcept { return data_; }
+	const T *data() const noexcept { return data_; }
+	std::size_t size() const noexcept { return size_; }
+	bool locked() const noexcept { return locked_; }
+	std::span<T> span() noexcept { return {data_, size_}; }
+	std::span<const T> span() const noexcept { return {data_, size_}; }
+	T &operator[](std::size_t i) noexcept { return data_[i]; }
+	const T &operator[](std::size_t i) const noexcept { return data_[i]; }
+
+private:
+	std::size_t bytes() const noexcept { return size_ * sizeof(T); }
+	void reset() noexcept
+	{
+		if (!data_)
+		{
+			return;
+		}
+		OPENSSL_cleanse(data_, bytes());
+		if (locked_)
+		{
+			munlock(data_, bytes());
+		}
+		std::free(data_);
+		data_ = nullptr;
+		size_ = 0;
+		locked_ = false;
+	}
+
+	T *data_ = nullptr;
+	std::size_t size_ = 0;
+	bool locked_ = false;
+};
+
+// Output formats for FdSink, fixed at compile time. Each is constructed
+// with the largest batch it will see and encodes a whole batch into a buffer
+// of at least batch * record_size bytes.
+struct Binary
+{
+	static constexpr std::size_t record_size = ETH_WALLET_RECORD_SIZE;
+
+	explicit Binary(std::size_t) {}
+	std::size_t encode(char *dst, std::span<const PrivKey> keys, std::span<const Address> addresses)
+	{
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			std::memcpy(dst + i * record_size, keys[i].data(), ETH_PRIV_KEY_SIZE);
+			std::memcpy(dst + i * record_size + ETH_PRIV_KEY_SIZE, addresses[i].data(), ETH_ADDRESS_SIZE);
+		}
+		return keys.size() * record_size;
+	}
+};
+
+namespace detail
+{
+inline char *put_hex(char *dst, const unsigned char *src, std::size_t len)
+{
+	static constexpr char digits[] = "0123456789abcdef";
+	*dst++ = '0';
+	*dst++ = 'x';
+	for (std::size_t i = 0; i < len; i++)
+	{
+		*dst++ = digits[src[i] >> 4];
+		*dst++ = digits[src[i] & 15];
+	}
+	return dst;
+}
+} // namespace detail
+
+// "0x<key> 0x<address>\n", the same lines walgen gen writes
+struct Hex
+{
+	static constexpr std::size_t record_size = ETH_WALLET_HEX_LINE_SIZE;
+
+	explicit Hex(std::size_t) {}
+	std::size_t encode(char *dst, std::span<const PrivKey> keys, std::span<const Address> addresses)
+	{
+		char *p = dst;
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			p = detail::put_hex(p, keys[i].data(), ETH_PRIV_KEY_SIZE);
+			*p++ = ' ';
+			p = detail::put_hex(p, addresses[i].data(), ETH_ADDRESS_SIZE);
+			*p++ = '\n';
+		}
+		return static_cast<std::size_t>(p - dst);
+	}
+};
+
+// As Hex, with the address in EIP-55 checksum case
+class Eip55
+{
+public:
+	static constexpr std::size_t record_size = ETH_WALLET_HEX_LINE_SIZE;
+
+	explicit Eip55(std::size_t max_batch) : checksummed_(max_batch * ETH_EIP55_SIZE) {}
+	std::size_t encode(char *dst, std::span<const PrivKey> keys, std::span<const Address> addresses)
+	{
+		if (keys.empty())
+		{
+			return 0;
+		}
+		// One call per batch
+		if (eth_address_eip55(addresses.data()->data(), keys.size(), checksummed_.data()) != 0)
+		{
+			throw std::runtime_error("EIP-55 encoding failed");
+		}
+		char *p = dst;
+		for (std::size_t i = 0; i < keys.size(); i++)
+		{
+			p = detail::put_hex(p, keys[i].data(), ETH_PRIV_KEY_SIZE);
+			*p++ = ' ';
+			std::memcpy(p, checksummed_.data() + i * ETH_EIP55_SIZE, ETH_EIP55_SIZE);
+			p += ETH_EIP55_SIZE;
+			*p++ = '\n';
+		}
+		return static_cast<std::size_t>(p - dst);
+	}
+
+private:
+	SecureBuffer<char> checksummed_;
+};
+
+// Encodes each batch with Format and writes it to a file descriptor. The
+// encode buffer is sized once for the largest batch it will see.
+template <class Format>
+class FdSink
+{
+public:
+	FdSink(int fd, std::size_t max_batch) : fd_(fd), format_(max_batch), buffer_(max_batch * Format::record_size) {}
+
+	void operator()(std::span<const PrivKey> keys, std::span<const Address> addresses)
+	{
+		if (keys.size() * Format::record_size > buffer_.size())
+		{
+			throw std::length_error("batch larger than the sink was sized for");
+		}
+		std::size_t len = format_.encode(buffer_.data(), keys, addresses);
+		const char *p = buffer_.data();
+		while (len > 0)
+		{
+			ssize_t n = ::write(fd_, p, len);
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (n < 0)
+			{
+				throw std::runtime_error("write failed");
+			}
+			p += n;
+			len -= static_cast<std::size_t>(n);
+		}
+	}
+
+private:
+	int fd_;
+	Format format_;
+	SecureBuffer<char> buffer_; // holds encoded private keys
+};
+
+using BinarySink = FdSink<Binary>;
+using HexSink = FdSink<Hex>;
+using Eip55Sink = FdSink<Eip55>;
+
+// Hands each batch to a callable taking (span<const PrivKey>, span<const Address>)
+template <class F>
+class CallbackSink
+{
+public:
+	explicit CallbackSink(F f) : f_(std::move(f)) {}
+
+	void operator()(std::span<const PrivKey> keys, std::span<const Address> addresses) { f_(keys, addresses); }
+
+private:
+	F f_;
+};
+
+// Owns the secp256k1 context for one thread of generation
+class Generator
+{
+public:
+	Generator() : gen_(eth_generator_create())
+	{
+		if (!gen_)
+		{
+			throw std::runtime_error("eth_generator_create failed");
+		}
+	}
+	~Generator() { eth_generator_destroy(gen_); }
+
+	Generator(const Generator &) = delete;
+	Generator &operator=(const Generator &) = delete;
+	Generator(Generator &&other) noexcept : gen_(std::exchange(other.gen_, nullptr)) {}
+	Generator &operator=(Generator &&other) noexcept
+	{
+		if (this != &other)
+		{
+			eth_generator_destroy(gen_);
+			gen_ = std::exchange(other.gen_, nullptr);
+		}
+		return *this;
+	}
+
+	// Fills min(keys.size(), addresses.size()) wallets
+	void generate(std::span<PrivKey> keys, std::span<Address> addresses)
+	{
+		std::size_t count = keys.size() < addresses.size() ? keys.size() : addresses.size();
+		if (count == 0)
+		{
+			return;
+		}
+		if (eth_generator_fill(gen_, keys.data()->data(), addresses.data()->data(), count) != 0)
+		{
+			throw std::runtime_error("eth_generator_fill failed");
+		}
+	}
+
+	// Generates `count` wallets in batches of `batch`, passing each batch to
+	// `sink`. Keys live in one locked buffer reused across batches. A zero
+	// batch throws std::invalid_argument.
+	template <class Sink>
+	void generate(std::size_t count, Sink &sink, std::size_t batch = 4096)
+	{
+		if (batch == 0)
+		{
+			throw std::invalid_argument("batch must be positive");
+		}
+		SecureBuffer<PrivKey> keys(batch);
+		SecureBuffer<Address> addresses(batch);
+		while (count > 0)
+		{
+			std::size_t n = count < batch ? count : batch;
+			generate(keys.span().first(n), addresses.span().first(n));
+			sink(std::span<const PrivKey>(keys.data(), n), std::span<const Address>(addresses.data(), n));
+			count -= n;
+		}
+	}
+
+	eth_generator *native() noexcept { return gen_; }
+
+private:
+	eth_generator *gen_;
+};
+
+} // namespace walgen
+
+#endif // WALLET_GEN_HPP
@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include "wallet_gen.h"
+
+#define HUGE_2M (2UL << 20)
+#define HUGE_1G (1UL << 30)
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static const char *const mode_names[] = {"off", "thp", "2m", "1g"};
+static const char *const page_names[] = {"4k", "thp", "2m", "1g"};
+
+static int huge_mode = ETH_HUGE_OFF;
+// Bytes currently mapped and their high-water marks, by ETH_PAGES_* kind
+static atomic_size_t huge_mapped[ETH_PAGES_KINDS];
+static atomic_size_t huge_peak[ETH_PAGES_KINDS];
+static atomic_ulong huge_fallbacks;
+
+// WALGEN_HUGEPAGES=off|thp|2m|1g sets the starting mode
+__attribute__((constructor)) static void huge_init(void)
+{
+	const char *mode = getenv("WALGEN_HUGEPAGES");
+	if (mode)
+	{
+		eth_huge_pages_select(mode);
+	}
+}
+
+int eth_huge_pages_set(int mode)
+{
+	if (mode < ETH_HUGE_OFF || mode > ETH_HUGE_1G)
+	{
+		return -1;
+	}
+	huge_mode = mode;
+	return 0;
+}
+
+int eth_huge_pages_select(const char *name)
+{
+	for (int i = 0; name && i <= ETH_HUGE_1G; i++)
+	{
+		if (strcmp(mode_names[i], name) == 0)
+		{
+			huge_mode = i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int eth_huge_pages_mode(void)
+{
+	return huge_mode;
+}
+
+const char *eth_huge_pages_name(int pages)
+{
+	return pages >= 0 && pages < ETH_PAGES_KINDS ? page_names[pages] : "?";
+}
+
+#ifdef MAP_HUGETLB
+// Explicit huge pages come from the hugetlbfs pool (vm.nr_hugepages), so
+// this fails unless the administrator reserved enough of them
+static void *huge_map_hugetlb(size_t size, int flag)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flag, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+}
+#endif
+
+// 2 MB-aligned anonymous memory, so transparent huge pages can back every
+// extent; over-maps by one huge page and trims the ends
+static void *huge_map_aligned(size_t size)
+{
+	unsigned char *p = mmap(NULL, size + HUGE_2M, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+	{
+		return NULL;
+	}
+	size_t lead = (HUGE_2M - ((uintptr_t)p & (HUGE_2M - 1))) & (HUGE_2M - 1);
+	if (lead)
+	{
+		munmap(p, lead);
+	}
+	munmap(p + lead + size, HUGE_2M - lead);
+	return p + lead;
+}
+
+int eth_huge_alloc(struct eth_huge_buffer *buf, size_t size)
+{
+	if (!buf || size == 0)
+	{
+		return -1;
+	}
+	memset(buf, 0, sizeof(*buf));
+	buf->size = size;
+	int mode = huge_mode;
+
+#ifdef MAP_HUGETLB
+	// Only buffers of at least one page of a size try that size: rounding a
+	// small ring up to 1 GB would waste far more than the TLB saves
+	if (mode == ETH_HUGE_1G && size >= HUGE_1G)
+	{
+		size_t mapped = (size + HUGE_1G - 1) & ~(HUGE_1G - 1);
+		if ((buf->data = huge_map_hugetlb(mapped, MAP_HUGE_1GB)) != NULL)
+		{
+			buf->mapped = mapped;
+			buf->pages = ETH_PAGES_1G;
+		}
+		else
+		{
+			atomic_fetch_add(&huge_fallbacks, 1);
+		}
+	}
+	if (!buf->data && mode >= ETH_HUGE_2M && size >= HUGE_2M)
+	{
+		size_t mapped = (size + HUGE_2M - 1) & ~(HUGE_2M - 1);
+		if ((buf->data = huge_map_hugetlb(mapped, MAP_HUGE_2MB)) != NULL)
+		{
+			buf->mapped = mapped;
+			buf->pages = ETH_PAGES_2M;
+		}
+		else
+		{
+			atomic_fetch_add(&huge_fallbacks, 1);
+		}
+	}
+#endif
+#ifdef MADV_HUGEPAGE
+	if (!buf->data && mode >= ETH_HUGE_THP && size >= HUGE_2M)
+	{
+		size_t mapped = (size + HUGE_2M - 1) & ~(HUGE_2M - 1);
+		if ((buf->data = huge_map_aligned(mapped)) != NULL)
+		{
+			buf->mapped = mapped;
+			if (madvise(buf->data, mapped, MADV_HUGEPAGE) == 0)
+			{
+				buf->pages = ETH_PAGES_THP;
+			}
+			else
+			{
+				// THP disabled or unsupported: plain pages after all
+				atomic_fetch_add(&huge_fallbacks, 1);
+			}
+		}
+	}
+#endif
+	if (!buf->data)
+	{
+		void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+		{
+			return -1;
+		}
+		buf->data = p;
+		buf->mapped = size;
+		buf->pages = ETH_PAGES_4K;
+	}
+	size_t now = atomic_fetch_add(&huge_mapped[buf->pages], buf->mapped) + buf->mapped;
+	size_t peak = atomic_load(&huge_peak[buf->pages]);
+	while (now > peak && !atomic_compare_exchange_weak(&huge_peak[buf->pages], &peak, now))
+	{
+	}
+	return 0;
+}
+
+void eth_huge_free(struct eth_huge_buffer *buf)
+{
+	if (!buf || !buf->data)
+	{
+		return;
+	}
+	atomic_fetch_sub(&huge_mapped[buf->pages], buf->mapped);
+	munmap(buf->data, buf->mapped);
+	memset(buf, 0, sizeof(*buf));
+}
+
+size_t eth_huge_backed(const struct eth_huge_buffer *buf)
+{
+	if (!buf || !buf->data)
+	{
+		return 0;
+	}
+	if (buf->pages == ETH_PAGES_2M || buf->pages == ETH_PAGES_1G)
+	{
+		return buf->mapped;
+	}
+	if (buf->pages != ETH_PAGES_THP)
+	{
+		return 0;
+	}
+
+	// Transparent pages are only known once touched: sum AnonHugePages of
+	// the mappings inside the buffer
+	size_t backed = 0;
+#ifdef __linux__
+	FILE *f = fopen("/proc/self/smaps", "r");
+	if (!f)
+	{
+		return 0;
+	}
+	char line[256];
+	uintptr_t lo = (uintptr_t)buf->data, hi = lo + buf->mapped;
+	int inside = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		unsigned long start, end, kb;
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+		{
+			inside = start >= lo && end <= hi;
+		}
+		else if (inside && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+		{
+			backed += (size_t)kb << 10;
+		}
+	}
+	fclose(f);
+#endif
+	return backed;
+}
+
+void eth_huge_stats(struct eth_huge_stats *stats)
+{
+	for (int i = 0; i < ETH_PAGES_KINDS; i++)
+	{
+		stats->mapped[i] = atomic_load(&huge_mapped[i]);
+		stats->peak[i] = atomic_load(&huge_peak[i]);
+	}
+	stats->fallbacks = atomic_load(&huge_fallbacks);
+}
@@ -0,0 +1,104 @@
+#ifndef WALLET_INTERNAL_H
+#define WALLET_INTERNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <libkeccak.h>
+#include <secp256k1.h>
+
+// Library-private helpers shared between the wallet_*.c translation units
+#if defined(__GNUC__)
+#define WALLET_HIDDEN __attribute__((visibility("hidden")))
+#else
+#define WALLET_HIDDEN
+#endif
+
+WALLET_HIDDEN void secure_random(unsigned char *buf, size_t len);
+// Private key bytes: from the installed entropy source, else secure_random.
+// Fails once the source is exhausted or broken, with `buf` wiped.
+WALLET_HIDDEN int eth_key_material(unsigned char *buf, size_t len);
+WALLET_HIDDEN int eth_entropy_installed(void);
+struct eth_entropy_source;
+// Set the installed source aside, neither closed nor drawn from, for runs
+// whose keys are thrown away (wallet_entropy.c); 1 if there was one
+WALLET_HIDDEN int eth_entropy_detach(struct eth_entropy_source *source, unsigned long long *used);
+WALLET_HIDDEN void eth_entropy_attach(const struct eth_entropy_source *source, unsigned long long used);
+// Value of one hex digit, or -1
+WALLET_HIDDEN int eth_hex_value(char c);
+
+// Initialise a reusable Keccak-256 (Ethereum, not SHA3) state
+WALLET_HIDDEN int eth_keccak256_init(struct libkeccak_state *state);
+// Hash `len` bytes with a state from eth_keccak256_init, resetting it first
+WALLET_HIDDEN int eth_keccak256(struct libkeccak_state *state, const void *data, size_t len, unsigned char *hash);
+// Single-block Keccak-256 (wallet_kernels.c), `len` below 136
+WALLET_HIDDEN void eth_keccak256_short(const void *data, size_t len, unsigned char *hash);
+// Kernel variant measured fastest on this host (wallet_kernels.c)
+WALLET_HIDDEN const char *eth_kernel_measure(void);
+// Kernel variant in this host's autotune cache entry (wallet_tune.c)
+WALLET_HIDDEN int eth_tune_cached_kernel(char *kernel, size_t size);
+// Dispatched multi-lane Keccak-256: ETH_KECCAK_LANES messages per call,
+// message m at data + m * stride with len[m] below 136, hash m at hashes + 32 * m
+#define ETH_KECCAK_LANES 8
+WALLET_HIDDEN void eth_keccak256_lanes(const unsigned char *data, size_t stride, const size_t *len,
+	unsigned char *hashes);
+// Keccak-256 of the 64-byte public key body, last 20 bytes as the address
+WALLET_HIDDEN int eth_pubkey_to_address(const unsigned char *pub64, unsigned char *address);
+// Full derivation of the address for a private key, as generate_single_eth_address does it
+WALLET_HIDDEN int eth_seckey_to_address(const secp256k1_context *ctx, const unsigned char *priv_key,
+	unsigned char *address);
+// Non-default crypto backends (wallet_backend.c). Callers check
+// eth_backend_default() and otherwise use libsecp256k1 / the Keccak kernels.
+WALLET_HIDDEN int eth_backend_default(int kind);
+WALLET_HIDDEN int eth_backend_pubkey64(const unsigned char *priv_key, unsigned char *pub64);
+WALLET_HIDDEN int eth_backend_keccak(const void *data, size_t len, unsigned char *hash);
+// Lower-case hex of the address with EIP-55 capitalisation, 40 chars, no prefix
+WALLET_HIDDEN void eth_checksum_hex(const unsigned char *address, char *hex);
+
+// Batched affine walk: n points in 5x52-bit limbs, limb j of point i at
+// x[j * n + i], each step adding the same point Q to all of them with one
+// shared field inversion. n must be a multiple of ETH_EC_WALK_LANES.
+#define ETH_EC_WALK_LANES 8
+struct eth_ec_walk
+{
+	size_t n;
+	uint64_t *x, *y, *scratch;
+	uint64_t qx[5], qy[5];
+};
+// Dispatched step (wallet_kernels.c); fails, leaving the points as they
+// were, when some point would meet Q or -Q
+WALLET_HIDDEN int eth_ec_walk_kernel(uint64_t *x, uint64_t *y, size_t n, const uint64_t *qx, const uint64_t *qy,
+	uint64_t *scratch);
+// `step64` is Q as a 64-byte public key body
+WALLET_HIDDEN int eth_ec_walk_init(struct eth_ec_walk *walk, size_t n, const unsigned char *step64);
+WALLET_HIDDEN void eth_ec_walk_free(struct eth_ec_walk *walk);
+WALLET_HIDDEN void eth_ec_walk_set(struct eth_ec_walk *walk, size_t i, const unsigned char *pub64);
+WALLET_HIDDEN void eth_ec_walk_get(const struct eth_ec_walk *walk, size_t i, unsigned char *pub64);
+WALLET_HIDDEN int eth_ec_walk_step(struct eth_ec_walk *walk);
+// Point i = (start_key + base + i) * G, by full multiplication
+WALLET_HIDDEN int eth_ec_walk_reset(struct eth_ec_walk *walk, const secp256k1_context *ctx,
+	const unsigned char *start_key, unsigned long long base);
+// Loaded table of 1G .. count*G as 64-byte bodies, NULL unless it holds at
+// least `count` points; WALGEN_EC_TABLE is tried on the first call
+WALLET_HIDDEN const unsigned char *eth_ec_table_points(size_t count);
+// 64-byte public key body of a private key
+WALLET_HIDDEN int eth_ec_pubkey64(const secp256k1_context *ctx, const unsigned char *priv_key, unsigned char *pub64);
+
+// Pin the calling thread to `cpu` modulo the online CPU count (no-op where unsupported)
+WALLET_HIDDEN void eth_pin_thread(unsigned int cpu);
+WALLET_HIDDEN unsigned int eth_online_cpus(void);
+
+// Split [0, count) into one contiguous range per thread (0 = online CPUs)
+// and run `fn` on each, the calling thread included. Fails if any call did.
+typedef int (*eth_range_fn)(void *arg, size_t first, size_t count, unsigned int thread);
+WALLET_HIDDEN int eth_parallel_ranges(size_t count, unsigned int threads, eth_range_fn fn, void *arg);
+
+// Makes way for binding a unix socket at `path` (wallet_dist.c): nothing
+// there, or a stale socket that is removed. Fails on a live socket or any
+// other file.
+WALLET_HIDDEN int eth_unix_socket_clear(const char *path);
+
+// Monotonic start time for eth_latency_end(), 0 while recording is off
+WALLET_HIDDEN unsigned long long eth_latency_start(void);
+WALLET_HIDDEN void eth_latency_end(int op, unsigned long long start);
+
+#endif // WALLET_INTERNAL_H
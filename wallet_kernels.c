@@ -0,0 +1,381 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#endif
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define KECCAK256_RATE 136
+#define ROL64(x, n) (((x) << (n)) | ((x) >> ((64 - (n)) & 63)))
+
+static const uint64_t keccak_rc[24] = {
+	0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+	0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+	0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+	0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+	0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+	0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+// Lane i = x + 5y: rotation, and destination index of the pi step
+static const unsigned char keccak_rho[25] = {
+	0, 1, 62, 28, 27, 36, 44, 6, 55, 20, 3, 10, 43, 25, 39, 41, 45, 15, 21, 8, 18, 2, 61, 56, 14,
+};
+static const unsigned char keccak_pi[25] = {
+	0, 10, 20, 5, 15, 16, 1, 11, 21, 6, 7, 17, 2, 12, 22, 23, 8, 18, 3, 13, 14, 24, 9, 19, 4,
+};
+
+static inline uint64_t load64_le(const unsigned char *p)
+{
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--)
+	{
+		v = v << 8 | p[i];
+	}
+	return v;
+}
+
+static inline void store64_le(unsigned char *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		p[i] = (unsigned char)(v >> (8 * i));
+	}
+}
+
+// One uint64_t per message for the multi-lane Keccak kernels
+typedef uint64_t keccak_lanes __attribute__((vector_size(8 * ETH_KECCAK_LANES)));
+
+// secp256k1 field constants for wallet_field.h
+#define FE_M52 0xFFFFFFFFFFFFFULL
+#define FE_M48 0xFFFFFFFFFFFFULL
+#define FE_K 0x1000003D1ULL   // 2^256 mod p
+#define FE_R 0x1000003D10ULL  // 2^260 mod p
+static const uint64_t fe_2p[5] = {
+	0x1FFFFDFFFFF85EULL, 0x1FFFFFFFFFFFFEULL, 0x1FFFFFFFFFFFFEULL, 0x1FFFFFFFFFFFFEULL, 0x1FFFFFFFFFFFEULL,
+};
+static const uint64_t fe_p[5] = {
+	0xFFFFEFFFFFC2FULL, 0xFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFFULL, 0xFFFFFFFFFFFFULL,
+};
+
+// Weak-form values are below 2p, so zero is either 0 or p
+static int fe_is_zero(const uint64_t *a)
+{
+	return (a[0] | a[1] | a[2] | a[3] | a[4]) == 0 ||
+		(a[0] == fe_p[0] && a[1] == fe_p[1] && a[2] == fe_p[2] && a[3] == fe_p[3] && a[4] == fe_p[4]);
+}
+
+#define KERNEL_SUFFIX scalar
+#define KERNEL_TARGET
+#include "wallet_kernels.h"
+#include "wallet_field.h"
+#undef KERNEL_SUFFIX
+#undef KERNEL_TARGET
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define WALLET_KERNELS_X86 1
+
+// Only the multi-lane Keccak and the IFMA walk have vector code; the
+// single-message hash, the hex encoder and the one-chain walk gain nothing
+// from a wider target and stay scalar in every variant
+#define KERNEL_VECTOR_ONLY
+
+#define KERNEL_SUFFIX avx2
+#define KERNEL_TARGET __attribute__((target("avx2")))
+#include "wallet_kernels.h"
+#undef KERNEL_SUFFIX
+#undef KERNEL_TARGET
+
+#define KERNEL_SUFFIX avx512
+#define KERNEL_TARGET __attribute__((target("avx512f,avx512vl,avx512bw,avx2")))
+#include "wallet_kernels.h"
+#undef KERNEL_SUFFIX
+#undef KERNEL_TARGET
+
+#define KERNEL_SUFFIX ifma
+#define KERNEL_TARGET __attribute__((target("avx512f,avx512vl,avx512bw,avx512ifma,avx2")))
+#define KERNEL_IFMA
+#include "wallet_kernels.h"
+#include "wallet_field.h"
+#undef KERNEL_IFMA
+#undef KERNEL_SUFFIX
+#undef KERNEL_TARGET
+
+#undef KERNEL_VECTOR_ONLY
+#endif
+
+// Calibration time per variant for the autotune
+#define KERNEL_MEASURE_SECONDS 0.002
+#define KERNEL_MEASURE_RUNS 3
+// Points per calibration walk step
+#define KERNEL_MEASURE_WALK 64
+
+struct kernel
+{
+	const char *name;
+	int (*supported)(void);
+	void (*keccak256_lanes)(const unsigned char *data, size_t stride, const size_t *len, unsigned char *hashes);
+	int (*ec_walk_step)(uint64_t *x, uint64_t *y, size_t n, const uint64_t *qx, const uint64_t *qy, uint64_t *scratch);
+};
+
+static int always(void)
+{
+	return 1;
+}
+
+#ifdef WALLET_KERNELS_X86
+static int has_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static int has_avx512(void)
+{
+	return has_avx2() && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+		__builtin_cpu_supports("avx512bw");
+}
+
+static int has_ifma(void)
+{
+	return has_avx512() && __builtin_cpu_supports("avx512ifma");
+}
+#endif
+
+// Widest first, scalar last: with no tune cache entry the first one the
+// CPU supports is used
+static const struct kernel kernels[] = {
+#ifdef WALLET_KERNELS_X86
+	{"avx512ifma", has_ifma, keccak256_lanes_ifma, ec_walk_step8_ifma},
+	{"avx512", has_avx512, keccak256_lanes_avx512, ec_walk_step_scalar},
+	{"avx2", has_avx2, keccak256_lanes_avx2, ec_walk_step_scalar},
+#endif
+	{"scalar", always, keccak256_lanes_scalar, ec_walk_step_scalar},
+};
+
+#define KERNEL_COUNT (sizeof(kernels) / sizeof(kernels[0]))
+
+// NULL until the first dispatched call or eth_kernel_select()
+static _Atomic(const struct kernel *) active;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static double kernel_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void kernel_cpu_init(void)
+{
+#ifdef WALLET_KERNELS_X86
+	// Constructors may call in first, so cpu detection may not be set up
+	__builtin_cpu_init();
+#endif
+}
+
+static const struct kernel *kernel_find(const char *name)
+{
+	kernel_cpu_init();
+	for (size_t i = 0; i < KERNEL_COUNT; i++)
+	{
+		if (name && strcmp(kernels[i].name, name) == 0 && kernels[i].supported())
+		{
+			return &kernels[i];
+		}
+	}
+	return NULL;
+}
+
+// Multi-lane Keccak blocks per second, best of a few short runs. Each
+// output feeds the next input so no call can be skipped.
+static double kernel_lanes_rate(const struct kernel *k)
+{
+	unsigned char data[ETH_KECCAK_LANES][64] = {{0}};
+	unsigned char hashes[32 * ETH_KECCAK_LANES];
+	size_t len[ETH_KECCAK_LANES];
+	double best = 0;
+
+	for (int m = 0; m < ETH_KECCAK_LANES; m++)
+	{
+		len[m] = sizeof(data[m]);
+		data[m][0] = (unsigned char)m;
+	}
+	for (int run = 0; run < KERNEL_MEASURE_RUNS; run++)
+	{
+		size_t done = 0;
+		double elapsed;
+		double start = kernel_now();
+		do
+		{
+			for (int r = 0; r < 16; r++)
+			{
+				k->keccak256_lanes(&data[0][0], sizeof(data[0]), len, hashes);
+				data[r % ETH_KECCAK_LANES][1] ^= hashes[r];
+			}
+			done += 16;
+		} while ((elapsed = kernel_now() - start) < KERNEL_MEASURE_SECONDS);
+		if (done / elapsed > best)
+		{
+			best = done / elapsed;
+		}
+	}
+	return best;
+}
+
+// Walk steps per second over KERNEL_MEASURE_WALK points. The formulas do
+// not need the points to be on the curve, so any field elements will do.
+static double kernel_walk_rate(const struct kernel *k)
+{
+	uint64_t x[5 * KERNEL_MEASURE_WALK], y[5 * KERNEL_MEASURE_WALK];
+	uint64_t scratch[10 * KERNEL_MEASURE_WALK];
+	const uint64_t qx[5] = {1, 2, 3, 4, 5};
+	const uint64_t qy[5] = {5, 4, 3, 2, 1};
+	double best = 0;
+
+	for (size_t i = 0; i < 5 * KERNEL_MEASURE_WALK; i++)
+	{
+		x[i] = ((i + 7) * 0x9E3779B97F4A7C15ULL) & FE_M48;
+		y[i] = ((i + 11) * 0xC2B2AE3D27D4EB4FULL) & FE_M48;
+	}
+	for (int run = 0; run < KERNEL_MEASURE_RUNS; run++)
+	{
+		size_t done = 0;
+		double elapsed;
+		double start = kernel_now();
+		do
+		{
+			k->ec_walk_step(x, y, KERNEL_MEASURE_WALK, qx, qy, scratch);
+			done++;
+		} while ((elapsed = kernel_now() - start) < KERNEL_MEASURE_SECONDS);
+		if (done / elapsed > best)
+		{
+			best = done / elapsed;
+		}
+	}
+	return best;
+}
+
+const char *eth_kernel_measure(void)
+{
+	const struct kernel *best = &kernels[KERNEL_COUNT - 1];
+	double best_lanes = kernel_lanes_rate(best);
+	double best_walk = 0; // measured once a variant with another walk shows up
+
+	kernel_cpu_init();
+	// Narrow to wide. A wider variant must be no slower at either kernel
+	// and clearly faster at one, so timing noise, or a part that clocks
+	// down under wide vectors, keeps the narrower one. In particular the
+	// IFMA walk is only used where it beats the scalar one.
+	for (size_t i = KERNEL_COUNT - 1; i-- > 0;)
+	{
+		const struct kernel *k = &kernels[i];
+		if (!k->supported())
+		{
+			continue;
+		}
+		double lanes = kernel_lanes_rate(k);
+		double walk = best_walk;
+		if (k->ec_walk_step != best->ec_walk_step)
+		{
+			if (best_walk == 0)
+			{
+				best_walk = kernel_walk_rate(best);
+			}
+			walk = kernel_walk_rate(k);
+		}
+		if (lanes >= best_lanes * 0.97 && walk >= best_walk * 0.97 &&
+			(lanes > best_lanes * 1.03 || walk > best_walk * 1.03))
+		{
+			best = k;
+			best_lanes = lanes;
+			best_walk = walk;
+		}
+	}
+	return best->name;
+}
+
+// WALGEN_KERNEL, else the variant the autotune cache recorded for this
+// host, else the widest the CPU supports. Nothing is timed here: measuring
+// is the autotune's job, so first use costs no start-up time.
+static void kernel_pick(void)
+{
+	char cached[16];
+	const struct kernel *k = kernel_find(getenv("WALGEN_KERNEL"));
+
+	if (!k && eth_tune_cached_kernel(cached, sizeof(cached)) == 0)
+	{
+		k = kernel_find(cached);
+	}
+	for (size_t i = 0; !k && i < KERNEL_COUNT; i++)
+	{
+		if (kernels[i].supported())
+		{
+			k = &kernels[i];
+		}
+	}
+	// An eth_kernel_select() that got in first stands
+	const struct kernel *none = NULL;
+	atomic_compare_exchange_strong(&active, &none, k);
+}
+
+static inline const struct kernel *kernel_active(void)
+{
+	const struct kernel *k = atomic_load_explicit(&active, memory_order_acquire);
+	if (__builtin_expect(!k, 0))
+	{
+		pthread_once(&kernel_once, kernel_pick);
+		k = atomic_load(&active);
+	}
+	return k;
+}
+
+const char *eth_kernel_name(void)
+{
+	return kernel_active()->name;
+}
+
+const char *eth_kernel_variant(unsigned int index)
+{
+	return index < KERNEL_COUNT ? kernels[index].name : NULL;
+}
+
+int eth_kernel_select(const char *name)
+{
+	const struct kernel *k = kernel_find(name);
+	if (!k)
+	{
+		return -1;
+	}
+	atomic_store(&active, k);
+	return 0;
+}
+
+void eth_keccak256_64(const unsigned char *data, unsigned char *hash)
+{
+	keccak256_short_scalar(data, 64, hash);
+}
+
+void eth_keccak256_short(const void *data, size_t len, unsigned char *hash)
+{
+	keccak256_short_scalar(data, len, hash);
+}
+
+void eth_keccak256_lanes(const unsigned char *data, size_t stride, const size_t *len, unsigned char *hashes)
+{
+	kernel_active()->keccak256_lanes(data, stride, len, hashes);
+}
+
+void eth_hex_encode(const unsigned char *src, size_t len, char *dst)
+{
+	hex_encode_scalar(src, len, dst);
+}
+
+int eth_ec_walk_kernel(uint64_t *x, uint64_t *y, size_t n, const uint64_t *qx, const uint64_t *qy, uint64_t *scratch)
+{
+	return kernel_active()->ec_walk_step(x, y, n, qx, qy, scratch);
+}
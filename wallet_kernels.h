@@ -0,0 +1,159 @@
+// Hot kernels, compiled once per instruction set by wallet_kernels.c.
+// No include guard: the including file defines KERNEL_SUFFIX and
+// KERNEL_TARGET (a function attribute, possibly empty) before each include,
+// and KERNEL_VECTOR_ONLY for builds that only need the multi-lane code.
+
+#define KERNEL_CAT_(a, b) a##_##b
+#define KERNEL_CAT(a, b) KERNEL_CAT_(a, b)
+#define KERNEL_FN(name) KERNEL_CAT(name, KERNEL_SUFFIX)
+
+#ifndef KERNEL_VECTOR_ONLY
+static KERNEL_TARGET void KERNEL_FN(keccak_f1600)(uint64_t *state)
+{
+	// Work on a local copy so the lanes can live in registers
+	uint64_t s[25];
+	memcpy(s, state, sizeof(s));
+
+	for (int round = 0; round < 24; round++)
+	{
+		uint64_t c[5], d[5], b[25];
+
+		// Constant trip counts: unrolled, the % and table lookups fold away
+#pragma GCC unroll 5
+		for (int x = 0; x < 5; x++)
+		{
+			c[x] = s[x] ^ s[x + 5] ^ s[x + 10] ^ s[x + 15] ^ s[x + 20];
+		}
+#pragma GCC unroll 5
+		for (int x = 0; x < 5; x++)
+		{
+			d[x] = c[(x + 4) % 5] ^ ROL64(c[(x + 1) % 5], 1);
+		}
+		// rho and pi together: b[pi(i)] = rot(s[i] ^ d, rho(i))
+#pragma GCC unroll 25
+		for (int i = 0; i < 25; i++)
+		{
+			b[keccak_pi[i]] = ROL64(s[i] ^ d[i % 5], keccak_rho[i]);
+		}
+#pragma GCC unroll 25
+		for (int i = 0; i < 25; i++)
+		{
+			int y = i / 5 * 5, x = i % 5;
+			s[i] = b[i] ^ (~b[y + (x + 1) % 5] & b[y + (x + 2) % 5]);
+		}
+		s[0] ^= keccak_rc[round];
+	}
+	memcpy(state, s, sizeof(s));
+}
+
+// Keccak-256 of up to 135 bytes: one padded block, one permutation
+static KERNEL_TARGET void KERNEL_FN(keccak256_short)(const unsigned char *data, size_t len, unsigned char *hash)
+{
+	uint64_t s[25] = {0};
+	unsigned char block[KECCAK256_RATE] = {0};
+
+	memcpy(block, data, len);
+	block[len] ^= 0x01;
+	block[KECCAK256_RATE - 1] ^= 0x80;
+	for (int i = 0; i < KECCAK256_RATE / 8; i++)
+	{
+		s[i] = load64_le(block + 8 * i);
+	}
+	KERNEL_FN(keccak_f1600)(s);
+	for (int i = 0; i < 4; i++)
+	{
+		store64_le(hash + 8 * i, s[i]);
+	}
+}
+
+#endif
+
+// ETH_KECCAK_LANES independent permutations in one pass, one vector element
+// per message. The vector type is split into whatever registers the target
+// has: one zmm with AVX-512, two ymm with AVX2, plain words otherwise.
+static KERNEL_TARGET void KERNEL_FN(keccak_f1600_lanes)(keccak_lanes *state)
+{
+	keccak_lanes s[25];
+	memcpy(s, state, sizeof(s));
+
+	for (int round = 0; round < 24; round++)
+	{
+		keccak_lanes c[5], d[5], b[25];
+
+#pragma GCC unroll 5
+		for (int x = 0; x < 5; x++)
+		{
+			c[x] = s[x] ^ s[x + 5] ^ s[x + 10] ^ s[x + 15] ^ s[x + 20];
+		}
+#pragma GCC unroll 5
+		for (int x = 0; x < 5; x++)
+		{
+			d[x] = c[(x + 4) % 5] ^ ROL64(c[(x + 1) % 5], 1);
+		}
+#pragma GCC unroll 25
+		for (int i = 0; i < 25; i++)
+		{
+			b[keccak_pi[i]] = ROL64(s[i] ^ d[i % 5], keccak_rho[i]);
+		}
+#pragma GCC unroll 25
+		for (int i = 0; i < 25; i++)
+		{
+			int y = i / 5 * 5, x = i % 5;
+			s[i] = b[i] ^ (~b[y + (x + 1) % 5] & b[y + (x + 2) % 5]);
+		}
+		s[0] ^= keccak_rc[round];
+	}
+	memcpy(state, s, sizeof(s));
+}
+
+// Keccak-256 of ETH_KECCAK_LANES messages, message m at data + m * stride,
+// each below 136 bytes; hash m at hashes + 32 * m
+static KERNEL_TARGET void KERNEL_FN(keccak256_lanes)(const unsigned char *data, size_t stride, const size_t *len,
+	unsigned char *hashes)
+{
+	keccak_lanes s[25];
+	unsigned char block[ETH_KECCAK_LANES][KECCAK256_RATE];
+
+	memset(block, 0, sizeof(block));
+	memset(s, 0, sizeof(s));
+	for (int m = 0; m < ETH_KECCAK_LANES; m++)
+	{
+		memcpy(block[m], data + m * stride, len[m]);
+		block[m][len[m]] ^= 0x01;
+		block[m][KECCAK256_RATE - 1] ^= 0x80;
+	}
+	for (int i = 0; i < KECCAK256_RATE / 8; i++)
+	{
+		for (int m = 0; m < ETH_KECCAK_LANES; m++)
+		{
+			s[i][m] = load64_le(block[m] + 8 * i);
+		}
+	}
+	KERNEL_FN(keccak_f1600_lanes)(s);
+	for (int m = 0; m < ETH_KECCAK_LANES; m++)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			store64_le(hashes + 32 * m + 8 * i, s[i][m]);
+		}
+	}
+}
+
+#ifndef KERNEL_VECTOR_ONLY
+// Branch-free digit selection so the loop vectorises where the target allows
+static KERNEL_TARGET void KERNEL_FN(hex_encode)(const unsigned char *src, size_t len, char *dst)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		int hi = src[i] >> 4;
+		int lo = src[i] & 15;
+		dst[2 * i] = (char)(hi + '0' + (((9 - hi) >> 8) & ('a' - '0' - 10)));
+		dst[2 * i + 1] = (char)(lo + '0' + (((9 - lo) >> 8) & ('a' - '0' - 10)));
+	}
+}
+
+#endif
+
+#undef KERNEL_FN
+#undef KERNEL_CAT
+#undef KERNEL_CAT_
@@ -0,0 +1,404 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Log-linear buckets: values below 16 ns get one bucket each, every octave
+// above that is split into 8, so a bucket is at most 12.5% wide. The last
+// bucket also takes everything from 2^44 ns (about 4.9 hours) up.
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB (1u << LATENCY_SUB_BITS)
+#define LATENCY_MAX_NS ((1ULL << 44) - 1)
+
+// Exposed `le` boundaries: every octave from 2^10 ns (about 1 us) to 2^40 ns
+#define EXPOSE_FIRST_OCTAVE 10
+#define EXPOSE_LAST_OCTAVE 40
+
+static const char *const op_names[ETH_LATENCY_OPS] = {"single", "batch", "sign", "flush"};
+
+// Written only by the owning thread, so a bump is a plain load and store;
+// merging reads them concurrently and may see a record half applied
+struct latency_op
+{
+	atomic_ullong count;
+	atomic_ullong sum_ns;
+	atomic_ullong max_ns;
+	atomic_ullong buckets[ETH_LATENCY_BUCKETS];
+};
+
+// One per live thread. Never freed: a thread that exits leaves its counts
+// for merging, and the next new thread takes the slot over.
+struct latency_thread
+{
+	struct latency_thread *next;
+	atomic_int owned;
+	struct latency_op ops[ETH_LATENCY_OPS];
+};
+
+static _Atomic(struct latency_thread *) latency_threads;
+static atomic_int latency_on = 1;
+static pthread_key_t latency_key;
+static pthread_once_t latency_once = PTHREAD_ONCE_INIT;
+
+static void latency_thread_exit(void *arg)
+{
+	struct latency_thread *t = arg;
+	atomic_store_explicit(&t->owned, 0, memory_order_release);
+}
+
+static void latency_key_init(void)
+{
+	pthread_key_create(&latency_key, latency_thread_exit);
+}
+
+// WALGEN_LATENCY=0 starts with recording off
+__attribute__((constructor)) static void latency_init(void)
+{
+	const char *env = getenv("WALGEN_LATENCY");
+	if (env && strcmp(env, "0") == 0)
+	{
+		eth_latency_enable(0);
+	}
+}
+
+static struct latency_thread *latency_thread(void)
+{
+	pthread_once(&latency_once, latency_key_init);
+	struct latency_thread *t = pthread_getspecific(latency_key);
+	if (t)
+	{
+		return t;
+	}
+
+	// Adopt a slot left by an exited thread before growing the list
+	for (t = atomic_load_explicit(&latency_threads, memory_order_acquire); t; t = t->next)
+	{
+		int free_slot = 0;
+		if (atomic_compare_exchange_strong(&t->owned, &free_slot, 1))
+		{
+			break;
+		}
+	}
+	if (!t)
+	{
+		t = calloc(1, sizeof(*t));
+		if (!t)
+		{
+			return NULL;
+		}
+		atomic_init(&t->owned, 1);
+		t->next = atomic_load_explicit(&latency_threads, memory_order_relaxed);
+		while (!atomic_compare_exchange_weak_explicit(&latency_threads, &t->next, t, memory_order_release,
+			memory_order_relaxed))
+		{
+		}
+	}
+	if (pthread_setspecific(latency_key, t) != 0)
+	{
+		atomic_store(&t->owned, 0);
+		return NULL;
+	}
+	return t;
+}
+
+static unsigned int latency_bucket(unsigned long long ns)
+{
+	if (ns > LATENCY_MAX_NS)
+	{
+		ns = LATENCY_MAX_NS;
+	}
+	if (ns < 2 * LATENCY_SUB)
+	{
+		return (unsigned int)ns;
+	}
+	unsigned int shift = (unsigned int)(63 - __builtin_clzll(ns)) - LATENCY_SUB_BITS;
+	return shift * LATENCY_SUB + (unsigned int)(ns >> shift);
+}
+
+unsigned long long eth_latency_bucket_upper(unsigned int bucket)
+{
+	if (bucket >= ETH_LATENCY_BUCKETS)
+	{
+		return 0;
+	}
+	if (bucket < 2 * LATENCY_SUB)
+	{
+		return bucket;
+	}
+	unsigned int shift = bucket / LATENCY_SUB - 1;
+	unsigned long long sub = bucket % LATENCY_SUB + LATENCY_SUB;
+	return ((sub + 1) << shift) - 1;
+}
+
+static inline void latency_bump(atomic_ullong *counter, unsigned long long by)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + by,
+		memory_order_relaxed);
+}
+
+void eth_latency_enable(int on)
+{
+	atomic_store(&latency_on, on != 0);
+}
+
+int eth_latency_enabled(void)
+{
+	return atomic_load_explicit(&latency_on, memory_order_relaxed);
+}
+
+const char *eth_latency_op_name(int op)
+{
+	return op >= 0 && op < ETH_LATENCY_OPS ? op_names[op] : NULL;
+}
+
+void eth_latency_record(int op, unsigned long long ns)
+{
+	if (op < 0 || op >= ETH_LATENCY_OPS || !eth_latency_enabled())
+	{
+		return;
+	}
+	struct latency_thread *t = latency_thread();
+	if (!t)
+	{
+		return;
+	}
+	struct latency_op *o = &t->ops[op];
+	latency_bump(&o->buckets[latency_bucket(ns)], 1);
+	latency_bump(&o->count, 1);
+	latency_bump(&o->sum_ns, ns);
+	if (ns > atomic_load_explicit(&o->max_ns, memory_order_relaxed))
+	{
+		atomic_store_explicit(&o->max_ns, ns, memory_order_relaxed);
+	}
+}
+
+unsigned long long eth_latency_start(void)
+{
+	struct timespec ts;
+	if (!eth_latency_enabled())
+	{
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+void eth_latency_end(int op, unsigned long long start)
+{
+	struct timespec ts;
+	if (!start)
+	{
+		return;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	unsigned long long now = (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+	eth_latency_record(op, now > start ? now - start : 0);
+}
+
+int eth_latency_merge(int op, struct eth_latency_histogram *histogram)
+{
+	if (op < 0 || op >= ETH_LATENCY_OPS || !histogram)
+	{
+		return -1;
+	}
+	memset(histogram, 0, sizeof(*histogram));
+	for (struct latency_thread *t = atomic_load_explicit(&latency_threads, memory_order_acquire); t; t = t->next)
+	{
+		struct latency_op *o = &t->ops[op];
+		for (unsigned int i = 0; i < ETH_LATENCY_BUCKETS; i++)
+		{
+			histogram->buckets[i] += atomic_load_explicit(&o->buckets[i], memory_order_relaxed);
+		}
+		histogram->count += atomic_load_explicit(&o->count, memory_order_relaxed);
+		histogram->sum_ns += atomic_load_explicit(&o->sum_ns, memory_order_relaxed);
+		unsigned long long max = atomic_load_explicit(&o->max_ns, memory_order_relaxed);
+		if (max > histogram->max_ns)
+		{
+			histogram->max_ns = max;
+		}
+	}
+	return 0;
+}
+
+unsigned long long eth_latency_quantile(const struct eth_latency_histogram *histogram, double q)
+{
+	unsigned long long total = 0;
+	for (unsigned int i = 0; i < ETH_LATENCY_BUCKETS; i++)
+	{
+		total += histogram->buckets[i];
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+	q = q < 0 ? 0 : q > 1 ? 1 : q;
+	unsigned long long rank = (unsigned long long)(q * (double)total + 0.5);
+	if (rank == 0)
+	{
+		rank = 1;
+	}
+
+	unsigned long long seen = 0;
+	for (unsigned int i = 0; i < ETH_LATENCY_BUCKETS; i++)
+	{
+		seen += histogram->buckets[i];
+		if (seen >= rank)
+		{
+			// The bucket's top, but never past the largest value seen
+			unsigned long long upper = eth_latency_bucket_upper(i);
+			return histogram->max_ns && upper > histogram->max_ns ? histogram->max_ns : upper;
+		}
+	}
+	return histogram->max_ns;
+}
+
+static int expose_line(eth_latency_write_fn emit, void *ctx, const char *format, ...)
+	__attribute__((format(printf, 3, 4)));
+
+static int expose_line(eth_latency_write_fn emit, void *ctx, const char *format, ...)
+{
+	char line[256];
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	if (n < 0 || (size_t)n >= sizeof(line))
+	{
+		return -1;
+	}
+	return emit(ctx, line, (size_t)n);
+}
+
+int eth_latency_expose(eth_latency_write_fn emit, void *ctx)
+{
+	static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+	struct eth_latency_histogram *h = malloc(ETH_LATENCY_OPS * sizeof(*h));
+	int ret = -1;
+
+	if (!emit || !h)
+	{
+		free(h);
+		return -1;
+	}
+	for (int op = 0; op < ETH_LATENCY_OPS; op++)
+	{
+		eth_latency_merge(op, &h[op]);
+	}
+
+	if (expose_line(emit, ctx, "# HELP walgen_latency_seconds Latency of wallet operations.\n") != 0 ||
+		expose_line(emit, ctx, "# TYPE walgen_latency_seconds histogram\n") != 0)
+	{
+		goto out;
+	}
+	for (int op = 0; op < ETH_LATENCY_OPS; op++)
+	{
+		// Fine buckets are summed up to each octave; a value of exactly
+		// 2^k ns is counted under the next `le`
+		unsigned long long below = 0;
+		unsigned int i = 0;
+		for (unsigned int k = EXPOSE_FIRST_OCTAVE; k <= EXPOSE_LAST_OCTAVE; k++)
+		{
+			for (; i < latency_bucket(1ULL << k); i++)
+			{
+				below += h[op].buckets[i];
+			}
+			if (expose_line(emit, ctx, "walgen_latency_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n", op_names[op],
+				(double)(1ULL << k) / 1e9, below) != 0)
+			{
+				goto out;
+			}
+		}
+		if (expose_line(emit, ctx, "walgen_latency_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", op_names[op],
+				h[op].count) != 0 ||
+			expose_line(emit, ctx, "walgen_latency_seconds_sum{op=\"%s\"} %.9g\n", op_names[op],
+				(double)h[op].sum_ns / 1e9) != 0 ||
+			expose_line(emit, ctx, "walgen_latency_seconds_count{op=\"%s\"} %llu\n", op_names[op], h[op].count) != 0)
+		{
+			goto out;
+		}
+	}
+
+	if (expose_line(emit, ctx,
+			"# HELP walgen_latency_quantile_seconds Latency quantiles from the full-resolution histogram.\n") != 0 ||
+		expose_line(emit, ctx, "# TYPE walgen_latency_quantile_seconds gauge\n") != 0)
+	{
+		goto out;
+	}
+	for (int op = 0; op < ETH_LATENCY_OPS; op++)
+	{
+		for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++)
+		{
+			if (expose_line(emit, ctx, "walgen_latency_quantile_seconds{op=\"%s\",quantile=\"%g\"} %.9g\n",
+				op_names[op], quantiles[q], (double)eth_latency_quantile(&h[op], quantiles[q]) / 1e9) != 0)
+			{
+				goto out;
+			}
+		}
+	}
+
+	if (expose_line(emit, ctx, "# HELP walgen_latency_max_seconds Slowest operation seen.\n") != 0 ||
+		expose_line(emit, ctx, "# TYPE walgen_latency_max_seconds gauge\n") != 0)
+	{
+		goto out;
+	}
+	for (int op = 0; op < ETH_LATENCY_OPS; op++)
+	{
+		if (expose_line(emit, ctx, "walgen_latency_max_seconds{op=\"%s\"} %.9g\n", op_names[op],
+			(double)h[op].max_ns / 1e9) != 0)
+		{
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	free(h);
+	return ret;
+}
+
+static int expose_stdio(void *ctx, const char *text, size_t len)
+{
+	return fwrite(text, 1, len, ctx) == len ? 0 : -1;
+}
+
+int eth_latency_expose_file(const char *path)
+{
+	if (!path)
+	{
+		return -1;
+	}
+	if (strcmp(path, "-") == 0)
+	{
+		return eth_latency_expose(expose_stdio, stdout) == 0 && fflush(stdout) == 0 ? 0 : -1;
+	}
+
+	// Renamed into place, so a scraper (e.g. the node_exporter textfile
+	// collector) never reads half a file
+	size_t plen = strlen(path);
+	char *tmp = malloc(plen + 5);
+	if (!tmp)
+	{
+		return -1;
+	}
+	memcpy(tmp, path, plen);
+	memcpy(tmp + plen, ".tmp", 5);
+	FILE *f = fopen(tmp, "w");
+	int ret = -1;
+	if (f)
+	{
+		int written = eth_latency_expose(expose_stdio, f) == 0;
+		ret = fclose(f) == 0 && written && rename(tmp, path) == 0 ? 0 : -1;
+		if (ret != 0)
+		{
+			unlink(tmp);
+		}
+	}
+	free(tmp);
+	return ret;
+}
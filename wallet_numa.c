@@ -0,0 +1,296 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Node numbers that fit the one-word mbind mask
+#define NUMA_MAX_NODES 64
+#define NUMA_MAX_CPUS 1024
+// Wallets a worker generates per eth_generator_fill call
+#define NUMA_BATCH 256
+
+struct numa_topology
+{
+	unsigned int nodes;
+	int id[NUMA_MAX_NODES]; // sysfs node number, -1 when sysfs has none
+	unsigned int ncpus[NUMA_MAX_NODES];
+	unsigned short *cpus[NUMA_MAX_NODES];
+};
+
+struct numa_worker
+{
+	pthread_t tid;
+	unsigned int node; // index into the topology
+	int node_id;       // its sysfs number, for mbind
+	int cpu;           // -1: not pinned
+	int placement;
+	size_t count;
+	unsigned char *slice; // count records, key || address
+	size_t slice_bytes;
+	struct eth_huge_buffer slice_mem;
+	int failed;
+};
+
+// "0-3,8-11" into cpu numbers; returns how many
+static unsigned int numa_parse_cpulist(const char *list, unsigned short *cpus, unsigned int max)
+{
+	unsigned int n = 0;
+	while (*list && n < max)
+	{
+		char *end;
+		unsigned long lo = strtoul(list, &end, 10), hi = lo;
+		if (end == list)
+		{
+			break;
+		}
+		if (*end == '-')
+		{
+			list = end + 1;
+			hi = strtoul(list, &end, 10);
+		}
+		for (unsigned long c = lo; c <= hi && n < max; c++)
+		{
+			cpus[n++] = (unsigned short)c;
+		}
+		list = *end == ',' ? end + 1 : end;
+		if (*list == '\n')
+		{
+			break;
+		}
+	}
+	return n;
+}
+
+// Nodes and their CPUs from sysfs; a machine without it is one node. Node
+// numbers can have gaps (offline or hot-pluggable nodes), so every number
+// the mbind mask can express is tried.
+static void numa_topology_read(struct numa_topology *topo)
+{
+	memset(topo, 0, sizeof(*topo));
+	for (unsigned int node = 0; node < NUMA_MAX_NODES; node++)
+	{
+		char path[64], list[4096];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+		FILE *f = fopen(path, "r");
+		if (!f)
+		{
+			continue;
+		}
+		unsigned short *cpus = malloc(NUMA_MAX_CPUS * sizeof(*cpus));
+		unsigned int n = 0;
+		if (cpus && fgets(list, sizeof(list), f))
+		{
+			n = numa_parse_cpulist(list, cpus, NUMA_MAX_CPUS);
+		}
+		fclose(f);
+		// Memory-only nodes have no CPUs to run workers on
+		if (n == 0)
+		{
+			free(cpus);
+			continue;
+		}
+		topo->id[topo->nodes] = (int)node;
+		topo->cpus[topo->nodes] = cpus;
+		topo->ncpus[topo->nodes] = n;
+		topo->nodes++;
+	}
+	if (topo->nodes == 0)
+	{
+		unsigned int n = eth_online_cpus();
+		topo->cpus[0] = malloc(n * sizeof(unsigned short));
+		for (unsigned int c = 0; topo->cpus[0] && c < n; c++)
+		{
+			topo->cpus[0][c] = (unsigned short)c;
+		}
+		topo->ncpus[0] = topo->cpus[0] ? n : 0;
+		topo->id[0] = -1;
+		topo->nodes = 1;
+	}
+}
+
+static void numa_topology_free(struct numa_topology *topo)
+{
+	for (unsigned int i = 0; i < topo->nodes; i++)
+	{
+		free(topo->cpus[i]);
+	}
+}
+
+unsigned int eth_numa_nodes(void)
+{
+	struct numa_topology topo;
+	numa_topology_read(&topo);
+	unsigned int nodes = topo.nodes;
+	numa_topology_free(&topo);
+	return nodes;
+}
+
+// Anonymous pages (huge if enabled) preferring `node`; pages are placed on
+// first touch, which the pinned worker does itself
+static unsigned char *numa_alloc(struct eth_huge_buffer *mem, size_t size, int node)
+{
+	if (eth_huge_alloc(mem, size) != 0)
+	{
+		return NULL;
+	}
+#if defined(__linux__) && defined(SYS_mbind)
+	if (node >= 0)
+	{
+		unsigned long mask = 1UL << node;
+		// Best effort: without the syscall, first touch from the pinned thread still lands locally
+		syscall(SYS_mbind, mem->data, mem->mapped, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+	}
+#else
+	(void)node;
+#endif
+	return mem->data;
+}
+
+static void *numa_worker_main(void *arg)
+{
+	struct numa_worker *w = arg;
+	unsigned char keys[NUMA_BATCH * ETH_PRIV_KEY_SIZE];
+	unsigned char addresses[NUMA_BATCH * ETH_ADDRESS_SIZE];
+
+	if (w->cpu >= 0)
+	{
+#ifdef __linux__
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	}
+	// Allocated after pinning, so the context (and its scratch space) and the
+	// output slice are local to the worker's node
+	if (w->placement == ETH_NUMA_LOCAL)
+	{
+		w->slice = numa_alloc(&w->slice_mem, w->slice_bytes, w->node_id);
+	}
+	struct eth_generator *gen = eth_generator_create();
+	if (!gen || !w->slice)
+	{
+		w->failed = 1;
+		eth_generator_destroy(gen);
+		return NULL;
+	}
+
+	for (size_t done = 0; done < w->count;)
+	{
+		size_t n = w->count - done < NUMA_BATCH ? w->count - done : NUMA_BATCH;
+		if (eth_generator_fill(gen, keys, addresses, n) != 0)
+		{
+			w->failed = 1;
+			break;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned char *rec = w->slice + (done + i) * ETH_WALLET_RECORD_SIZE;
+			memcpy(rec, keys + i * ETH_PRIV_KEY_SIZE, ETH_PRIV_KEY_SIZE);
+			memcpy(rec + ETH_PRIV_KEY_SIZE, addresses + i * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE);
+		}
+		done += n;
+	}
+	OPENSSL_cleanse(keys, sizeof(keys));
+	eth_generator_destroy(gen);
+	return NULL;
+}
+
+int generate_eth_wallets_numa(const struct eth_numa_config *config, unsigned char *priv_keys,
+	unsigned char *addresses)
+{
+	struct numa_topology topo;
+
+	if (!config || (config->placement != ETH_NUMA_LOCAL && config->placement != ETH_NUMA_NONE) ||
+		((!priv_keys || !addresses) && config->count))
+	{
+		return -1;
+	}
+	unsigned int threads = config->threads ? config->threads : eth_online_cpus();
+	if (threads > ETH_SEARCH_MAX_THREADS)
+	{
+		threads = ETH_SEARCH_MAX_THREADS;
+	}
+	struct numa_worker *workers = calloc(threads, sizeof(*workers));
+	if (!workers)
+	{
+		return -1;
+	}
+	numa_topology_read(&topo);
+
+	// Workers go round-robin over the nodes, then over each node's CPUs
+	unsigned int next_cpu[NUMA_MAX_NODES] = {0};
+	for (unsigned int t = 0; t < threads; t++)
+	{
+		struct numa_worker *w = &workers[t];
+		w->node = t % topo.nodes;
+		w->node_id = topo.id[w->node];
+		w->cpu = -1;
+		w->placement = config->placement;
+		if (config->placement == ETH_NUMA_LOCAL && topo.ncpus[w->node])
+		{
+			w->cpu = topo.cpus[w->node][next_cpu[w->node]++ % topo.ncpus[w->node]];
+		}
+		w->count = config->count / threads + (t < config->count % threads);
+		w->slice_bytes = (w->count ? w->count : 1) * ETH_WALLET_RECORD_SIZE;
+		// Baseline: every slice allocated (and first touched) by this thread
+		if (config->placement == ETH_NUMA_NONE)
+		{
+			w->slice = numa_alloc(&w->slice_mem, w->slice_bytes, -1);
+			if (w->slice)
+			{
+				memset(w->slice, 0, w->slice_bytes);
+			}
+		}
+	}
+
+	unsigned int started = 0;
+	for (; started < threads; started++)
+	{
+		if (pthread_create(&workers[started].tid, NULL, numa_worker_main, &workers[started]) != 0)
+		{
+			break;
+		}
+	}
+	int ret = started == threads ? 0 : -1;
+	for (unsigned int t = 0; t < started; t++)
+	{
+		pthread_join(workers[t].tid, NULL);
+		if (workers[t].failed)
+		{
+			ret = -1;
+		}
+	}
+
+	// Merge the per-node slices into the caller's arrays
+	size_t first = 0;
+	for (unsigned int t = 0; t < threads; t++)
+	{
+		struct numa_worker *w = &workers[t];
+		for (size_t i = 0; ret == 0 && i < w->count; i++)
+		{
+			const unsigned char *rec = w->slice + i * ETH_WALLET_RECORD_SIZE;
+			memcpy(priv_keys + (first + i) * ETH_PRIV_KEY_SIZE, rec, ETH_PRIV_KEY_SIZE);
+			memcpy(addresses + (first + i) * ETH_ADDRESS_SIZE, rec + ETH_PRIV_KEY_SIZE, ETH_ADDRESS_SIZE);
+		}
+		first += w->count;
+		if (w->slice)
+		{
+			OPENSSL_cleanse(w->slice, w->slice_bytes);
+			eth_huge_free(&w->slice_mem);
+		}
+	}
+	numa_topology_free(&topo);
+	free(workers);
+	return ret;
+}
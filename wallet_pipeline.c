@@ -0,0 +1,616 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+#include "wallet_ring.h"
+
+#define PIPE_DEFAULT_RING 4096
+#define PIPE_DEFAULT_BATCH 256
+#define PIPE_OUT_BUF (1 << 20)
+
+// One fixed-size record travels through every ring; each stage fills in
+// its part. Padded to two cache lines so neighbouring slots never share one.
+struct pipe_rec
+{
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	unsigned char pub_key[65];
+	unsigned char address[ETH_ADDRESS_SIZE];
+	unsigned char pad[128 - ETH_PRIV_KEY_SIZE - 65 - ETH_ADDRESS_SIZE];
+};
+
+// A lane is one chain of random -> EC -> Keccak stages; all lanes feed the
+// single output stage.
+struct pipe_lane
+{
+	struct eth_ring rand_ring; // random -> EC
+	struct eth_ring ec_ring;   // EC -> Keccak
+	struct eth_ring out_ring;  // Keccak -> output
+	size_t count;
+	size_t batch;
+	int pin;
+	unsigned int cpu[3];
+	atomic_int abort;
+	atomic_int failed; // set by any of the lane's threads
+};
+
+struct pipe_out
+{
+	struct pipe_lane *lanes;
+	unsigned int nlanes;
+	size_t batch;
+	int fd;
+	int format;
+	struct eth_shm_ring *shm;
+	struct eth_writer *writer;
+	int pin;
+	unsigned int cpu;
+	atomic_int failed;
+};
+
+// Block until at least one slot is free; returns 0 once the lane is aborted
+static size_t pipe_acquire_write(struct eth_ring *ring, size_t want, size_t *pos, atomic_int *abort)
+{
+	unsigned int spins = 0;
+	size_t n;
+	while ((n = eth_ring_writable(ring, want, pos)) == 0)
+	{
+		if (atomic_load_explicit(abort, memory_order_relaxed))
+		{
+			return 0;
+		}
+		eth_ring_wait(&spins);
+	}
+	return n;
+}
+
+static size_t pipe_acquire_read(struct eth_ring *ring, size_t want, size_t *pos)
+{
+	unsigned int spins = 0;
+	size_t n;
+	while ((n = eth_ring_readable(ring, want, pos)) == 0)
+	{
+		if (eth_ring_drained(ring))
+		{
+			return 0;
+		}
+		eth_ring_wait(&spins);
+	}
+	return n;
+}
+
+// Stage 1: random bytes for a whole batch in one syscall, then seckey verify
+static void *pipe_rand_stage(void *arg)
+{
+	struct pipe_lane *lane = arg;
+	if (lane->pin)
+	{
+		eth_pin_thread(lane->cpu[0]);
+	}
+
+	// Verification needs no precomputed tables
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+	unsigned char *buf = malloc(lane->batch * ETH_PRIV_KEY_SIZE);
+	if (!ctx || !buf)
+	{
+		atomic_store(&lane->failed, 1);
+		atomic_store(&lane->abort, 1);
+		goto out;
+	}
+
+	size_t left = lane->count;
+	while (left > 0)
+	{
+		size_t pos;
+		size_t n = pipe_acquire_write(&lane->rand_ring, left < lane->batch ? left : lane->batch, &pos, &lane->abort);
+		if (n == 0)
+		{
+			break;
+		}
+		if (eth_key_material(buf, n * ETH_PRIV_KEY_SIZE) != 0)
+		{
+			goto dry;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned char *key = buf + i * ETH_PRIV_KEY_SIZE;
+			while (!secp256k1_ec_seckey_verify(ctx, key))
+			{
+				if (eth_key_material(key, ETH_PRIV_KEY_SIZE) != 0)
+				{
+					goto dry;
+				}
+			}
+			struct pipe_rec *rec = eth_ring_slot(&lane->rand_ring, pos + i);
+			memcpy(rec->priv_key, key, ETH_PRIV_KEY_SIZE);
+		}
+		eth_ring_publish(&lane->rand_ring, n);
+		left -= n;
+	}
+	goto out;
+
+dry:
+	// The entropy source ran out: fail the run rather than write fewer keys
+	atomic_store(&lane->failed, 1);
+	atomic_store(&lane->abort, 1);
+
+out:
+	if (buf)
+	{
+		OPENSSL_cleanse(buf, lane->batch * ETH_PRIV_KEY_SIZE);
+		free(buf);
+	}
+	if (ctx)
+	{
+		secp256k1_context_destroy(ctx);
+	}
+	eth_ring_close(&lane->rand_ring);
+	return NULL;
+}
+
+// Stage 2: EC multiply and serialize
+static void *pipe_ec_stage(void *arg)
+{
+	struct pipe_lane *lane = arg;
+	if (lane->pin)
+	{
+		eth_pin_thread(lane->cpu[1]);
+	}
+
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!ctx)
+	{
+		atomic_store(&lane->failed, 1);
+		atomic_store(&lane->abort, 1);
+		eth_ring_close(&lane->ec_ring);
+		return NULL;
+	}
+
+	size_t in, n;
+	while ((n = pipe_acquire_read(&lane->rand_ring, lane->batch, &in)) > 0)
+	{
+		size_t out;
+		if ((n = pipe_acquire_write(&lane->ec_ring, n, &out, &lane->abort)) == 0)
+		{
+			break;
+		}
+		size_t i;
+		for (i = 0; i < n; i++)
+		{
+			struct pipe_rec *src = eth_ring_slot(&lane->rand_ring, in + i);
+			struct pipe_rec *dst = eth_ring_slot(&lane->ec_ring, out + i);
+			dst->pub_key[0] = 0x04;
+			if (eth_ec_pubkey64(ctx, src->priv_key, dst->pub_key + 1) != 0)
+			{
+				break;
+			}
+			memcpy(dst->priv_key, src->priv_key, ETH_PRIV_KEY_SIZE);
+			OPENSSL_cleanse(src->priv_key, ETH_PRIV_KEY_SIZE);
+		}
+		if (i < n)
+		{
+			// Publish nothing of a batch with a failed multiplication, so no
+			// key is ever written next to a wrong address; the rings are
+			// wiped on the way out
+			atomic_store(&lane->failed, 1);
+			atomic_store(&lane->abort, 1);
+			break;
+		}
+		eth_ring_release(&lane->rand_ring, n);
+		eth_ring_publish(&lane->ec_ring, n);
+	}
+
+	secp256k1_context_destroy(ctx);
+	eth_ring_close(&lane->ec_ring);
+	return NULL;
+}
+
+// Stage 3: Keccak-256 of the public key body
+static void *pipe_keccak_stage(void *arg)
+{
+	struct pipe_lane *lane = arg;
+	if (lane->pin)
+	{
+		eth_pin_thread(lane->cpu[2]);
+	}
+
+	size_t in, n;
+	while ((n = pipe_acquire_read(&lane->ec_ring, lane->batch, &in)) > 0)
+	{
+		size_t out;
+		if ((n = pipe_acquire_write(&lane->out_ring, n, &out, &lane->abort)) == 0)
+		{
+			break;
+		}
+		size_t i;
+		for (i = 0; i < n; i++)
+		{
+			struct pipe_rec *src = eth_ring_slot(&lane->ec_ring, in + i);
+			struct pipe_rec *dst = eth_ring_slot(&lane->out_ring, out + i);
+			// Hash only 64 bytes of the public key (skip the first byte 0x04)
+			if (eth_pubkey_to_address(src->pub_key + 1, dst->address) != 0)
+			{
+				break;
+			}
+			memcpy(dst->priv_key, src->priv_key, ETH_PRIV_KEY_SIZE);
+			OPENSSL_cleanse(src->priv_key, ETH_PRIV_KEY_SIZE);
+		}
+		if (i < n)
+		{
+			atomic_store(&lane->failed, 1);
+			atomic_store(&lane->abort, 1);
+			break;
+		}
+		eth_ring_release(&lane->ec_ring, n);
+		eth_ring_publish(&lane->out_ring, n);
+	}
+
+	eth_ring_close(&lane->out_ring);
+	return NULL;
+}
+
+static int pipe_write_all(int fd, const unsigned char *buf, size_t len)
+{
+	unsigned long long start = eth_latency_start();
+	while (len > 0)
+	{
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		buf += ret;
+		len -= (size_t)ret;
+	}
+	eth_latency_end(ETH_LATENCY_FLUSH, start);
+	return 0;
+}
+
+static size_t pipe_encode(unsigned char *dst, const struct pipe_rec *rec, int format)
+{
+	if (format == ETH_OUTPUT_RAW)
+	{
+		memcpy(dst, rec->priv_key, ETH_PRIV_KEY_SIZE);
+		memcpy(dst + ETH_PRIV_KEY_SIZE, rec->address, ETH_ADDRESS_SIZE);
+		return ETH_WALLET_RECORD_SIZE;
+	}
+
+	unsigned char *p = dst;
+	*p++ = '0';
+	*p++ = 'x';
+	eth_hex_encode(rec->priv_key, ETH_PRIV_KEY_SIZE, (char *)p);
+	p += 2 * ETH_PRIV_KEY_SIZE;
+	*p++ = ' ';
+	*p++ = '0';
+	*p++ = 'x';
+	if (format == ETH_OUTPUT_MULTICHAIN)
+	{
+		// Same address bytes, two more encodings; no second EC pass
+		eth_checksum_hex(rec->address, (char *)p);
+		p += 2 * ETH_ADDRESS_SIZE;
+		*p++ = ' ';
+		eth_tron_address(rec->address, 1, (char *)p);
+		p += ETH_TRON_ADDRESS_SIZE;
+	}
+	else
+	{
+		eth_hex_encode(rec->address, ETH_ADDRESS_SIZE, (char *)p);
+		p += 2 * ETH_ADDRESS_SIZE;
+	}
+	*p++ = '\n';
+	return (size_t)(p - dst);
+}
+
+// Stop every lane; the output stage keeps draining until all rings close
+static void pipe_abort(struct pipe_out *po)
+{
+	atomic_store(&po->failed, 1);
+	for (unsigned int l = 0; l < po->nlanes; l++)
+	{
+		atomic_store(&po->lanes[l].abort, 1);
+	}
+}
+
+// Raw records straight into the consumer's shared-memory slots
+static void pipe_shm_publish(struct pipe_out *po, struct eth_ring *ring, size_t pos, size_t n)
+{
+	size_t i = 0;
+	while (i < n && !atomic_load(&po->failed))
+	{
+		unsigned char *slots;
+		size_t m = eth_shm_ring_reserve(po->shm, n - i, &slots);
+		if (m == 0)
+		{
+			pipe_abort(po);
+			break;
+		}
+		for (size_t k = 0; k < m; k++)
+		{
+			pipe_encode(slots + k * ETH_WALLET_RECORD_SIZE, eth_ring_slot(ring, pos + i + k), ETH_OUTPUT_RAW);
+		}
+		eth_shm_ring_commit(po->shm, m);
+		i += m;
+	}
+}
+
+// Encodes straight into the writer's buffer; only a line that straddles two
+// buffers is staged and copied
+static void pipe_writer_put(struct pipe_out *po, const struct pipe_rec *rec)
+{
+	unsigned char *space;
+	size_t room = eth_writer_reserve(po->writer, &space);
+	int ret;
+	if (room >= ETH_MULTICHAIN_LINE_SIZE)
+	{
+		ret = eth_writer_commit(po->writer, pipe_encode(space, rec, po->format));
+	}
+	else
+	{
+		unsigned char line[ETH_MULTICHAIN_LINE_SIZE];
+		ret = eth_writer_write(po->writer, line, pipe_encode(line, rec, po->format));
+		OPENSSL_cleanse(line, sizeof(line));
+	}
+	if (ret != 0)
+	{
+		pipe_abort(po);
+	}
+}
+
+// Stage 4: encode and write, or publish to a shared-memory ring; round-robins
+// over the lanes so a slow writer or consumer only ever backs up the output
+// rings, never the EC stages directly
+static void *pipe_out_stage(void *arg)
+{
+	struct pipe_out *po = arg;
+	if (po->pin)
+	{
+		eth_pin_thread(po->cpu);
+	}
+
+	unsigned char *buf = malloc(PIPE_OUT_BUF);
+	size_t used = 0;
+	unsigned int live = po->nlanes;
+	char *done = calloc(po->nlanes, 1);
+	if (!buf || !done)
+	{
+		pipe_abort(po);
+	}
+
+	while (live > 0)
+	{
+		int progress = 0;
+		for (unsigned int l = 0; l < po->nlanes; l++)
+		{
+			struct eth_ring *ring = &po->lanes[l].out_ring;
+			if (done && done[l])
+			{
+				continue;
+			}
+
+			size_t pos;
+			size_t n = eth_ring_readable(ring, po->batch, &pos);
+			if (n == 0)
+			{
+				if (eth_ring_drained(ring))
+				{
+					if (done)
+					{
+						done[l] = 1;
+					}
+					live--;
+				}
+				continue;
+			}
+
+			if (po->shm)
+			{
+				pipe_shm_publish(po, ring, pos, n);
+			}
+			for (size_t i = 0; i < n; i++)
+			{
+				struct pipe_rec *rec = eth_ring_slot(ring, pos + i);
+				if (po->writer && !atomic_load(&po->failed))
+				{
+					pipe_writer_put(po, rec);
+				}
+				else if (buf && !po->shm && !po->writer)
+				{
+					if (PIPE_OUT_BUF - used < ETH_MULTICHAIN_LINE_SIZE)
+					{
+						if (!atomic_load(&po->failed) && pipe_write_all(po->fd, buf, used) != 0)
+						{
+							pipe_abort(po);
+						}
+						OPENSSL_cleanse(buf, used);
+						used = 0;
+					}
+					used += pipe_encode(buf + used, rec, po->format);
+				}
+				OPENSSL_cleanse(rec->priv_key, ETH_PRIV_KEY_SIZE);
+			}
+			eth_ring_release(ring, n);
+			progress = 1;
+		}
+		if (!progress)
+		{
+			unsigned int spins = 0;
+			eth_ring_wait(&spins);
+		}
+	}
+
+	if (buf)
+	{
+		if (used > 0 && !atomic_load(&po->failed) && pipe_write_all(po->fd, buf, used) != 0)
+		{
+			atomic_store(&po->failed, 1);
+		}
+		OPENSSL_cleanse(buf, PIPE_OUT_BUF);
+		free(buf);
+	}
+	free(done);
+	return NULL;
+}
+
+int generate_eth_wallets_pipeline(const struct eth_pipeline_config *config)
+{
+	if (!config || (config->format != ETH_OUTPUT_HEX && config->format != ETH_OUTPUT_RAW &&
+		config->format != ETH_OUTPUT_MULTICHAIN))
+	{
+		return -1;
+	}
+
+	// Each lane busy-waits on three threads, so one lane per three CPUs
+	unsigned int cpus = eth_online_cpus();
+	struct eth_tune_params tune = {.lanes = cpus / 3 ? cpus / 3 : 1, .ring_size = PIPE_DEFAULT_RING,
+		.batch = PIPE_DEFAULT_BATCH};
+	eth_tune_query(&tune);
+	unsigned int nlanes = config->lanes ? config->lanes : tune.lanes;
+	size_t ring_size = config->ring_size ? config->ring_size : tune.ring_size;
+	size_t batch = config->batch ? config->batch : tune.batch;
+	if (batch > ring_size)
+	{
+		batch = ring_size;
+	}
+
+	struct pipe_lane *lanes = calloc(nlanes, sizeof(*lanes));
+	pthread_t *threads = calloc((size_t)nlanes * 3, sizeof(*threads));
+	if (!lanes || !threads)
+	{
+		free(lanes);
+		free(threads);
+		return -1;
+	}
+
+	// With room for every thread, each gets its own core; otherwise the
+	// stages of a lane are a third of the CPUs apart
+	unsigned int ncpu = eth_online_cpus();
+	unsigned int stride = 3 * nlanes <= ncpu ? nlanes : (ncpu / 3 ? ncpu / 3 : 1);
+	int ret = 0;
+	unsigned int ready = 0;
+	for (; ready < nlanes; ready++)
+	{
+		struct pipe_lane *lane = &lanes[ready];
+		if (eth_ring_init(&lane->rand_ring, ring_size, sizeof(struct pipe_rec)) != 0)
+		{
+			break;
+		}
+		if (eth_ring_init(&lane->ec_ring, ring_size, sizeof(struct pipe_rec)) != 0)
+		{
+			eth_ring_destroy(&lane->rand_ring);
+			break;
+		}
+		if (eth_ring_init(&lane->out_ring, ring_size, sizeof(struct pipe_rec)) != 0)
+		{
+			eth_ring_destroy(&lane->rand_ring);
+			eth_ring_destroy(&lane->ec_ring);
+			break;
+		}
+		atomic_init(&lane->abort, 0);
+		atomic_init(&lane->failed, 0);
+		lane->count = config->count / nlanes + (ready < config->count % nlanes);
+		lane->batch = batch;
+		lane->pin = config->pin;
+		// EC dominates, so EC stages get the first cores; Keccak and random
+		// stages follow `stride` cores further on, so a lane's three stages
+		// never share a core even when there are as many lanes as CPUs
+		lane->cpu[1] = ready % ncpu;
+		lane->cpu[2] = (ready + stride) % ncpu;
+		lane->cpu[0] = (ready + 2 * stride) % ncpu;
+	}
+	if (ready < nlanes)
+	{
+		ret = -1;
+		goto out;
+	}
+
+	struct pipe_out po = {
+		.lanes = lanes,
+		.nlanes = nlanes,
+		.batch = batch,
+		.fd = config->fd,
+		.format = config->format,
+		.shm = config->shm,
+		.writer = config->writer,
+		.pin = config->pin,
+		.cpu = 3 * nlanes,
+	};
+
+	void *(*stages[3])(void *) = {pipe_rand_stage, pipe_ec_stage, pipe_keccak_stage};
+	size_t started = 0;
+	for (unsigned int l = 0; l < nlanes && ret == 0; l++)
+	{
+		for (int s = 0; s < 3; s++)
+		{
+			if (pthread_create(&threads[started], NULL, stages[s], &lanes[l]) != 0)
+			{
+				ret = -1;
+				break;
+			}
+			started++;
+		}
+	}
+
+	if (ret != 0)
+	{
+		// Abort everything and close the rings whose producer never started
+		// so the output stage can drain and return
+		pipe_abort(&po);
+		for (unsigned int l = 0; l < nlanes; l++)
+		{
+			size_t lane_started = started > (size_t)l * 3 ? started - (size_t)l * 3 : 0;
+			if (lane_started < 1)
+			{
+				eth_ring_close(&lanes[l].rand_ring);
+			}
+			if (lane_started < 2)
+			{
+				eth_ring_close(&lanes[l].ec_ring);
+			}
+			if (lane_started < 3)
+			{
+				eth_ring_close(&lanes[l].out_ring);
+			}
+		}
+	}
+
+	pipe_out_stage(&po);
+	for (size_t i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	if (atomic_load(&po.failed))
+	{
+		ret = -1;
+	}
+	for (unsigned int l = 0; l < nlanes; l++)
+	{
+		if (atomic_load(&lanes[l].failed))
+		{
+			ret = -1;
+		}
+	}
+
+out:
+	for (unsigned int l = 0; l < ready; l++)
+	{
+		OPENSSL_cleanse(lanes[l].rand_ring.recs, ring_size * sizeof(struct pipe_rec));
+		OPENSSL_cleanse(lanes[l].ec_ring.recs, ring_size * sizeof(struct pipe_rec));
+		OPENSSL_cleanse(lanes[l].out_ring.recs, ring_size * sizeof(struct pipe_rec));
+		eth_ring_destroy(&lanes[l].rand_ring);
+		eth_ring_destroy(&lanes[l].ec_ring);
+		eth_ring_destroy(&lanes[l].out_ring);
+	}
+	free(lanes);
+	free(threads);
+	return ret;
+}
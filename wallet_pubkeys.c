@@ -0,0 +1,217 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <secp256k1.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Keys parsed before their bodies are hashed in one pass
+#define PUBKEY_BLOCK 64
+
+struct pubkey_batch
+{
+	const unsigned char *pubkeys;
+	size_t key_size;
+	unsigned char *addresses;
+	unsigned char *status;
+	size_t failures[ETH_SEARCH_MAX_THREADS];
+};
+
+// Parsing only needs the static context: it validates the point and, for
+// compressed keys, recovers y with one field square root. Unlike inversion
+// there is no Montgomery-style trick to share that root across keys, so the
+// batching here is in the hashing, not the decompression.
+static int pubkey_body(const unsigned char *in, size_t key_size, unsigned char *pub64)
+{
+	secp256k1_pubkey pubkey;
+	unsigned char pub_key[65];
+	size_t pubkey_len = 65;
+
+	if (!secp256k1_ec_pubkey_parse(secp256k1_context_static, &pubkey, in, key_size))
+	{
+		return -1;
+	}
+	if (key_size == 65)
+	{
+		memcpy(pub64, in + 1, 64);
+		return 0;
+	}
+	secp256k1_ec_pubkey_serialize(secp256k1_context_static, pub_key, &pubkey_len, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+	memcpy(pub64, pub_key + 1, 64);
+	return 0;
+}
+
+static int pubkey_range(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct pubkey_batch *batch = arg;
+	unsigned char pubs[PUBKEY_BLOCK][64];
+	unsigned char ok[PUBKEY_BLOCK];
+	size_t failures = 0;
+
+	for (size_t base = first; base < first + count; base += PUBKEY_BLOCK)
+	{
+		size_t n = first + count - base < PUBKEY_BLOCK ? first + count - base : PUBKEY_BLOCK;
+
+		for (size_t i = 0; i < n; i++)
+		{
+			ok[i] = pubkey_body(batch->pubkeys + (base + i) * batch->key_size, batch->key_size, pubs[i]) == 0;
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			unsigned char *address = batch->addresses + (base + i) * ETH_ADDRESS_SIZE;
+			int valid = ok[i] && eth_pubkey_to_address(pubs[i], address) == 0;
+
+			if (!valid)
+			{
+				memset(address, 0, ETH_ADDRESS_SIZE);
+				failures++;
+			}
+			if (batch->status)
+			{
+				batch->status[base + i] = valid ? ETH_RECOVER_OK : ETH_RECOVER_INVALID;
+			}
+		}
+	}
+	batch->failures[thread] = failures;
+	return 0;
+}
+
+int eth_pubkeys_to_addresses(const unsigned char *pubkeys, size_t key_size, size_t count,
+	unsigned char *addresses, unsigned char *status, size_t *failures, unsigned int threads)
+{
+	if ((key_size != 33 && key_size != 65) || ((!pubkeys || !addresses) && count))
+	{
+		return -1;
+	}
+	if (threads == 0 || threads > ETH_SEARCH_MAX_THREADS)
+	{
+		threads = eth_online_cpus();
+	}
+	if (threads > ETH_SEARCH_MAX_THREADS)
+	{
+		threads = ETH_SEARCH_MAX_THREADS;
+	}
+
+	struct pubkey_batch *batch = calloc(1, sizeof(*batch));
+	if (!batch)
+	{
+		return -1;
+	}
+	batch->pubkeys = pubkeys;
+	batch->key_size = key_size;
+	batch->addresses = addresses;
+	batch->status = status;
+
+	int ret = eth_parallel_ranges(count, threads, pubkey_range, batch);
+	if (failures)
+	{
+		*failures = 0;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			*failures += batch->failures[t];
+		}
+	}
+	free(batch);
+	return ret;
+}
+
+// A file of fixed-size keys: 65-byte records start with 0x04, 33-byte ones
+// with 0x02/0x03. Sizes divisible by both are told apart by the first byte.
+static size_t pubkey_file_key_size(const unsigned char *data, size_t size)
+{
+	if (size % 65 == 0 && data[0] == 0x04)
+	{
+		return 65;
+	}
+	if (size % 33 == 0 && (data[0] == 0x02 || data[0] == 0x03))
+	{
+		return 33;
+	}
+	return 0;
+}
+
+int eth_pubkey_file_to_addresses(const char *in_path, const char *out_path, size_t *count,
+	size_t *failures, unsigned int threads)
+{
+	struct stat st;
+	unsigned char *in = MAP_FAILED;
+	unsigned char *out = MAP_FAILED;
+	size_t out_size = 0;
+	int ret = -1;
+
+	if (!in_path || !out_path)
+	{
+		return -1;
+	}
+	int in_fd = open(in_path, O_RDONLY);
+	if (in_fd < 0)
+	{
+		perror(in_path);
+		return -1;
+	}
+	int out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (out_fd < 0)
+	{
+		perror(out_path);
+		close(in_fd);
+		return -1;
+	}
+	if (fstat(in_fd, &st) != 0 || st.st_size == 0)
+	{
+		fprintf(stderr, "%s: empty or unreadable\n", in_path);
+		goto out;
+	}
+
+	in = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+	if (in == MAP_FAILED)
+	{
+		perror("mmap");
+		goto out;
+	}
+	madvise(in, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	size_t key_size = pubkey_file_key_size(in, (size_t)st.st_size);
+	if (key_size == 0)
+	{
+		fprintf(stderr, "%s: not a file of 33- or 65-byte public keys\n", in_path);
+		goto out;
+	}
+	size_t n = (size_t)st.st_size / key_size;
+
+	// Threads write straight into the mapped output file
+	out_size = n * ETH_ADDRESS_SIZE;
+	if (ftruncate(out_fd, (off_t)out_size) != 0)
+	{
+		perror(out_path);
+		goto out;
+	}
+	out = mmap(NULL, out_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+	if (out == MAP_FAILED)
+	{
+		perror("mmap");
+		goto out;
+	}
+
+	ret = eth_pubkeys_to_addresses(in, key_size, n, out, NULL, failures, threads);
+	if (count)
+	{
+		*count = n;
+	}
+
+out:
+	if (out != MAP_FAILED)
+	{
+		munmap(out, out_size);
+	}
+	if (in != MAP_FAILED)
+	{
+		munmap(in, (size_t)st.st_size);
+	}
+	close(out_fd);
+	close(in_fd);
+	return ret;
+}
@@ -0,0 +1,238 @@
+#include <stdlib.h>
+#include <string.h>
+#include <secp256k1.h>
+#include <secp256k1_recovery.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Signatures recovered before their public keys are hashed in one pass
+#define RECOVER_BLOCK 64
+
+struct recover_batch
+{
+	const unsigned char *hashes;
+	const unsigned char *sigs;
+	const unsigned long long *v; // full v per entry, sigs then r || s only
+	unsigned char *addresses;
+	const unsigned char *expected;
+	unsigned char *status;
+	size_t failures[ETH_SEARCH_MAX_THREADS];
+};
+
+// v as 0/1, 27/28 (personal_sign, EIP-712) or EIP-155 chainId * 2 + 35/36.
+// A one-byte v cannot hold EIP-155 values past chain id 110, so callers
+// with the byte from a 65-byte signature pass `eip155` = 0.
+static int recover_id(unsigned long long v, int eip155)
+{
+	if (v <= 1)
+	{
+		return (int)v;
+	}
+	if (v == 27 || v == 28)
+	{
+		return (int)(v - 27);
+	}
+	if (eip155 && v >= 35)
+	{
+		return (int)((v - 35) & 1);
+	}
+	return -1;
+}
+
+// `sig` is r || s; recid from recover_id
+static int recover_pubkey(const secp256k1_context *ctx, const unsigned char *hash, const unsigned char *sig,
+	int recid, unsigned char *pub64)
+{
+	secp256k1_ecdsa_recoverable_signature rsig;
+	secp256k1_pubkey pubkey;
+	unsigned char pub_key[65];
+	size_t pubkey_len = 65;
+
+	if (recid < 0 ||
+		!secp256k1_ecdsa_recoverable_signature_parse_compact(ctx, &rsig, sig, recid) ||
+		!secp256k1_ecdsa_recover(ctx, &pubkey, &rsig, hash))
+	{
+		return -1;
+	}
+	secp256k1_ec_pubkey_serialize(ctx, pub_key, &pubkey_len, &pubkey, SECP256K1_EC_UNCOMPRESSED);
+	memcpy(pub64, pub_key + 1, 64);
+	return 0;
+}
+
+static int recover_range(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct recover_batch *batch = arg;
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+	unsigned char pubs[RECOVER_BLOCK][64];
+	unsigned char hashes[RECOVER_BLOCK * 32];
+	unsigned char ok[RECOVER_BLOCK];
+	size_t len[ETH_KECCAK_LANES];
+	size_t failures = 0;
+
+	if (!ctx)
+	{
+		return -1;
+	}
+
+	for (size_t base = first; base < first + count; base += RECOVER_BLOCK)
+	{
+		size_t n = first + count - base < RECOVER_BLOCK ? first + count - base : RECOVER_BLOCK;
+
+		// EC recovery for the whole block first, then Keccak over the
+		// contiguous public keys ETH_KECCAK_LANES at a time, so each phase
+		// keeps its code and tables hot
+		for (size_t i = 0; i < n; i++)
+		{
+			const unsigned char *hash = batch->hashes + (base + i) * 32;
+			if (batch->v)
+			{
+				const unsigned char *sig = batch->sigs + (base + i) * 64;
+				ok[i] = recover_pubkey(ctx, hash, sig, recover_id(batch->v[base + i], 1), pubs[i]) == 0;
+			}
+			else
+			{
+				const unsigned char *sig = batch->sigs + (base + i) * ETH_SIGNATURE_SIZE;
+				ok[i] = recover_pubkey(ctx, hash, sig, recover_id(sig[64], 0), pubs[i]) == 0;
+			}
+			if (!ok[i])
+			{
+				memset(pubs[i], 0, 64);
+			}
+		}
+		for (size_t i = 0; i < n; i += ETH_KECCAK_LANES)
+		{
+			for (size_t l = 0; l < ETH_KECCAK_LANES; l++)
+			{
+				len[l] = i + l < n ? 64 : 0;
+			}
+			eth_keccak256_lanes(pubs[i], 64, len, hashes + i * 32);
+		}
+		for (size_t i = 0; i < n; i++)
+		{
+			size_t idx = base + i;
+			unsigned char address[ETH_ADDRESS_SIZE];
+			unsigned char st = ETH_RECOVER_INVALID;
+
+			if (ok[i])
+			{
+				memcpy(address, hashes + i * 32 + 12, ETH_ADDRESS_SIZE);
+				st = ETH_RECOVER_OK;
+				if (batch->expected && memcmp(address, batch->expected + idx * ETH_ADDRESS_SIZE, ETH_ADDRESS_SIZE) != 0)
+				{
+					st = ETH_RECOVER_MISMATCH;
+				}
+			}
+			else
+			{
+				memset(address, 0, sizeof(address));
+			}
+
+			if (batch->addresses)
+			{
+				memcpy(batch->addresses + idx * ETH_ADDRESS_SIZE, address, ETH_ADDRESS_SIZE);
+			}
+			if (batch->status)
+			{
+				batch->status[idx] = st;
+			}
+			failures += st != ETH_RECOVER_OK;
+		}
+	}
+
+	batch->failures[thread] = failures;
+	secp256k1_context_destroy(ctx);
+	return 0;
+}
+
+static int ecrecover_one(const unsigned char *hash, const unsigned char *sig, int recid, unsigned char *address)
+{
+	secp256k1_context *ctx;
+	unsigned char pub64[64];
+
+	if (!hash || !sig || !address)
+	{
+		return -1;
+	}
+	ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+	if (!ctx)
+	{
+		return -1;
+	}
+	int ret = recover_pubkey(ctx, hash, sig, recid, pub64);
+	secp256k1_context_destroy(ctx);
+	if (ret != 0)
+	{
+		return -1;
+	}
+	return eth_pubkey_to_address(pub64, address);
+}
+
+int eth_ecrecover(const unsigned char *hash, const unsigned char *sig, unsigned char *address)
+{
+	return ecrecover_one(hash, sig, sig ? recover_id(sig[64], 0) : -1, address);
+}
+
+int eth_ecrecover_v(const unsigned char *hash, const unsigned char *sig, unsigned long long v, unsigned char *address)
+{
+	return ecrecover_one(hash, sig, recover_id(v, 1), address);
+}
+
+static int ecrecover_batch(const unsigned char *hashes, const unsigned char *sigs, const unsigned long long *v,
+	size_t count, unsigned char *addresses, const unsigned char *expected, unsigned char *status,
+	size_t *failures, unsigned int threads)
+{
+	if ((!hashes || !sigs) && count)
+	{
+		return -1;
+	}
+	if (threads == 0 || threads > ETH_SEARCH_MAX_THREADS)
+	{
+		threads = eth_online_cpus();
+	}
+	if (threads > ETH_SEARCH_MAX_THREADS)
+	{
+		threads = ETH_SEARCH_MAX_THREADS;
+	}
+
+	struct recover_batch *batch = calloc(1, sizeof(*batch));
+	if (!batch)
+	{
+		return -1;
+	}
+	batch->hashes = hashes;
+	batch->sigs = sigs;
+	batch->v = v;
+	batch->addresses = addresses;
+	batch->expected = expected;
+	batch->status = status;
+
+	int ret = eth_parallel_ranges(count, threads, recover_range, batch);
+	if (failures)
+	{
+		*failures = 0;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			*failures += batch->failures[t];
+		}
+	}
+	free(batch);
+	return ret;
+}
+
+int eth_ecrecover_batch(const unsigned char *hashes, const unsigned char *sigs, size_t count,
+	unsigned char *addresses, const unsigned char *expected, unsigned char *status,
+	size_t *failures, unsigned int threads)
+{
+	return ecrecover_batch(hashes, sigs, NULL, count, addresses, expected, status, failures, threads);
+}
+
+int eth_ecrecover_batch_v(const unsigned char *hashes, const unsigned char *sigs, const unsigned long long *v,
+	size_t count, unsigned char *addresses, const unsigned char *expected, unsigned char *status,
+	size_t *failures, unsigned int threads)
+{
+	if (!v && count)
+	{
+		return -1;
+	}
+	return ecrecover_batch(hashes, sigs, v, count, addresses, expected, status, failures, threads);
+}
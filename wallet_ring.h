@@ -0,0 +1,132 @@
+#ifndef WALLET_RING_H
+#define WALLET_RING_H
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "wallet_gen.h"
+
+#define ETH_CACHELINE 64
+
+// Lock-free single-producer/single-consumer ring of fixed-size records.
+// The producer owns `head`, the consumer owns `tail`; each side keeps a
+// private copy of the other index so it only touches the shared cache
+// line when it runs out of slots.
+struct eth_ring
+{
+	_Alignas(ETH_CACHELINE) atomic_size_t head;
+	size_t tail_cache;
+	_Alignas(ETH_CACHELINE) atomic_size_t tail;
+	size_t head_cache;
+	_Alignas(ETH_CACHELINE) atomic_int closed;
+	size_t mask;
+	size_t rec_size;
+	unsigned char *recs;
+	struct eth_huge_buffer mem; // backs recs
+};
+
+// `capacity` must be a power of two
+static inline int eth_ring_init(struct eth_ring *ring, size_t capacity, size_t rec_size)
+{
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+	{
+		return -1;
+	}
+	memset(ring, 0, sizeof(*ring));
+	// Page-aligned, and on huge pages if the process asked for them
+	if (eth_huge_alloc(&ring->mem, capacity * rec_size) != 0)
+	{
+		return -1;
+	}
+	ring->recs = ring->mem.data;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, 0);
+	ring->mask = capacity - 1;
+	ring->rec_size = rec_size;
+	return 0;
+}
+
+static inline void eth_ring_destroy(struct eth_ring *ring)
+{
+	eth_huge_free(&ring->mem);
+	ring->recs = NULL;
+}
+
+static inline void *eth_ring_slot(struct eth_ring *ring, size_t pos)
+{
+	return ring->recs + (pos & ring->mask) * ring->rec_size;
+}
+
+// Producer: number of free slots starting at *pos, at most `want`
+static inline size_t eth_ring_writable(struct eth_ring *ring, size_t want, size_t *pos)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t cap = ring->mask + 1;
+	if (head - ring->tail_cache + want > cap)
+	{
+		ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	}
+	size_t n = cap - (head - ring->tail_cache);
+	*pos = head;
+	return n < want ? n : want;
+}
+
+static inline void eth_ring_publish(struct eth_ring *ring, size_t n)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	atomic_store_explicit(&ring->head, head + n, memory_order_release);
+}
+
+// Producer: no more records will follow
+static inline void eth_ring_close(struct eth_ring *ring)
+{
+	atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}
+
+// Consumer: number of ready records starting at *pos, at most `want`
+static inline size_t eth_ring_readable(struct eth_ring *ring, size_t want, size_t *pos)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	if (ring->head_cache - tail < want)
+	{
+		ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+	}
+	size_t n = ring->head_cache - tail;
+	*pos = tail;
+	return n < want ? n : want;
+}
+
+static inline void eth_ring_release(struct eth_ring *ring, size_t n)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+}
+
+// Consumer: true once the producer closed the ring and everything was consumed
+static inline int eth_ring_drained(struct eth_ring *ring)
+{
+	if (!atomic_load_explicit(&ring->closed, memory_order_acquire))
+	{
+		return 0;
+	}
+	size_t pos;
+	return eth_ring_readable(ring, 1, &pos) == 0;
+}
+
+// Back off while the other side catches up
+static inline void eth_ring_wait(unsigned int *spins)
+{
+	if (++*spins < 64)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+		return;
+	}
+	*spins = 0;
+	sched_yield();
+}
+
+#endif // WALLET_RING_H
@@ -0,0 +1,750 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Steps between publishing progress and checking the stop flag
+#define SEARCH_CHUNK 1024
+// Points stepped together per thread; divides SEARCH_CHUNK
+#define SEARCH_WALK 256
+#define SEARCH_DEFAULT_CHECKPOINT_INTERVAL 60
+#define CHECKPOINT_MAGIC "walgen-search-checkpoint 2"
+// Written before case constraints existed; read as case-insensitive
+#define CHECKPOINT_MAGIC_V1 "walgen-search-checkpoint 1"
+
+struct search_thread
+{
+	struct eth_search *search;
+	pthread_t tid;
+	unsigned int index;
+	unsigned char start_key[ETH_PRIV_KEY_SIZE];
+	_Alignas(64) atomic_ullong steps;
+};
+
+struct eth_search
+{
+	struct eth_search_config config;
+	struct search_thread *threads;
+	unsigned int nthreads;
+	unsigned int started;
+	atomic_uint running; // search threads that have not exited
+	int total_nibbles;
+	int total_cases;
+	atomic_int stop;
+	double started_at;
+	double elapsed_before; // time spent before a resume
+	pthread_mutex_t lock;
+	int found;
+	struct eth_search_result result;
+	int best_score;
+	struct eth_search_result best;
+	// Background checkpointing
+	pthread_t checkpointer;
+	int checkpointing;
+	pthread_cond_t wake;
+};
+
+static double search_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int pattern_set(struct eth_search_pattern *pattern, const char *hex, size_t first, int checksum)
+{
+	for (size_t i = 0; hex[i]; i++)
+	{
+		size_t nibble = first + i;
+		int v = eth_hex_value(hex[i]);
+		if (v < 0)
+		{
+			return -1;
+		}
+		unsigned char shift = (nibble & 1) ? 0 : 4;
+		pattern->value[nibble / 2] |= (unsigned char)(v << shift);
+		pattern->mask[nibble / 2] |= (unsigned char)(0xf << shift);
+		// Digits have no case; a letter's case is bit 3 of its checksum nibble
+		if (checksum && v >= 10)
+		{
+			pattern->case_mask[nibble / 2] |= (unsigned char)(0x8 << shift);
+			if (hex[i] <= 'F')
+			{
+				pattern->case_value[nibble / 2] |= (unsigned char)(0x8 << shift);
+			}
+		}
+	}
+	return 0;
+}
+
+static const char *skip_0x(const char *hex)
+{
+	if (hex && hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+	{
+		return hex + 2;
+	}
+	return hex;
+}
+
+static int pattern_compile(struct eth_search_pattern *pattern, const char *prefix, const char *suffix, int checksum)
+{
+	if (!pattern)
+	{
+		return -1;
+	}
+	memset(pattern, 0, sizeof(*pattern));
+
+	prefix = skip_0x(prefix);
+	size_t plen = prefix ? strlen(prefix) : 0;
+	size_t slen = suffix ? strlen(suffix) : 0;
+	if (plen + slen > 2 * ETH_ADDRESS_SIZE)
+	{
+		return -1;
+	}
+	if (prefix && pattern_set(pattern, prefix, 0, checksum) != 0)
+	{
+		return -1;
+	}
+	if (suffix && pattern_set(pattern, suffix, 2 * ETH_ADDRESS_SIZE - slen, checksum) != 0)
+	{
+		return -1;
+	}
+	return 0;
+}
+
+int eth_search_pattern_compile(struct eth_search_pattern *pattern, const char *prefix, const char *suffix)
+{
+	return pattern_compile(pattern, prefix, suffix, 0);
+}
+
+int eth_search_pattern_compile_eip55(struct eth_search_pattern *pattern, const char *prefix, const char *suffix)
+{
+	return pattern_compile(pattern, prefix, suffix, 1);
+}
+
+// Nibbles of `bytes` that differ from `value` under `mask`
+static int nibble_misses(const unsigned char *bytes, const unsigned char *value, const unsigned char *mask)
+{
+	int misses = 0;
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		unsigned char diff = (bytes[i] ^ value[i]) & mask[i];
+		misses += (diff >> 4) != 0;
+		misses += (diff & 0xf) != 0;
+	}
+	return misses;
+}
+
+// Letters whose EIP-55 case is wrong. Costs a second Keccak-256, over the
+// 40 hex characters, so it only runs once the nibbles already match.
+static int case_misses(const struct eth_search_pattern *pattern, const unsigned char *address)
+{
+	char hex[2 * ETH_ADDRESS_SIZE];
+	unsigned char hash[32];
+
+	eth_hex_encode(address, ETH_ADDRESS_SIZE, hex);
+	eth_keccak256_short(hex, sizeof(hex), hash);
+	return nibble_misses(hash, pattern->case_value, pattern->case_mask);
+}
+
+static int count_nibbles(const unsigned char *mask)
+{
+	int count = 0;
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		count += ((mask[i] >> 4) != 0) + ((mask[i] & 0xf) != 0);
+	}
+	return count;
+}
+
+int eth_search_pattern_match(const struct eth_search_pattern *pattern, const unsigned char *address)
+{
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		if ((address[i] & pattern->mask[i]) != pattern->value[i])
+		{
+			return 0;
+		}
+	}
+	return count_nibbles(pattern->case_mask) == 0 || case_misses(pattern, address) == 0;
+}
+
+// Number of pattern nibbles `address` gets right, plus, once all of them do,
+// the letters in the right case; a full match scores total_nibbles +
+// total_cases. The first part is as cheap as a plain compare, so it doubles
+// as the filter that keeps the checksum hash off the hot path.
+static int search_score(const struct eth_search *s, const unsigned char *address)
+{
+	const struct eth_search_pattern *pattern = &s->config.pattern;
+	int score = s->total_nibbles - nibble_misses(address, pattern->value, pattern->mask);
+	if (score == s->total_nibbles && s->total_cases)
+	{
+		score += s->total_cases - case_misses(pattern, address);
+	}
+	return score;
+}
+
+double eth_search_pattern_difficulty(const struct eth_search_pattern *pattern)
+{
+	double difficulty = 1.0;
+	for (int i = 0; i < ETH_ADDRESS_SIZE; i++)
+	{
+		difficulty *= (pattern->mask[i] >> 4) == 0xf ? 16.0 : 1.0;
+		difficulty *= (pattern->mask[i] & 0xf) == 0xf ? 16.0 : 1.0;
+		// The checksum hash is independent of the address bits, so each
+		// case-constrained letter is a fair coin flip on top
+		difficulty *= (pattern->case_mask[i] >> 4) ? 2.0 : 1.0;
+		difficulty *= (pattern->case_mask[i] & 0xf) ? 2.0 : 1.0;
+	}
+	return difficulty;
+}
+
+// Offset of thread `index` of `shard` after `steps` steps, as a 256-bit
+// big-endian scalar. Shards are 2^64 keys apart, threads 2^48 apart.
+static void search_offset(unsigned char *tweak, unsigned long long shard, unsigned int index, unsigned long long steps)
+{
+	unsigned long long low = ((unsigned long long)index << 48) + steps;
+	memset(tweak, 0, 32);
+	for (int i = 0; i < 8; i++)
+	{
+		tweak[23 - i] = (unsigned char)(shard >> (8 * i));
+		tweak[31 - i] = (unsigned char)(low >> (8 * i));
+	}
+}
+
+// start_key + steps, or 0 if that wraps to an invalid key
+static int search_key_at(const struct search_thread *t, unsigned long long steps, unsigned char *key)
+{
+	unsigned char tweak[32];
+	memcpy(key, t->start_key, ETH_PRIV_KEY_SIZE);
+	search_offset(tweak, 0, 0, steps);
+	return steps == 0 || secp256k1_ec_seckey_tweak_add(secp256k1_context_static, key, tweak);
+}
+
+// Called only when a thread beats the best score it last saw, which
+// happens a handful of times per search. The key is derived again from
+// scratch, so a fault in the walk can never report a key that does not
+// own the address.
+static int search_record(struct search_thread *t, const secp256k1_context *ctx, unsigned long long steps,
+	const unsigned char *address, int score)
+{
+	struct eth_search *s = t->search;
+	unsigned char key[ETH_PRIV_KEY_SIZE];
+	unsigned char derived[ETH_ADDRESS_SIZE];
+	int hit = score == s->total_nibbles + s->total_cases;
+	int found;
+
+	pthread_mutex_lock(&s->lock);
+	if ((score > s->best_score || (hit && !s->found)) && search_key_at(t, steps, key) &&
+		eth_seckey_to_address(ctx, key, derived) == 0 && memcmp(derived, address, ETH_ADDRESS_SIZE) == 0)
+	{
+		s->best_score = score;
+		memcpy(s->best.priv_key, key, ETH_PRIV_KEY_SIZE);
+		memcpy(s->best.address, address, ETH_ADDRESS_SIZE);
+		if (hit)
+		{
+			s->found = 1;
+			s->result = s->best;
+		}
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	score = s->best_score;
+	found = s->found;
+	pthread_mutex_unlock(&s->lock);
+
+	if (found)
+	{
+		atomic_store(&s->stop, 1);
+	}
+	return score;
+}
+
+// Walk SEARCH_WALK points P + jG side by side from the thread's start key,
+// adding the same Q = SEARCH_WALK * G to each per step, so one batched point
+// addition (one shared inversion) covers SEARCH_WALK candidates
+static void *search_thread_main(void *arg)
+{
+	struct search_thread *t = arg;
+	struct eth_search *s = t->search;
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	struct eth_ec_walk walk = {0};
+	unsigned char step[32] = {0};
+	unsigned char step64[64];
+	unsigned long long steps = atomic_load(&t->steps);
+
+	if (!ctx)
+	{
+		goto out;
+	}
+
+	// A resumed thread continues where its checkpointed position left off
+	step[31] = SEARCH_WALK & 0xff;
+	step[30] = SEARCH_WALK >> 8;
+	if (eth_ec_pubkey64(ctx, step, step64) != 0 || eth_ec_walk_init(&walk, SEARCH_WALK, step64) != 0 ||
+		eth_ec_walk_reset(&walk, ctx, t->start_key, steps) != 0)
+	{
+		goto out;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	int best = s->best_score;
+	pthread_mutex_unlock(&s->lock);
+
+	while (!atomic_load_explicit(&s->stop, memory_order_relaxed))
+	{
+		for (int i = 0; i < SEARCH_CHUNK; i += SEARCH_WALK)
+		{
+			for (size_t j = 0; j < SEARCH_WALK; j++)
+			{
+				unsigned char pub64[64];
+				unsigned char address[ETH_ADDRESS_SIZE];
+
+				eth_ec_walk_get(&walk, j, pub64);
+				eth_pubkey_to_address(pub64, address);
+				int score = search_score(s, address);
+				if (score > best)
+				{
+					best = search_record(t, ctx, steps + j, address, score);
+				}
+			}
+
+			steps += SEARCH_WALK;
+			// A point meeting Q has no affine sum; restart the walk from keys
+			if (eth_ec_walk_step(&walk) != 0 && eth_ec_walk_reset(&walk, ctx, t->start_key, steps) != 0)
+			{
+				goto out;
+			}
+		}
+		// Relaxed store: the only cost checkpointing adds to the hot loop
+		atomic_store_explicit(&t->steps, steps, memory_order_relaxed);
+	}
+
+out:
+	eth_ec_walk_free(&walk);
+	if (ctx)
+	{
+		secp256k1_context_destroy(ctx);
+	}
+	atomic_fetch_sub(&s->running, 1);
+	return NULL;
+}
+
+int eth_search_snapshot(struct eth_search *search, struct eth_search_checkpoint *checkpoint)
+{
+	memset(checkpoint, 0, sizeof(*checkpoint));
+	checkpoint->pattern = search->config.pattern;
+	checkpoint->threads = search->nthreads;
+	memcpy(checkpoint->base_key, search->config.base_key, ETH_PRIV_KEY_SIZE);
+	checkpoint->shard = search->config.shard;
+	checkpoint->elapsed = search->elapsed_before + (search_now() - search->started_at);
+	for (unsigned int i = 0; i < search->nthreads; i++)
+	{
+		checkpoint->steps[i] = atomic_load_explicit(&search->threads[i].steps, memory_order_relaxed);
+	}
+
+	pthread_mutex_lock(&search->lock);
+	checkpoint->best_score = search->best_score;
+	checkpoint->best = search->best;
+	checkpoint->found = search->found;
+	pthread_mutex_unlock(&search->lock);
+	return 0;
+}
+
+static void write_hex(FILE *f, const char *name, const unsigned char *buf, size_t len)
+{
+	fprintf(f, "%s ", name);
+	for (size_t i = 0; i < len; i++)
+	{
+		fprintf(f, "%02x", buf[i]);
+	}
+	fprintf(f, "\n");
+}
+
+static int read_hex(FILE *f, const char *name, unsigned char *buf, size_t len)
+{
+	char field[32];
+	char hex[2 * 64 + 1];
+	if (fscanf(f, "%31s %128s", field, hex) != 2 || strcmp(field, name) != 0 || strlen(hex) != 2 * len)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < len; i++)
+	{
+		int hi = eth_hex_value(hex[2 * i]);
+		int lo = eth_hex_value(hex[2 * i + 1]);
+		if (hi < 0 || lo < 0)
+		{
+			return -1;
+		}
+		buf[i] = (unsigned char)(hi << 4 | lo);
+	}
+	OPENSSL_cleanse(hex, sizeof(hex));
+	return 0;
+}
+
+static int search_sync_dir(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+	if (!dir)
+	{
+		return -1;
+	}
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0)
+	{
+		return -1;
+	}
+	int ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+// Written to a temporary file, synced and renamed over `path`, so a crash
+// leaves either the old or the new checkpoint, never a torn one. The file
+// holds the search origin key and is created owner-only.
+int eth_search_checkpoint_save(const char *path, const struct eth_search_checkpoint *checkpoint)
+{
+	if (!path || !checkpoint || checkpoint->threads == 0 || checkpoint->threads > ETH_SEARCH_MAX_THREADS)
+	{
+		return -1;
+	}
+
+	size_t plen = strlen(path);
+	char *tmp = malloc(plen + 5);
+	if (!tmp)
+	{
+		return -1;
+	}
+	memcpy(tmp, path, plen);
+	memcpy(tmp + plen, ".tmp", 5);
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	FILE *f = fd >= 0 ? fdopen(fd, "w") : NULL;
+	if (!f)
+	{
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		free(tmp);
+		return -1;
+	}
+
+	fprintf(f, "%s\n", CHECKPOINT_MAGIC);
+	write_hex(f, "pattern_value", checkpoint->pattern.value, ETH_ADDRESS_SIZE);
+	write_hex(f, "pattern_mask", checkpoint->pattern.mask, ETH_ADDRESS_SIZE);
+	write_hex(f, "pattern_case_value", checkpoint->pattern.case_value, ETH_ADDRESS_SIZE);
+	write_hex(f, "pattern_case_mask", checkpoint->pattern.case_mask, ETH_ADDRESS_SIZE);
+	write_hex(f, "base_key", checkpoint->base_key, ETH_PRIV_KEY_SIZE);
+	fprintf(f, "shard %llu\n", checkpoint->shard);
+	fprintf(f, "elapsed %.3f\n", checkpoint->elapsed);
+	fprintf(f, "found %d\n", checkpoint->found);
+	fprintf(f, "best_score %d\n", checkpoint->best_score);
+	write_hex(f, "best_key", checkpoint->best.priv_key, ETH_PRIV_KEY_SIZE);
+	write_hex(f, "best_address", checkpoint->best.address, ETH_ADDRESS_SIZE);
+	fprintf(f, "threads %u\n", checkpoint->threads);
+	for (unsigned int i = 0; i < checkpoint->threads; i++)
+	{
+		fprintf(f, "steps %llu\n", checkpoint->steps[i]);
+	}
+
+	int ret = fflush(f) == 0 && fsync(fd) == 0 ? 0 : -1;
+	if (fclose(f) != 0)
+	{
+		ret = -1;
+	}
+	if (ret == 0 && rename(tmp, path) != 0)
+	{
+		ret = -1;
+	}
+	// The rename itself is durable only once the directory is synced
+	if (ret == 0 && search_sync_dir(path) != 0)
+	{
+		ret = -1;
+	}
+	if (ret != 0)
+	{
+		unlink(tmp);
+	}
+	free(tmp);
+	return ret;
+}
+
+int eth_search_checkpoint_load(const char *path, struct eth_search_checkpoint *checkpoint)
+{
+	char magic[64];
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		return -1;
+	}
+	memset(checkpoint, 0, sizeof(*checkpoint));
+
+	int ret = -1;
+	if (!fgets(magic, sizeof(magic), f))
+	{
+		goto out;
+	}
+	int v1 = strncmp(magic, CHECKPOINT_MAGIC_V1 "\n", sizeof(magic)) == 0;
+	if (!v1 && strncmp(magic, CHECKPOINT_MAGIC "\n", sizeof(magic)) != 0)
+	{
+		goto out;
+	}
+	if (read_hex(f, "pattern_value", checkpoint->pattern.value, ETH_ADDRESS_SIZE) != 0 ||
+		read_hex(f, "pattern_mask", checkpoint->pattern.mask, ETH_ADDRESS_SIZE) != 0 ||
+		(!v1 && read_hex(f, "pattern_case_value", checkpoint->pattern.case_value, ETH_ADDRESS_SIZE) != 0) ||
+		(!v1 && read_hex(f, "pattern_case_mask", checkpoint->pattern.case_mask, ETH_ADDRESS_SIZE) != 0) ||
+		read_hex(f, "base_key", checkpoint->base_key, ETH_PRIV_KEY_SIZE) != 0 ||
+		fscanf(f, " shard %llu", &checkpoint->shard) != 1 ||
+		fscanf(f, " elapsed %lf", &checkpoint->elapsed) != 1 ||
+		fscanf(f, " found %d", &checkpoint->found) != 1 ||
+		fscanf(f, " best_score %d", &checkpoint->best_score) != 1 ||
+		read_hex(f, "best_key", checkpoint->best.priv_key, ETH_PRIV_KEY_SIZE) != 0 ||
+		read_hex(f, "best_address", checkpoint->best.address, ETH_ADDRESS_SIZE) != 0 ||
+		fscanf(f, " threads %u", &checkpoint->threads) != 1 ||
+		checkpoint->threads == 0 || checkpoint->threads > ETH_SEARCH_MAX_THREADS)
+	{
+		goto out;
+	}
+	for (unsigned int i = 0; i < checkpoint->threads; i++)
+	{
+		if (fscanf(f, " steps %llu", &checkpoint->steps[i]) != 1)
+		{
+			goto out;
+		}
+	}
+	ret = 0;
+
+out:
+	fclose(f);
+	if (ret != 0)
+	{
+		OPENSSL_cleanse(checkpoint, sizeof(*checkpoint));
+	}
+	return ret;
+}
+
+static void search_write_checkpoint(struct eth_search *s)
+{
+	struct eth_search_checkpoint *checkpoint = malloc(sizeof(*checkpoint));
+	if (!checkpoint)
+	{
+		return;
+	}
+	eth_search_snapshot(s, checkpoint);
+	eth_search_checkpoint_save(s->config.checkpoint_path, checkpoint);
+	OPENSSL_cleanse(checkpoint, sizeof(*checkpoint));
+	free(checkpoint);
+}
+
+// Snapshots are taken from the published counters on this thread, so the
+// search threads never wait for file I/O
+static void *search_checkpoint_main(void *arg)
+{
+	struct eth_search *s = arg;
+	unsigned int interval = s->config.checkpoint_interval ? s->config.checkpoint_interval
+		: SEARCH_DEFAULT_CHECKPOINT_INTERVAL;
+
+	pthread_mutex_lock(&s->lock);
+	while (!atomic_load(&s->stop))
+	{
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += interval;
+		pthread_cond_timedwait(&s->wake, &s->lock, &deadline);
+		if (atomic_load(&s->stop))
+		{
+			break;
+		}
+		pthread_mutex_unlock(&s->lock);
+		search_write_checkpoint(s);
+		pthread_mutex_lock(&s->lock);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+}
+
+static struct eth_search *search_launch(const struct eth_search_config *config,
+	const struct eth_search_checkpoint *resume)
+{
+	if (!config || !secp256k1_ec_seckey_verify(secp256k1_context_static, config->base_key) ||
+		config->threads > ETH_SEARCH_MAX_THREADS)
+	{
+		return NULL;
+	}
+
+	struct eth_search *s = calloc(1, sizeof(*s));
+	if (!s)
+	{
+		return NULL;
+	}
+	s->config = *config;
+	s->nthreads = config->threads ? config->threads : eth_online_cpus();
+	if (s->nthreads > ETH_SEARCH_MAX_THREADS)
+	{
+		s->nthreads = ETH_SEARCH_MAX_THREADS;
+	}
+	s->total_nibbles = count_nibbles(config->pattern.mask);
+	s->total_cases = count_nibbles(config->pattern.case_mask);
+	s->best_score = -1;
+	s->started_at = search_now();
+	if (resume)
+	{
+		s->elapsed_before = resume->elapsed;
+		s->best_score = resume->best_score;
+		s->best = resume->best;
+		s->found = resume->found;
+		if (s->found)
+		{
+			s->result = resume->best;
+		}
+	}
+	atomic_init(&s->stop, s->found);
+	atomic_init(&s->running, 0);
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->wake, NULL);
+
+	s->threads = calloc(s->nthreads, sizeof(*s->threads));
+	if (!s->threads)
+	{
+		eth_search_free(s);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < s->nthreads; i++)
+	{
+		struct search_thread *t = &s->threads[i];
+		unsigned char tweak[32];
+
+		t->search = s;
+		t->index = i;
+		atomic_init(&t->steps, resume ? resume->steps[i] : 0);
+		memcpy(t->start_key, config->base_key, ETH_PRIV_KEY_SIZE);
+		search_offset(tweak, config->shard, i, 0);
+		if (!secp256k1_ec_seckey_tweak_add(secp256k1_context_static, t->start_key, tweak))
+		{
+			eth_search_free(s);
+			return NULL;
+		}
+		atomic_fetch_add(&s->running, 1);
+		if (pthread_create(&t->tid, NULL, search_thread_main, t) != 0)
+		{
+			atomic_fetch_sub(&s->running, 1);
+			eth_search_free(s);
+			return NULL;
+		}
+		s->started++;
+	}
+
+	if (config->checkpoint_path)
+	{
+		if (pthread_create(&s->checkpointer, NULL, search_checkpoint_main, s) != 0)
+		{
+			eth_search_free(s);
+			return NULL;
+		}
+		s->checkpointing = 1;
+	}
+	return s;
+}
+
+struct eth_search *eth_search_start(const struct eth_search_config *config)
+{
+	return search_launch(config, NULL);
+}
+
+struct eth_search *eth_search_resume(const struct eth_search_checkpoint *checkpoint,
+	const char *checkpoint_path, unsigned int checkpoint_interval)
+{
+	struct eth_search_config config;
+	if (!checkpoint)
+	{
+		return NULL;
+	}
+	memset(&config, 0, sizeof(config));
+	config.pattern = checkpoint->pattern;
+	config.threads = checkpoint->threads;
+	memcpy(config.base_key, checkpoint->base_key, ETH_PRIV_KEY_SIZE);
+	config.shard = checkpoint->shard;
+	config.checkpoint_path = checkpoint_path;
+	config.checkpoint_interval = checkpoint_interval;
+
+	struct eth_search *s = search_launch(&config, checkpoint);
+	OPENSSL_cleanse(&config, sizeof(config));
+	return s;
+}
+
+unsigned long long eth_search_attempts(struct eth_search *search)
+{
+	unsigned long long total = 0;
+	for (unsigned int i = 0; i < search->started; i++)
+	{
+		total += atomic_load_explicit(&search->threads[i].steps, memory_order_relaxed);
+	}
+	return total;
+}
+
+int eth_search_poll(struct eth_search *search, struct eth_search_result *result)
+{
+	pthread_mutex_lock(&search->lock);
+	int found = search->found;
+	if (found && result)
+	{
+		*result = search->result;
+	}
+	pthread_mutex_unlock(&search->lock);
+	// Threads leave on their own only when they cannot go on (no context,
+	// no memory): with none left the search would never finish
+	if (!found && atomic_load(&search->running) == 0 && !atomic_load(&search->stop))
+	{
+		return -1;
+	}
+	return found;
+}
+
+void eth_search_stop(struct eth_search *search)
+{
+	pthread_mutex_lock(&search->lock);
+	atomic_store(&search->stop, 1);
+	pthread_cond_signal(&search->wake);
+	pthread_mutex_unlock(&search->lock);
+}
+
+void eth_search_free(struct eth_search *search)
+{
+	if (!search)
+	{
+		return;
+	}
+	eth_search_stop(search);
+	for (unsigned int i = 0; i < search->started; i++)
+	{
+		pthread_join(search->threads[i].tid, NULL);
+	}
+	if (search->checkpointing)
+	{
+		pthread_join(search->checkpointer, NULL);
+		// Final positions, so a clean shutdown loses nothing
+		search_write_checkpoint(search);
+	}
+	if (search->threads)
+	{
+		OPENSSL_cleanse(search->threads, search->nthreads * sizeof(*search->threads));
+	}
+	free(search->threads);
+	pthread_cond_destroy(&search->wake);
+	pthread_mutex_destroy(&search->lock);
+	OPENSSL_cleanse(search, sizeof(*search));
+	free(search);
+}
@@ -0,0 +1,187 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Keccak-256 rate: every candidate must fit one block
+#define SELECTOR_RATE 136
+// Candidates between updates of the shared attempt counter
+#define SELECTOR_CHUNK 4096
+
+// Suffix digits, all valid in Solidity identifiers: 6 bits per character
+static const char selector_digits[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_$";
+
+struct selector_mine
+{
+	const struct eth_selector_config *config;
+	size_t name_len;
+	size_t params_len;
+	unsigned int threads;
+	atomic_int stop;
+	atomic_ullong attempts;
+	pthread_mutex_t lock;
+	int found;
+	struct eth_selector_result *result;
+};
+
+// name + "_" + counter in base 64 + params; returns the length
+static size_t selector_candidate(const struct selector_mine *m, unsigned long long counter, unsigned char *out)
+{
+	unsigned char *p = out;
+	memcpy(p, m->config->name, m->name_len);
+	p += m->name_len;
+	*p++ = '_';
+	do
+	{
+		*p++ = (unsigned char)selector_digits[counter & 63];
+		counter >>= 6;
+	} while (counter);
+	memcpy(p, m->config->params, m->params_len);
+	p += m->params_len;
+	return (size_t)(p - out);
+}
+
+static int selector_match(const struct eth_selector_config *config, const unsigned char *hash)
+{
+	for (int i = 0; i < 32; i++)
+	{
+		if ((hash[i] & config->mask[i]) != config->value[i])
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Thread t tries counters t, t + threads, t + 2 * threads, ...,
+// ETH_KECCAK_LANES candidates per hash call
+static int selector_range(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct selector_mine *m = arg;
+	unsigned char candidates[ETH_KECCAK_LANES][SELECTOR_RATE];
+	unsigned char hashes[ETH_KECCAK_LANES * 32];
+	size_t len[ETH_KECCAK_LANES];
+	unsigned long long counter = first;
+	unsigned long long max = m->config->max_attempts;
+	(void)count;
+	(void)thread;
+
+	while (!atomic_load_explicit(&m->stop, memory_order_relaxed))
+	{
+		for (int i = 0; i < SELECTOR_CHUNK; i += ETH_KECCAK_LANES)
+		{
+			unsigned long long base = counter;
+			for (int l = 0; l < ETH_KECCAK_LANES; l++)
+			{
+				len[l] = selector_candidate(m, counter, candidates[l]);
+				counter += m->threads;
+			}
+			eth_keccak256_lanes(&candidates[0][0], SELECTOR_RATE, len, hashes);
+
+			for (int l = 0; l < ETH_KECCAK_LANES; l++)
+			{
+				if (!selector_match(m->config, hashes + 32 * l))
+				{
+					continue;
+				}
+				pthread_mutex_lock(&m->lock);
+				if (!m->found)
+				{
+					m->found = 1;
+					memcpy(m->result->signature, candidates[l], len[l]);
+					m->result->signature[len[l]] = '\0';
+					memcpy(m->result->hash, hashes + 32 * l, 32);
+					m->result->counter = base + (unsigned long long)l * m->threads;
+				}
+				pthread_mutex_unlock(&m->lock);
+				atomic_store(&m->stop, 1);
+			}
+		}
+		unsigned long long done = atomic_fetch_add_explicit(&m->attempts, SELECTOR_CHUNK, memory_order_relaxed);
+		if (max && done + SELECTOR_CHUNK >= max)
+		{
+			atomic_store(&m->stop, 1);
+		}
+	}
+	return 0;
+}
+
+int eth_selector_mine(const struct eth_selector_config *config, struct eth_selector_result *result)
+{
+	if (!config || !config->name || !config->params || !result)
+	{
+		return -1;
+	}
+	struct selector_mine m = {.config = config, .result = result};
+	m.name_len = strlen(config->name);
+	m.params_len = strlen(config->params);
+	// Room for "_" and the longest (11-digit) counter
+	if (m.name_len + 1 + 11 + m.params_len >= SELECTOR_RATE ||
+		m.name_len + 1 + 11 + m.params_len >= ETH_SELECTOR_MAX_SIGNATURE)
+	{
+		return -1;
+	}
+	m.threads = config->threads ? config->threads : eth_online_cpus();
+	if (m.threads > ETH_SEARCH_MAX_THREADS)
+	{
+		m.threads = ETH_SEARCH_MAX_THREADS;
+	}
+	atomic_init(&m.stop, 0);
+	atomic_init(&m.attempts, 0);
+	pthread_mutex_init(&m.lock, NULL);
+	memset(result, 0, sizeof(*result));
+
+	// One "range" per thread: range t is just the starting counter t
+	int ret = eth_parallel_ranges(m.threads, m.threads, selector_range, &m);
+	pthread_mutex_destroy(&m.lock);
+	result->attempts = atomic_load(&m.attempts);
+	if (ret != 0)
+	{
+		return -1;
+	}
+	return m.found ? 0 : 1;
+}
+
+int eth_selector_target(struct eth_selector_config *config, unsigned int zero_bytes, const char *hex)
+{
+	memset(config->value, 0, sizeof(config->value));
+	memset(config->mask, 0, sizeof(config->mask));
+	if (zero_bytes > sizeof(config->mask))
+	{
+		return -1;
+	}
+	memset(config->mask, 0xff, zero_bytes);
+	if (!hex)
+	{
+		return 0;
+	}
+
+	// Leading nibbles of the hash, like a vanity prefix
+	if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X'))
+	{
+		hex += 2;
+	}
+	size_t n = strlen(hex);
+	if (n == 0 || n > 2 * sizeof(config->value))
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		int v = eth_hex_value(hex[i]);
+		if (v < 0)
+		{
+			return -1;
+		}
+		int shift = i % 2 ? 0 : 4;
+		if ((config->mask[i / 2] >> shift & 15) && (config->value[i / 2] >> shift & 15) != v)
+		{
+			return -1;
+		}
+		config->value[i / 2] |= (unsigned char)(v << shift);
+		config->mask[i / 2] |= (unsigned char)(15 << shift);
+	}
+	return 0;
+}
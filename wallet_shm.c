@@ -0,0 +1,390 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+#include "wallet_ring.h"
+
+#define SHM_MAGIC 0x57414c52 // "WALR"
+#define SHM_VERSION 2
+// Records start on their own page after the header
+#define SHM_HEADER_SIZE 4096
+#define SHM_MAX_NAME 255
+// Longest the producer sleeps before checking the consumer is still alive
+#define SHM_LIVENESS_SECONDS 0.1
+
+// Shared between processes; every field a peer can change is atomic. Same
+// cache-line split as struct eth_ring: producer fields, consumer fields, flags.
+struct shm_header
+{
+	atomic_uint magic; // stored last by the creator
+	uint32_t version;
+	uint64_t capacity;
+	uint32_t rec_size;
+	_Alignas(ETH_CACHELINE) atomic_uint_least64_t head;
+	atomic_uint head_seq; // futex word, bumped on every publish
+	atomic_uint consumer_waiting;
+	_Alignas(ETH_CACHELINE) atomic_uint_least64_t tail;
+	atomic_uint tail_seq; // futex word, bumped on every release
+	atomic_uint producer_waiting;
+	atomic_int consumer_pid; // 0 until a consumer opens the ring
+	_Alignas(ETH_CACHELINE) atomic_uint closed; // producer finished
+	atomic_uint detached;                      // consumer went away
+};
+
+_Static_assert(sizeof(struct shm_header) <= SHM_HEADER_SIZE, "shm header outgrew its page");
+
+struct eth_shm_ring
+{
+	struct shm_header *hdr;
+	unsigned char *recs;
+	size_t map_size;
+	size_t mask;
+	uint64_t peer_cache; // last seen tail (producer) or head (consumer)
+	int producer;
+	char name[SHM_MAX_NAME + 1];
+};
+
+static double shm_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sleep until *seq moves past `seen`, `timeout` seconds pass (< 0: forever)
+// or a spurious wakeup. Callers read `seen` before re-checking their
+// condition, so a wake between that check and the sleep is never lost.
+static void shm_wait(atomic_uint *seq, unsigned int seen, atomic_uint *waiting, double timeout)
+{
+	atomic_fetch_add(waiting, 1);
+#ifdef __linux__
+	struct timespec ts, *tsp = NULL;
+	if (timeout >= 0)
+	{
+		ts.tv_sec = (time_t)timeout;
+		ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1e9);
+		tsp = &ts;
+	}
+	// Not FUTEX_PRIVATE: the word lives in a mapping shared across processes
+	syscall(SYS_futex, seq, FUTEX_WAIT, seen, tsp, NULL, 0);
+#else
+	struct timespec ts = {0, 50000};
+	if (atomic_load(seq) == seen)
+	{
+		nanosleep(&ts, NULL);
+	}
+	(void)timeout;
+#endif
+	atomic_fetch_sub(waiting, 1);
+}
+
+static void shm_wake(atomic_uint *seq, atomic_uint *waiting)
+{
+	atomic_fetch_add(seq, 1);
+	if (atomic_load(waiting))
+	{
+#ifdef __linux__
+		syscall(SYS_futex, seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+	}
+}
+
+// A consumer that died without eth_shm_ring_free() never detaches, so the
+// producer checks on its pid between timed waits
+static int shm_consumer_gone(struct shm_header *hdr)
+{
+	int pid = atomic_load(&hdr->consumer_pid);
+	if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH)
+	{
+		atomic_store(&hdr->detached, 1);
+	}
+	return atomic_load(&hdr->detached);
+}
+
+// "/name" as shm_open wants it; a missing leading slash is added
+static int shm_name(char *dst, const char *name)
+{
+	size_t len = name ? strlen(name) : 0;
+	int slash = len > 0 && name[0] == '/';
+	if (len == 0 || len + !slash > SHM_MAX_NAME || strchr(name + slash, '/'))
+	{
+		return -1;
+	}
+	dst[0] = '/';
+	memcpy(dst + 1, name + slash, len - slash + 1);
+	return 0;
+}
+
+struct eth_shm_ring *eth_shm_ring_create(const char *name, size_t capacity)
+{
+	struct eth_shm_ring *ring = calloc(1, sizeof(*ring));
+	if (!ring)
+	{
+		return NULL;
+	}
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0 || shm_name(ring->name, name) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	// Records hold private keys: owner-only, and an existing object is
+	// never replaced, since it may be another producer's live ring
+	int fd = shm_open(ring->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	ring->map_size = SHM_HEADER_SIZE + capacity * ETH_WALLET_RECORD_SIZE;
+	void *map = MAP_FAILED;
+	if (ftruncate(fd, (off_t)ring->map_size) == 0)
+	{
+		map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		shm_unlink(ring->name);
+		free(ring);
+		return NULL;
+	}
+
+	ring->hdr = map;
+	ring->recs = (unsigned char *)map + SHM_HEADER_SIZE;
+	ring->mask = capacity - 1;
+	ring->producer = 1;
+	ring->hdr->version = SHM_VERSION;
+	ring->hdr->capacity = capacity;
+	ring->hdr->rec_size = ETH_WALLET_RECORD_SIZE;
+	atomic_init(&ring->hdr->head, 0);
+	atomic_init(&ring->hdr->tail, 0);
+	atomic_store(&ring->hdr->magic, SHM_MAGIC);
+	return ring;
+}
+
+struct eth_shm_ring *eth_shm_ring_open(const char *name)
+{
+	struct eth_shm_ring *ring = calloc(1, sizeof(*ring));
+	struct stat st;
+	if (!ring)
+	{
+		return NULL;
+	}
+	if (shm_name(ring->name, name) != 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	int fd = shm_open(ring->name, O_RDWR, 0);
+	if (fd < 0)
+	{
+		free(ring);
+		return NULL;
+	}
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size > SHM_HEADER_SIZE)
+	{
+		ring->map_size = (size_t)st.st_size;
+		map = mmap(NULL, ring->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	ring->hdr = map;
+	ring->recs = (unsigned char *)map + SHM_HEADER_SIZE;
+	uint64_t capacity = ring->hdr->capacity;
+	if (atomic_load(&ring->hdr->magic) != SHM_MAGIC || ring->hdr->version != SHM_VERSION ||
+		ring->hdr->rec_size != ETH_WALLET_RECORD_SIZE || capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+		SHM_HEADER_SIZE + capacity * ETH_WALLET_RECORD_SIZE > ring->map_size)
+	{
+		munmap(map, ring->map_size);
+		free(ring);
+		return NULL;
+	}
+	ring->mask = capacity - 1;
+	atomic_store(&ring->hdr->consumer_pid, (int)getpid());
+	return ring;
+}
+
+size_t eth_shm_ring_reserve(struct eth_shm_ring *ring, size_t want, unsigned char **records)
+{
+	struct shm_header *hdr = ring->hdr;
+	uint64_t head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+	size_t cap = ring->mask + 1;
+	unsigned int spins = 0;
+
+	if (want > cap)
+	{
+		want = cap;
+	}
+	for (;;)
+	{
+		if (head - ring->peer_cache + want > cap)
+		{
+			ring->peer_cache = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+		}
+		size_t n = cap - (size_t)(head - ring->peer_cache);
+		if (atomic_load_explicit(&hdr->detached, memory_order_relaxed))
+		{
+			return 0;
+		}
+		if (n > 0)
+		{
+			// Contiguous slots only, so the caller can write straight in
+			size_t to_end = cap - (size_t)(head & ring->mask);
+			n = n < want ? n : want;
+			*records = ring->recs + (head & ring->mask) * ETH_WALLET_RECORD_SIZE;
+			return n < to_end ? n : to_end;
+		}
+		if (spins < 64)
+		{
+			eth_ring_wait(&spins);
+			continue;
+		}
+		unsigned int seen = atomic_load(&hdr->tail_seq);
+		if (atomic_load_explicit(&hdr->tail, memory_order_acquire) == ring->peer_cache)
+		{
+			shm_wait(&hdr->tail_seq, seen, &hdr->producer_waiting, SHM_LIVENESS_SECONDS);
+			shm_consumer_gone(hdr);
+		}
+	}
+}
+
+void eth_shm_ring_commit(struct eth_shm_ring *ring, size_t count)
+{
+	uint64_t head = atomic_load_explicit(&ring->hdr->head, memory_order_relaxed);
+	atomic_store_explicit(&ring->hdr->head, head + count, memory_order_release);
+	shm_wake(&ring->hdr->head_seq, &ring->hdr->consumer_waiting);
+}
+
+void eth_shm_ring_close(struct eth_shm_ring *ring)
+{
+	atomic_store(&ring->hdr->closed, 1);
+	shm_wake(&ring->hdr->head_seq, &ring->hdr->consumer_waiting);
+}
+
+int eth_shm_ring_drain(struct eth_shm_ring *ring, int timeout_ms)
+{
+	struct shm_header *hdr = ring->hdr;
+	double deadline = shm_now() + timeout_ms / 1e3;
+
+	for (;;)
+	{
+		unsigned int seen = atomic_load(&hdr->tail_seq);
+		if (atomic_load(&hdr->tail) == atomic_load(&hdr->head) || shm_consumer_gone(hdr))
+		{
+			return 0;
+		}
+		double left = deadline - shm_now();
+		if (timeout_ms >= 0 && left <= 0)
+		{
+			return -1;
+		}
+		shm_wait(&hdr->tail_seq, seen, &hdr->producer_waiting,
+			timeout_ms >= 0 && left < SHM_LIVENESS_SECONDS ? left : SHM_LIVENESS_SECONDS);
+	}
+}
+
+size_t eth_shm_ring_acquire(struct eth_shm_ring *ring, size_t max, const unsigned char **records, int timeout_ms)
+{
+	struct shm_header *hdr = ring->hdr;
+	uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_relaxed);
+	size_t cap = ring->mask + 1;
+	double deadline = timeout_ms > 0 ? shm_now() + timeout_ms / 1e3 : 0;
+	unsigned int spins = 0;
+
+	for (;;)
+	{
+		if (ring->peer_cache - tail < max)
+		{
+			ring->peer_cache = atomic_load_explicit(&hdr->head, memory_order_acquire);
+		}
+		size_t n = (size_t)(ring->peer_cache - tail);
+		if (n > 0)
+		{
+			size_t to_end = cap - (size_t)(tail & ring->mask);
+			n = n < max ? n : max;
+			*records = ring->recs + (tail & ring->mask) * ETH_WALLET_RECORD_SIZE;
+			return n < to_end ? n : to_end;
+		}
+
+		unsigned int seen = atomic_load(&hdr->head_seq);
+		int closed = atomic_load(&hdr->closed);
+		if (atomic_load_explicit(&hdr->head, memory_order_acquire) != ring->peer_cache)
+		{
+			continue;
+		}
+		if (closed || timeout_ms == 0)
+		{
+			return 0;
+		}
+		if (spins < 64)
+		{
+			eth_ring_wait(&spins);
+			continue;
+		}
+		double left = deadline - shm_now();
+		if (timeout_ms > 0 && left <= 0)
+		{
+			return 0;
+		}
+		shm_wait(&hdr->head_seq, seen, &hdr->consumer_waiting, timeout_ms > 0 ? left : -1);
+	}
+}
+
+void eth_shm_ring_release(struct eth_shm_ring *ring, size_t count)
+{
+	uint64_t tail = atomic_load_explicit(&ring->hdr->tail, memory_order_relaxed);
+	// Consumed keys do not linger in shared memory
+	OPENSSL_cleanse(ring->recs + (tail & ring->mask) * ETH_WALLET_RECORD_SIZE, count * ETH_WALLET_RECORD_SIZE);
+	atomic_store_explicit(&ring->hdr->tail, tail + count, memory_order_release);
+	shm_wake(&ring->hdr->tail_seq, &ring->hdr->producer_waiting);
+}
+
+int eth_shm_ring_finished(struct eth_shm_ring *ring)
+{
+	return atomic_load(&ring->hdr->closed) &&
+		atomic_load(&ring->hdr->tail) == atomic_load(&ring->hdr->head);
+}
+
+void eth_shm_ring_free(struct eth_shm_ring *ring)
+{
+	if (!ring)
+	{
+		return;
+	}
+	if (ring->producer)
+	{
+		// The name goes now; the memory once the last consumer unmaps it
+		eth_shm_ring_close(ring);
+		shm_unlink(ring->name);
+	}
+	else
+	{
+		atomic_store(&ring->hdr->detached, 1);
+		shm_wake(&ring->hdr->tail_seq, &ring->hdr->producer_waiting);
+	}
+	munmap(ring->hdr, ring->map_size);
+	free(ring);
+}
@@ -0,0 +1,316 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <secp256k1.h>
+#include <secp256k1_recovery.h>
+#include <openssl/crypto.h>
+#include <libkeccak.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define PERSONAL_PREFIX "\x19" "Ethereum Signed Message:\n"
+
+struct eth_signer
+{
+	// Read-only once created, so batch threads share it
+	secp256k1_context *ctx;
+	unsigned char priv_key[ETH_PRIV_KEY_SIZE];
+	unsigned char address[ETH_ADDRESS_SIZE];
+};
+
+struct sign_batch
+{
+	struct eth_signer *signer;
+	int mode;
+	const unsigned char *domain_separator;
+	const struct eth_sign_item *items;
+	unsigned char *sigs;
+};
+
+struct eth_signer *eth_signer_create(const unsigned char *priv_key)
+{
+	unsigned char seed[32];
+
+	if (!priv_key)
+	{
+		return NULL;
+	}
+	struct eth_signer *signer = calloc(1, sizeof(*signer));
+	if (!signer)
+	{
+		return NULL;
+	}
+
+	signer->ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!signer->ctx || !secp256k1_ec_seckey_verify(signer->ctx, priv_key))
+	{
+		eth_signer_destroy(signer);
+		return NULL;
+	}
+	// Blinding against side channels; done once, not per signature
+	secure_random(seed, sizeof(seed));
+	if (!secp256k1_context_randomize(signer->ctx, seed))
+	{
+		OPENSSL_cleanse(seed, sizeof(seed));
+		eth_signer_destroy(signer);
+		return NULL;
+	}
+	OPENSSL_cleanse(seed, sizeof(seed));
+	memcpy(signer->priv_key, priv_key, ETH_PRIV_KEY_SIZE);
+
+	if (eth_seckey_to_address(signer->ctx, priv_key, signer->address) != 0)
+	{
+		eth_signer_destroy(signer);
+		return NULL;
+	}
+	return signer;
+}
+
+void eth_signer_destroy(struct eth_signer *signer)
+{
+	if (!signer)
+	{
+		return;
+	}
+	if (signer->ctx)
+	{
+		secp256k1_context_destroy(signer->ctx);
+	}
+	OPENSSL_cleanse(signer, sizeof(*signer));
+	free(signer);
+}
+
+void eth_signer_address(const struct eth_signer *signer, unsigned char *address)
+{
+	memcpy(address, signer->address, ETH_ADDRESS_SIZE);
+}
+
+static int personal_hash(struct libkeccak_state *state, const void *message, size_t len, unsigned char *hash)
+{
+	char length[24];
+	int n = snprintf(length, sizeof(length), "%zu", len);
+
+	libkeccak_state_reset(state);
+	if (libkeccak_update(state, PERSONAL_PREFIX, sizeof(PERSONAL_PREFIX) - 1) != 0 ||
+		libkeccak_update(state, length, (size_t)n) != 0)
+	{
+		return -1;
+	}
+	return libkeccak_digest(state, message, len, 0, NULL, hash);
+}
+
+static int typed_hash(struct libkeccak_state *state, const unsigned char *domain_separator,
+	const unsigned char *struct_hash, unsigned char *hash)
+{
+	unsigned char buf[2 + 32 + 32];
+	buf[0] = 0x19;
+	buf[1] = 0x01;
+	memcpy(buf + 2, domain_separator, 32);
+	memcpy(buf + 34, struct_hash, 32);
+	return eth_keccak256(state, buf, sizeof(buf), hash);
+}
+
+// Keccak state creation allocates, so callers hashing in bulk should use the
+// batch entry points, which keep one state per thread
+int eth_personal_message_hash(const void *message, size_t len, unsigned char *hash)
+{
+	struct libkeccak_state state;
+	if (eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	int ret = personal_hash(&state, message, len, hash);
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+int eth_eip712_type_hash(const char *type, unsigned char *hash)
+{
+	struct libkeccak_state state;
+	if (!type || eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	int ret = eth_keccak256(&state, type, strlen(type), hash);
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+int eth_eip712_hash_struct(const unsigned char *type_hash, const unsigned char *encoded, size_t words,
+	unsigned char *hash)
+{
+	struct libkeccak_state state;
+	if (eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	int ret = libkeccak_update(&state, type_hash, 32) == 0 &&
+		libkeccak_digest(&state, encoded, words * 32, 0, NULL, hash) == 0 ? 0 : -1;
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+int eth_eip712_domain_separator(const struct eth_eip712_domain *domain, unsigned char *separator)
+{
+	char type[128] = "EIP712Domain(";
+	unsigned char encoded[5 * 32];
+	size_t words = 0;
+	struct libkeccak_state state;
+
+	if (!domain || eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	memset(encoded, 0, sizeof(encoded));
+
+	// Fields in the order EIP-712 fixes for the domain; absent ones are
+	// left out of both the type string and the encoding
+	if (domain->name)
+	{
+		strcat(type, "string name,");
+		eth_keccak256(&state, domain->name, strlen(domain->name), encoded + 32 * words++);
+	}
+	if (domain->version)
+	{
+		strcat(type, "string version,");
+		eth_keccak256(&state, domain->version, strlen(domain->version), encoded + 32 * words++);
+	}
+	if (domain->has_chain_id)
+	{
+		strcat(type, "uint256 chainId,");
+		for (int i = 0; i < 8; i++)
+		{
+			encoded[32 * words + 31 - i] = (unsigned char)(domain->chain_id >> (8 * i));
+		}
+		words++;
+	}
+	if (domain->verifying_contract)
+	{
+		strcat(type, "address verifyingContract,");
+		memcpy(encoded + 32 * words + 12, domain->verifying_contract, ETH_ADDRESS_SIZE);
+		words++;
+	}
+	if (domain->salt)
+	{
+		strcat(type, "bytes32 salt,");
+		memcpy(encoded + 32 * words++, domain->salt, 32);
+	}
+	size_t tlen = strlen(type);
+	if (type[tlen - 1] == ',')
+	{
+		tlen--;
+	}
+	type[tlen++] = ')';
+
+	unsigned char type_hash[32];
+	int ret = eth_keccak256(&state, type, tlen, type_hash) == 0 &&
+		libkeccak_update(&state, type_hash, 32) == 0 &&
+		libkeccak_digest(&state, encoded, words * 32, 0, NULL, separator) == 0 ? 0 : -1;
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+static int sign_digest(struct eth_signer *signer, const unsigned char *digest, unsigned char *sig)
+{
+	secp256k1_ecdsa_recoverable_signature rsig;
+	int recid;
+
+	unsigned long long start = eth_latency_start();
+	int ok = secp256k1_ecdsa_sign_recoverable(signer->ctx, &rsig, digest, signer->priv_key, NULL, NULL);
+	eth_latency_end(ETH_LATENCY_SIGN, start);
+	if (!ok)
+	{
+		return -1;
+	}
+	secp256k1_ecdsa_recoverable_signature_serialize_compact(signer->ctx, sig, &recid, &rsig);
+	sig[64] = (unsigned char)(27 + recid);
+	return 0;
+}
+
+static int sign_item(struct eth_signer *signer, struct libkeccak_state *state, int mode,
+	const unsigned char *domain_separator, const struct eth_sign_item *item, unsigned char *sig)
+{
+	unsigned char digest[32];
+
+	switch (mode)
+	{
+	case ETH_SIGN_HASH:
+		if (item->len != 32)
+		{
+			return -1;
+		}
+		memcpy(digest, item->data, 32);
+		break;
+	case ETH_SIGN_PERSONAL:
+		if (personal_hash(state, item->data, item->len, digest) != 0)
+		{
+			return -1;
+		}
+		break;
+	case ETH_SIGN_TYPED:
+		if (item->len != 32 || typed_hash(state, domain_separator, item->data, digest) != 0)
+		{
+			return -1;
+		}
+		break;
+	default:
+		return -1;
+	}
+	return sign_digest(signer, digest, sig);
+}
+
+int eth_sign(struct eth_signer *signer, int mode, const unsigned char *domain_separator,
+	const struct eth_sign_item *item, unsigned char *sig)
+{
+	struct libkeccak_state state;
+	if (!signer || !item || !sig || (mode == ETH_SIGN_TYPED && !domain_separator) ||
+		eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	int ret = sign_item(signer, &state, mode, domain_separator, item, sig);
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+static int sign_range(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct sign_batch *batch = arg;
+	struct libkeccak_state state;
+	int ret = 0;
+	(void)thread;
+
+	if (eth_keccak256_init(&state) != 0)
+	{
+		return -1;
+	}
+	for (size_t i = first; i < first + count; i++)
+	{
+		unsigned char *sig = batch->sigs + i * ETH_SIGNATURE_SIZE;
+		if (sign_item(batch->signer, &state, batch->mode, batch->domain_separator, &batch->items[i], sig) != 0)
+		{
+			memset(sig, 0, ETH_SIGNATURE_SIZE);
+			ret = -1;
+		}
+	}
+	libkeccak_state_fast_destroy(&state);
+	return ret;
+}
+
+int eth_sign_batch(struct eth_signer *signer, int mode, const unsigned char *domain_separator,
+	const struct eth_sign_item *items, size_t count, unsigned char *sigs, unsigned int threads)
+{
+	if (!signer || (!items && count) || (!sigs && count) || (mode == ETH_SIGN_TYPED && !domain_separator))
+	{
+		return -1;
+	}
+
+	struct sign_batch batch = {
+		.signer = signer,
+		.mode = mode,
+		.domain_separator = domain_separator,
+		.items = items,
+		.sigs = sigs,
+	};
+	return eth_parallel_ranges(count, threads, sign_range, &batch);
+}
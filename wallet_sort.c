@@ -0,0 +1,564 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define SORT_REC ETH_WALLET_RECORD_SIZE
+// Offset of the address, the sort key, inside a record
+#define SORT_ADDR ETH_PRIV_KEY_SIZE
+#define SORT_DEFAULT_MEMORY (1UL << 30)
+#define SORT_DEFAULT_FAN_IN 64
+// In-memory runs are bucketed on the first two address bytes
+#define SORT_BUCKETS 65536
+// Smallest read per run during a merge, so every run is read sequentially
+#define SORT_MIN_READ (1 << 20)
+// Output buffers: still large sequential writes, without the writer's
+// default 32 MB per run file
+#define SORT_WRITE_BUFFER (2 << 20)
+#define SORT_WRITE_DEPTH 4
+
+struct sort_run
+{
+	int fd;
+	size_t records;
+};
+
+struct sort_radix
+{
+	const unsigned char *src;
+	unsigned char *dst;
+	unsigned int threads;
+	size_t *offsets; // threads * SORT_BUCKETS: where each thread's records of a bucket go
+	size_t *start;   // SORT_BUCKETS + 1
+};
+
+// One run being merged: a window of records read ahead from its file
+struct sort_reader
+{
+	int fd;
+	off_t offset;
+	size_t left;     // records still in the file
+	unsigned char *buf;
+	size_t cap;      // records the buffer holds
+	size_t n;
+	size_t pos;
+};
+
+// Records leave through here: the merge and single-run paths share the
+// duplicate check
+struct sort_out
+{
+	struct eth_writer *writer;
+	int dedup;
+	int check; // final output: look for duplicates
+	unsigned char prev[SORT_REC];
+	int have_prev;
+	size_t written;
+	struct eth_sort_result *result;
+	eth_sort_dup_fn report;
+	void *arg;
+};
+
+static int sort_cmp(const void *a, const void *b)
+{
+	int c = memcmp((const unsigned char *)a + SORT_ADDR, (const unsigned char *)b + SORT_ADDR, ETH_ADDRESS_SIZE);
+	return c ? c : memcmp(a, b, ETH_PRIV_KEY_SIZE);
+}
+
+static unsigned int sort_bucket(const unsigned char *rec)
+{
+	return (unsigned int)rec[SORT_ADDR] << 8 | rec[SORT_ADDR + 1];
+}
+
+static int radix_count(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct sort_radix *r = arg;
+	size_t *hist = r->offsets + (size_t)thread * SORT_BUCKETS;
+	for (size_t i = first; i < first + count; i++)
+	{
+		hist[sort_bucket(r->src + i * SORT_REC)]++;
+	}
+	return 0;
+}
+
+static int radix_scatter(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct sort_radix *r = arg;
+	size_t *offset = r->offsets + (size_t)thread * SORT_BUCKETS;
+	for (size_t i = first; i < first + count; i++)
+	{
+		const unsigned char *rec = r->src + i * SORT_REC;
+		memcpy(r->dst + offset[sort_bucket(rec)]++ * SORT_REC, rec, SORT_REC);
+	}
+	return 0;
+}
+
+// Buckets hold ~n / 65536 records of random addresses, so a comparison sort
+// finishes each one in cache
+static int radix_buckets(void *arg, size_t first, size_t count, unsigned int thread)
+{
+	struct sort_radix *r = arg;
+	(void)thread;
+	for (size_t b = first; b < first + count; b++)
+	{
+		size_t n = r->start[b + 1] - r->start[b];
+		if (n > 1)
+		{
+			qsort(r->dst + r->start[b] * SORT_REC, n, SORT_REC, sort_cmp);
+		}
+	}
+	return 0;
+}
+
+// MSD radix sort of `n` records from `src` into `dst`: a parallel histogram
+// and scatter on the leading 16 address bits, then the buckets in parallel
+static int sort_memory(const unsigned char *src, unsigned char *dst, size_t n, unsigned int threads)
+{
+	struct sort_radix r = {.src = src, .dst = dst, .threads = threads};
+	if (threads > n)
+	{
+		threads = n ? (unsigned int)n : 1;
+	}
+	// Both tables are too big for a thread stack
+	size_t *start = malloc((SORT_BUCKETS + 1) * sizeof(size_t));
+	r.start = start;
+	r.offsets = calloc((size_t)threads * SORT_BUCKETS, sizeof(size_t));
+	if (!start || !r.offsets || eth_parallel_ranges(n, threads, radix_count, &r) != 0)
+	{
+		free(start);
+		free(r.offsets);
+		return -1;
+	}
+
+	// Bucket b of thread t starts after bucket b of threads 0..t-1
+	size_t pos = 0;
+	for (size_t b = 0; b < SORT_BUCKETS; b++)
+	{
+		start[b] = pos;
+		for (unsigned int t = 0; t < threads; t++)
+		{
+			size_t c = r.offsets[(size_t)t * SORT_BUCKETS + b];
+			r.offsets[(size_t)t * SORT_BUCKETS + b] = pos;
+			pos += c;
+		}
+	}
+	start[SORT_BUCKETS] = pos;
+
+	int ret = eth_parallel_ranges(n, threads, radix_scatter, &r);
+	if (ret == 0)
+	{
+		ret = eth_parallel_ranges(SORT_BUCKETS, threads, radix_buckets, &r);
+	}
+	free(start);
+	free(r.offsets);
+	return ret;
+}
+
+static int sort_read_full(int fd, unsigned char *buf, size_t len, off_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t n = pread(fd, buf, len, offset);
+		if (n < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (n <= 0)
+		{
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+		offset += n;
+	}
+	return 0;
+}
+
+// Unlinked straight away: runs vanish with the process, even on a crash
+static int sort_temp(const char *dir)
+{
+	char path[4096];
+	snprintf(path, sizeof(path), "%s/walgen-sort-XXXXXX", dir);
+	int fd = mkstemp(path);
+	if (fd >= 0)
+	{
+		unlink(path);
+	}
+	return fd;
+}
+
+static struct eth_writer *sort_writer(int fd)
+{
+	struct eth_writer_config config = {
+		.fd = fd,
+		.buffer_size = SORT_WRITE_BUFFER,
+		.depth = SORT_WRITE_DEPTH,
+		.backend = ETH_WRITER_AUTO,
+	};
+	return eth_writer_create(&config);
+}
+
+static int sort_emit(struct sort_out *out, const unsigned char *rec)
+{
+	if (out->check && out->have_prev &&
+		memcmp(rec + SORT_ADDR, out->prev + SORT_ADDR, ETH_ADDRESS_SIZE) == 0)
+	{
+		out->result->duplicate_addresses++;
+		if (memcmp(rec, out->prev, ETH_PRIV_KEY_SIZE) == 0)
+		{
+			out->result->duplicate_keys++;
+		}
+		if (out->report)
+		{
+			out->report(out->arg, rec, out->prev);
+		}
+		if (out->dedup)
+		{
+			return 0;
+		}
+	}
+	else if (out->check)
+	{
+		// prev stays the first record of its address
+		memcpy(out->prev, rec, SORT_REC);
+		out->have_prev = 1;
+	}
+	out->written++;
+	return eth_writer_write(out->writer, rec, SORT_REC);
+}
+
+static int reader_fill(struct sort_reader *r)
+{
+	r->n = r->left < r->cap ? r->left : r->cap;
+	r->pos = 0;
+	if (r->n == 0)
+	{
+		return 0;
+	}
+	if (sort_read_full(r->fd, r->buf, r->n * SORT_REC, r->offset) != 0)
+	{
+		return -1;
+	}
+	r->offset += (off_t)(r->n * SORT_REC);
+	r->left -= r->n;
+	return 0;
+}
+
+static const unsigned char *reader_head(const struct sort_reader *r)
+{
+	return r->buf + r->pos * SORT_REC;
+}
+
+// Min-heap of reader indices by their current record; ties go to the lower
+// run, which keeps the merge stable
+static int heap_less(struct sort_reader *readers, unsigned int a, unsigned int b)
+{
+	int c = sort_cmp(reader_head(&readers[a]), reader_head(&readers[b]));
+	return c < 0 || (c == 0 && a < b);
+}
+
+static void heap_down(unsigned int *heap, unsigned int n, unsigned int i, struct sort_reader *readers)
+{
+	for (;;)
+	{
+		unsigned int l = 2 * i + 1, m = i;
+		if (l < n && heap_less(readers, heap[l], heap[m]))
+		{
+			m = l;
+		}
+		if (l + 1 < n && heap_less(readers, heap[l + 1], heap[m]))
+		{
+			m = l + 1;
+		}
+		if (m == i)
+		{
+			return;
+		}
+		unsigned int t = heap[i];
+		heap[i] = heap[m];
+		heap[m] = t;
+		i = m;
+	}
+}
+
+// k-way merge of runs[0..k) into `out`, `memory` bytes of read buffers
+static int sort_merge(struct sort_run *runs, unsigned int k, size_t memory, struct sort_out *out)
+{
+	struct sort_reader *readers = calloc(k, sizeof(*readers));
+	unsigned int *heap = calloc(k, sizeof(*heap));
+	size_t cap = memory / k / SORT_REC;
+	if (cap * SORT_REC < SORT_MIN_READ)
+	{
+		cap = SORT_MIN_READ / SORT_REC + 1;
+	}
+	int ret = readers && heap ? 0 : -1;
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < k && ret == 0; i++)
+	{
+		readers[i].fd = runs[i].fd;
+		readers[i].left = runs[i].records;
+		readers[i].cap = cap;
+		readers[i].buf = malloc(cap * SORT_REC);
+		if (!readers[i].buf || reader_fill(&readers[i]) != 0)
+		{
+			ret = -1;
+		}
+		else if (readers[i].n > 0)
+		{
+			heap[n++] = i;
+		}
+	}
+	for (unsigned int i = n / 2; ret == 0 && i-- > 0;)
+	{
+		heap_down(heap, n, i, readers);
+	}
+
+	while (ret == 0 && n > 0)
+	{
+		struct sort_reader *r = &readers[heap[0]];
+		if (sort_emit(out, reader_head(r)) != 0)
+		{
+			ret = -1;
+			break;
+		}
+		if (++r->pos == r->n && reader_fill(r) != 0)
+		{
+			ret = -1;
+			break;
+		}
+		if (r->n == 0)
+		{
+			heap[0] = heap[--n];
+		}
+		heap_down(heap, n, 0, readers);
+	}
+
+	for (unsigned int i = 0; readers && i < k; i++)
+	{
+		if (readers[i].buf)
+		{
+			OPENSSL_cleanse(readers[i].buf, cap * SORT_REC);
+			free(readers[i].buf);
+		}
+	}
+	free(readers);
+	free(heap);
+	return ret;
+}
+
+static void sort_close_runs(struct sort_run *runs, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (runs[i].fd >= 0)
+		{
+			close(runs[i].fd);
+		}
+	}
+}
+
+int eth_sort_records(const struct eth_sort_config *config, eth_sort_dup_fn report, void *arg,
+	struct eth_sort_result *result)
+{
+	struct eth_sort_result local;
+	struct stat st;
+
+	if (!config || !config->input || !config->output)
+	{
+		return -1;
+	}
+	if (!result)
+	{
+		result = &local;
+	}
+	memset(result, 0, sizeof(*result));
+	size_t memory = config->memory ? config->memory : SORT_DEFAULT_MEMORY;
+	unsigned int fan_in = config->fan_in ? config->fan_in : SORT_DEFAULT_FAN_IN;
+	unsigned int threads = config->threads ? config->threads : eth_online_cpus();
+	if (fan_in < 2)
+	{
+		fan_in = 2;
+	}
+
+	char dir[4096];
+	if (config->tmp_dir)
+	{
+		snprintf(dir, sizeof(dir), "%s", config->tmp_dir);
+	}
+	else
+	{
+		// Next to the output, which is where there is room for a copy
+		snprintf(dir, sizeof(dir), "%s", config->output);
+		char *slash = strrchr(dir, '/');
+		if (slash == dir)
+		{
+			slash[1] = '\0';
+		}
+		else if (slash)
+		{
+			*slash = '\0';
+		}
+		else
+		{
+			strcpy(dir, ".");
+		}
+	}
+
+	int in = open(config->input, O_RDONLY);
+	if (in < 0)
+	{
+		return -1;
+	}
+	// Opening the output truncates it, so sorting a file onto itself
+	// (through any path or link) would destroy the input
+	struct stat out_st;
+	if (fstat(in, &st) != 0 || st.st_size % SORT_REC != 0 ||
+		(stat(config->output, &out_st) == 0 && out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino))
+	{
+		close(in);
+		return -1;
+	}
+	result->records = (size_t)st.st_size / SORT_REC;
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	// Run formation: half the memory for the input chunk, half for the
+	// radix scatter target
+	size_t chunk = memory / 2 / SORT_REC;
+	if (chunk == 0)
+	{
+		chunk = 1;
+	}
+	size_t nruns = result->records ? (result->records + chunk - 1) / chunk : 0;
+	struct sort_run *runs = calloc(nruns ? nruns : 1, sizeof(*runs));
+	unsigned char *src = malloc(chunk * SORT_REC);
+	unsigned char *dst = malloc(chunk * SORT_REC);
+	int out_fd = open(config->output, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	int ret = runs && src && dst && out_fd >= 0 ? 0 : -1;
+	for (size_t i = 0; i < nruns; i++)
+	{
+		runs[i].fd = -1;
+	}
+
+	struct sort_out out = {
+		.dedup = config->dedup,
+		.check = 1,
+		.result = result,
+		.report = report,
+		.arg = arg,
+	};
+	size_t done = 0;
+	for (size_t i = 0; i < nruns && ret == 0; i++)
+	{
+		size_t n = result->records - done < chunk ? result->records - done : chunk;
+		if (sort_read_full(in, src, n * SORT_REC, (off_t)(done * SORT_REC)) != 0 ||
+			sort_memory(src, dst, n, threads) != 0)
+		{
+			ret = -1;
+			break;
+		}
+		done += n;
+
+		// Everything fit in one run: straight to the output
+		if (nruns == 1)
+		{
+			out.writer = sort_writer(out_fd);
+			for (size_t j = 0; out.writer && j < n && ret == 0; j++)
+			{
+				ret = sort_emit(&out, dst + j * SORT_REC);
+			}
+			if (!out.writer || eth_writer_finish(out.writer) != 0)
+			{
+				ret = -1;
+			}
+			eth_writer_free(out.writer);
+			break;
+		}
+
+		runs[i].records = n;
+		runs[i].fd = sort_temp(dir);
+		struct eth_writer *w = runs[i].fd >= 0 ? sort_writer(runs[i].fd) : NULL;
+		if (!w || eth_writer_write(w, dst, n * SORT_REC) != 0 || eth_writer_finish(w) != 0)
+		{
+			ret = -1;
+		}
+		eth_writer_free(w);
+	}
+	result->runs = nruns;
+	close(in);
+	if (src)
+	{
+		OPENSSL_cleanse(src, chunk * SORT_REC);
+	}
+	if (dst)
+	{
+		OPENSSL_cleanse(dst, chunk * SORT_REC);
+	}
+	free(src);
+	free(dst);
+
+	// Intermediate passes merge fan_in runs at a time into longer runs until
+	// one final merge can take them all
+	while (ret == 0 && nruns > fan_in)
+	{
+		size_t merged = 0, first = 0;
+		unsigned int k = 0;
+		for (; first < nruns && ret == 0; first += k)
+		{
+			k = nruns - first < fan_in ? (unsigned int)(nruns - first) : fan_in;
+			struct sort_run run = {.fd = sort_temp(dir)};
+			struct sort_out pass = {.writer = run.fd >= 0 ? sort_writer(run.fd) : NULL};
+			if (!pass.writer || sort_merge(runs + first, k, memory, &pass) != 0 ||
+				eth_writer_finish(pass.writer) != 0)
+			{
+				ret = -1;
+			}
+			eth_writer_free(pass.writer);
+			run.records = pass.written;
+			sort_close_runs(runs + first, k);
+			runs[merged++] = run;
+		}
+		// After a failure the runs not reached yet are still open
+		for (; first < nruns; first++)
+		{
+			runs[merged++] = runs[first];
+		}
+		nruns = merged;
+		result->merge_passes++;
+	}
+	if (ret == 0 && nruns > 1)
+	{
+		out.writer = sort_writer(out_fd);
+		if (!out.writer || sort_merge(runs, (unsigned int)nruns, memory, &out) != 0 ||
+			eth_writer_finish(out.writer) != 0)
+		{
+			ret = -1;
+		}
+		eth_writer_free(out.writer);
+		result->merge_passes++;
+	}
+	if (runs)
+	{
+		sort_close_runs(runs, nruns);
+	}
+	free(runs);
+	OPENSSL_cleanse(out.prev, sizeof(out.prev));
+	if (out_fd >= 0)
+	{
+		if (ret == 0 && fsync(out_fd) != 0)
+		{
+			ret = -1;
+		}
+		close(out_fd);
+	}
+	result->written = out.written;
+	return ret;
+}
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define STREAM_DEFAULT_BATCH 1024
+
+struct stream_buffer
+{
+	unsigned char *keys;
+	unsigned char *addresses;
+	int ready; // filled and not yet handed to the consumer
+};
+
+struct eth_wallet_stream
+{
+	// Consumer side: the batch being handed out. Kept first so next()
+	// touches one cache line.
+	const unsigned char *keys;
+	const unsigned char *addresses;
+	size_t pos;
+	size_t batch;
+	unsigned int current;
+
+	struct eth_generator *gen; // synchronous mode only
+	struct stream_buffer buffers[2];
+	struct eth_huge_buffer mem;
+	size_t mem_bytes;
+	int locked;
+
+	// Prefetch mode: the producer fills whichever buffer is not ready
+	int prefetch;
+	int failed;
+	int shutdown;
+	pthread_t producer;
+	pthread_mutex_t lock;
+	pthread_cond_t filled;
+	pthread_cond_t drained;
+};
+
+static void *stream_producer_main(void *arg)
+{
+	struct eth_wallet_stream *s = arg;
+	struct eth_generator *gen = eth_generator_create();
+	unsigned int next = 0;
+
+	pthread_mutex_lock(&s->lock);
+	if (!gen)
+	{
+		s->failed = 1;
+		pthread_cond_broadcast(&s->filled);
+	}
+	while (gen && !s->shutdown)
+	{
+		struct stream_buffer *b = &s->buffers[next];
+		if (b->ready)
+		{
+			pthread_cond_wait(&s->drained, &s->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&s->lock);
+
+		// The consumer never reads a buffer that is not ready, so the
+		// generation runs unlocked
+		int ok = eth_generator_fill(gen, b->keys, b->addresses, s->batch) == 0;
+
+		pthread_mutex_lock(&s->lock);
+		if (!ok)
+		{
+			s->failed = 1;
+			pthread_cond_broadcast(&s->filled);
+			break;
+		}
+		b->ready = 1;
+		next ^= 1;
+		pthread_cond_broadcast(&s->filled);
+	}
+	pthread_mutex_unlock(&s->lock);
+	eth_generator_destroy(gen);
+	return NULL;
+}
+
+// Slow path of next(): once per batch
+static int stream_refill(struct eth_wallet_stream *s)
+{
+	if (!s->prefetch)
+	{
+		struct stream_buffer *b = &s->buffers[0];
+		if (eth_generator_fill(s->gen, b->keys, b->addresses, s->batch) != 0)
+		{
+			return -1;
+		}
+		s->keys = b->keys;
+		s->addresses = b->addresses;
+		s->pos = 0;
+		return 0;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	// Hand the finished batch back (the very first call has none) and take
+	// the other one, waiting only if the producer has fallen behind
+	if (s->keys)
+	{
+		s->buffers[s->current].ready = 0;
+		s->current ^= 1;
+		pthread_cond_signal(&s->drained);
+	}
+	while (!s->buffers[s->current].ready && !s->failed)
+	{
+		pthread_cond_wait(&s->filled, &s->lock);
+	}
+	int ret = s->buffers[s->current].ready ? 0 : -1;
+	pthread_mutex_unlock(&s->lock);
+	if (ret != 0)
+	{
+		return -1;
+	}
+	s->keys = s->buffers[s->current].keys;
+	s->addresses = s->buffers[s->current].addresses;
+	s->pos = 0;
+	return 0;
+}
+
+struct eth_wallet_stream *eth_wallet_stream_open(const struct eth_wallet_stream_config *config)
+{
+	struct eth_wallet_stream *s = calloc(1, sizeof(*s));
+	if (!s)
+	{
+		return NULL;
+	}
+	s->batch = config && config->batch ? config->batch : STREAM_DEFAULT_BATCH;
+	s->prefetch = config && config->prefetch;
+	// Nothing handed out yet: the first next() refills
+	s->pos = s->batch;
+
+	// Locked and kept out of core dumps, like the dispenser pool
+	size_t per_buffer = s->batch * ETH_WALLET_RECORD_SIZE;
+	s->mem_bytes = (s->prefetch ? 2 : 1) * per_buffer;
+	if (eth_huge_alloc(&s->mem, s->mem_bytes) != 0)
+	{
+		free(s);
+		return NULL;
+	}
+	s->locked = mlock(s->mem.data, s->mem_bytes) == 0;
+#ifdef MADV_DONTDUMP
+	madvise(s->mem.data, s->mem_bytes, MADV_DONTDUMP);
+#endif
+	for (int i = 0; i < (s->prefetch ? 2 : 1); i++)
+	{
+		s->buffers[i].keys = (unsigned char *)s->mem.data + i * per_buffer;
+		s->buffers[i].addresses = s->buffers[i].keys + s->batch * ETH_PRIV_KEY_SIZE;
+	}
+
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->filled, NULL);
+	pthread_cond_init(&s->drained, NULL);
+	if (s->prefetch)
+	{
+		if (pthread_create(&s->producer, NULL, stream_producer_main, s) != 0)
+		{
+			s->prefetch = 0;
+			eth_wallet_stream_close(s);
+			return NULL;
+		}
+	}
+	else if (!(s->gen = eth_generator_create()))
+	{
+		eth_wallet_stream_close(s);
+		return NULL;
+	}
+	return s;
+}
+
+int eth_wallet_stream_next(struct eth_wallet_stream *stream, const unsigned char **priv_key,
+	const unsigned char **address)
+{
+	if (__builtin_expect(stream->pos == stream->batch, 0) && stream_refill(stream) != 0)
+	{
+		return -1;
+	}
+	*priv_key = stream->keys + stream->pos * ETH_PRIV_KEY_SIZE;
+	*address = stream->addresses + stream->pos * ETH_ADDRESS_SIZE;
+	stream->pos++;
+	return 0;
+}
+
+int eth_wallet_stream_read(struct eth_wallet_stream *stream, unsigned char *priv_key, unsigned char *address)
+{
+	const unsigned char *k, *a;
+	if (eth_wallet_stream_next(stream, &k, &a) != 0)
+	{
+		return -1;
+	}
+	memcpy(priv_key, k, ETH_PRIV_KEY_SIZE);
+	memcpy(address, a, ETH_ADDRESS_SIZE);
+	return 0;
+}
+
+void eth_wallet_stream_close(struct eth_wallet_stream *stream)
+{
+	if (!stream)
+	{
+		return;
+	}
+	if (stream->prefetch)
+	{
+		pthread_mutex_lock(&stream->lock);
+		stream->shutdown = 1;
+		pthread_cond_broadcast(&stream->drained);
+		pthread_mutex_unlock(&stream->lock);
+		pthread_join(stream->producer, NULL);
+	}
+	eth_generator_destroy(stream->gen);
+
+	OPENSSL_cleanse(stream->mem.data, stream->mem_bytes);
+	if (stream->locked)
+	{
+		munlock(stream->mem.data, stream->mem_bytes);
+	}
+	eth_huge_free(&stream->mem);
+	pthread_cond_destroy(&stream->drained);
+	pthread_cond_destroy(&stream->filled);
+	pthread_mutex_destroy(&stream->lock);
+	free(stream);
+}
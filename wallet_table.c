@@ -0,0 +1,253 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+#define TABLE_MAGIC 0x57414c54 // "WALT"
+#define TABLE_VERSION 1
+#define TABLE_POINT_SIZE 64
+// Points start on their own page after the header
+#define TABLE_HEADER_SIZE 4096
+// Walk width used to compute the table
+#define TABLE_WALK 256
+
+struct table_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t point_size;
+	uint32_t reserved;
+	uint64_t count;
+	unsigned char sha256[SHA256_DIGEST_LENGTH]; // of the points
+};
+
+_Static_assert(sizeof(struct table_header) <= TABLE_HEADER_SIZE, "table header outgrew its page");
+
+// The installed table. Loading and unloading are setup steps, like
+// installing an entropy source; walks read these without the lock.
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static void *table_map;
+static size_t table_map_size;
+static const unsigned char *table_points;
+static size_t table_count;
+static pthread_once_t table_env_once = PTHREAD_ONCE_INIT;
+
+int eth_ec_table_create(const char *path, size_t count)
+{
+	struct table_header hdr = {
+		.magic = TABLE_MAGIC,
+		.version = TABLE_VERSION,
+		.point_size = TABLE_POINT_SIZE,
+	};
+	struct eth_ec_walk walk = {0};
+	unsigned char one[ETH_PRIV_KEY_SIZE] = {0};
+	unsigned char step[ETH_PRIV_KEY_SIZE] = {0};
+	unsigned char step64[64];
+	unsigned char *points = NULL;
+	char *tmp = NULL;
+	int fd = -1;
+	int ret = -1;
+
+	if (!path || count == 0 || count > (SIZE_MAX - TABLE_HEADER_SIZE) / TABLE_POINT_SIZE)
+	{
+		return -1;
+	}
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	points = malloc(count * TABLE_POINT_SIZE);
+	size_t plen = strlen(path);
+	tmp = malloc(plen + 5);
+	if (!ctx || !points || !tmp)
+	{
+		goto out;
+	}
+
+	// 1G .. count*G by the same batched walk the search uses: TABLE_WALK
+	// consecutive points, each step adding TABLE_WALK * G
+	one[31] = 1;
+	step[31] = TABLE_WALK & 0xff;
+	step[30] = TABLE_WALK >> 8;
+	if (eth_ec_pubkey64(ctx, step, step64) != 0 || eth_ec_walk_init(&walk, TABLE_WALK, step64) != 0 ||
+		eth_ec_walk_reset(&walk, ctx, one, 0) != 0)
+	{
+		goto out;
+	}
+	for (size_t done = 0; done < count;)
+	{
+		size_t n = count - done < TABLE_WALK ? count - done : TABLE_WALK;
+		for (size_t i = 0; i < n; i++)
+		{
+			eth_ec_walk_get(&walk, i, points + (done + i) * TABLE_POINT_SIZE);
+		}
+		done += n;
+		if (done < count && eth_ec_walk_step(&walk) != 0 && eth_ec_walk_reset(&walk, ctx, one, done) != 0)
+		{
+			goto out;
+		}
+	}
+	hdr.count = count;
+	SHA256(points, count * TABLE_POINT_SIZE, hdr.sha256);
+
+	// Synced and renamed into place, so a process never maps half a table
+	memcpy(tmp, path, plen);
+	memcpy(tmp + plen, ".tmp", 5);
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		goto out;
+	}
+	unsigned char page[TABLE_HEADER_SIZE] = {0};
+	memcpy(page, &hdr, sizeof(hdr));
+	if (write(fd, page, sizeof(page)) != (ssize_t)sizeof(page) ||
+		write(fd, points, count * TABLE_POINT_SIZE) != (ssize_t)(count * TABLE_POINT_SIZE) || fsync(fd) != 0)
+	{
+		goto out;
+	}
+	if (close(fd) != 0)
+	{
+		fd = -1;
+		goto out;
+	}
+	fd = -1;
+	ret = rename(tmp, path) == 0 ? 0 : -1;
+
+out:
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	if (ret != 0 && tmp)
+	{
+		unlink(tmp);
+	}
+	eth_ec_walk_free(&walk);
+	if (ctx)
+	{
+		secp256k1_context_destroy(ctx);
+	}
+	free(points);
+	free(tmp);
+	return ret;
+}
+
+// The checksum catches a damaged file; the first and last points are also
+// recomputed, so a table for another generator or count cannot pass
+static int table_check(const struct table_header *hdr, const unsigned char *points)
+{
+	unsigned char digest[SHA256_DIGEST_LENGTH];
+	unsigned char key[ETH_PRIV_KEY_SIZE] = {0};
+	unsigned char pub64[64];
+	int ret = -1;
+
+	SHA256(points, hdr->count * TABLE_POINT_SIZE, digest);
+	if (CRYPTO_memcmp(digest, hdr->sha256, sizeof(digest)) != 0)
+	{
+		return -1;
+	}
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	if (!ctx)
+	{
+		return -1;
+	}
+	key[31] = 1;
+	if (eth_ec_pubkey64(ctx, key, pub64) != 0 || memcmp(pub64, points, 64) != 0)
+	{
+		goto out;
+	}
+	for (int i = 0; i < 8; i++)
+	{
+		key[31 - i] = (unsigned char)(hdr->count >> (8 * i));
+	}
+	if (eth_ec_pubkey64(ctx, key, pub64) != 0 ||
+		memcmp(pub64, points + (hdr->count - 1) * TABLE_POINT_SIZE, 64) != 0)
+	{
+		goto out;
+	}
+	ret = 0;
+
+out:
+	secp256k1_context_destroy(ctx);
+	return ret;
+}
+
+int eth_ec_table_load(const char *path)
+{
+	struct stat st;
+	void *map = NULL;
+	size_t map_size = 0;
+
+	if (path)
+	{
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			return -1;
+		}
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size <= TABLE_HEADER_SIZE)
+		{
+			close(fd);
+			return -1;
+		}
+		// Read-only and shared: every process using the file maps the same
+		// page-cache pages
+		map_size = (size_t)st.st_size;
+		map = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+		{
+			return -1;
+		}
+		const struct table_header *hdr = map;
+		if (hdr->magic != TABLE_MAGIC || hdr->version != TABLE_VERSION || hdr->point_size != TABLE_POINT_SIZE ||
+			hdr->count == 0 || hdr->count > (map_size - TABLE_HEADER_SIZE) / TABLE_POINT_SIZE ||
+			table_check(hdr, (const unsigned char *)map + TABLE_HEADER_SIZE) != 0)
+		{
+			munmap(map, map_size);
+			return -1;
+		}
+	}
+
+	pthread_mutex_lock(&table_lock);
+	void *old = table_map;
+	size_t old_size = table_map_size;
+	table_map = map;
+	table_map_size = map_size;
+	table_points = map ? (const unsigned char *)map + TABLE_HEADER_SIZE : NULL;
+	table_count = map ? (size_t)((const struct table_header *)map)->count : 0;
+	pthread_mutex_unlock(&table_lock);
+	if (old)
+	{
+		munmap(old, old_size);
+	}
+	return 0;
+}
+
+size_t eth_ec_table_count(void)
+{
+	return table_count;
+}
+
+// WALGEN_EC_TABLE names a table to load on first use; a bad one is skipped
+static void table_env_load(void)
+{
+	const char *path = getenv("WALGEN_EC_TABLE");
+	if (path && !table_points && eth_ec_table_load(path) != 0)
+	{
+		fprintf(stderr, "walgen: ignoring unusable EC table %s\n", path);
+	}
+}
+
+const unsigned char *eth_ec_table_points(size_t count)
+{
+	pthread_once(&table_env_once, table_env_load);
+	return table_count >= count ? table_points : NULL;
+}
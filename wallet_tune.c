@@ -0,0 +1,467 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <secp256k1.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+
+// Shortest time one stage measurement runs for
+#define TUNE_STAGE_SECONDS 0.05
+// Target length of one pipeline trial
+#define TUNE_TRIAL_SECONDS 0.25
+#define TUNE_BLOCK 64
+#define TUNE_CACHE_MAGIC "# walgen autotune 1"
+#define TUNE_MAX_ENTRIES 64
+
+static const size_t tune_batches[] = {64, 256, 1024};
+
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+static int tuned;
+static struct eth_tune_params tune_current;
+
+static double tune_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// "model name" from /proc/cpuinfo, so a cache shared between machines
+// (NFS home directories) keeps one entry per CPU generation
+static void tune_cpu_model(char *model, size_t size)
+{
+	char line[256];
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	snprintf(model, size, "unknown");
+	while (f && fgets(line, sizeof(line), f))
+	{
+		char *colon = strchr(line, ':');
+		if (strncmp(line, "model name", 10) == 0 && colon)
+		{
+			colon += strspn(colon + 1, " \t") + 1;
+			colon[strcspn(colon, "\t\n")] = '\0';
+			snprintf(model, size, "%s", colon);
+			break;
+		}
+	}
+	if (f)
+	{
+		fclose(f);
+	}
+}
+
+int eth_tune_cache_path(char *path, size_t size)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int n;
+
+	if (xdg && xdg[0])
+	{
+		n = snprintf(path, size, "%s/walgen/tune", xdg);
+	}
+	else if (home && home[0])
+	{
+		n = snprintf(path, size, "%s/.cache/walgen/tune", home);
+	}
+	else
+	{
+		return -1;
+	}
+	return n > 0 && (size_t)n < size ? 0 : -1;
+}
+
+// One cache line: "model<TAB>cpus kernel lanes batch ring rate ec keccak rng"
+static int tune_parse(const char *line, struct eth_tune_params *p)
+{
+	const char *tab = strchr(line, '\t');
+	if (!tab || (size_t)(tab - line) >= sizeof(p->cpu_model))
+	{
+		return -1;
+	}
+	memset(p, 0, sizeof(*p));
+	memcpy(p->cpu_model, line, (size_t)(tab - line));
+	return sscanf(tab + 1, "%u %15s %u %zu %zu %lf %lf %lf %lf", &p->cpus, p->kernel, &p->lanes, &p->batch,
+		&p->ring_size, &p->rate, &p->ec_rate, &p->keccak_rate, &p->rng_rate) == 9 ? 0 : -1;
+}
+
+static void tune_format(FILE *f, const struct eth_tune_params *p)
+{
+	fprintf(f, "%s\t%u %s %u %zu %zu %.0f %.0f %.0f %.0f\n", p->cpu_model, p->cpus, p->kernel, p->lanes,
+		p->batch, p->ring_size, p->rate, p->ec_rate, p->keccak_rate, p->rng_rate);
+}
+
+static int tune_cache_load(const char *path, const char *model, unsigned int cpus, struct eth_tune_params *params)
+{
+	char line[512];
+	FILE *f = fopen(path, "r");
+	int ret = -1;
+
+	while (f && ret != 0 && fgets(line, sizeof(line), f))
+	{
+		struct eth_tune_params p;
+		if (line[0] != '#' && tune_parse(line, &p) == 0 && strcmp(p.cpu_model, model) == 0 && p.cpus == cpus &&
+			p.lanes > 0 && p.batch > 0 && p.ring_size >= p.batch)
+		{
+			*params = p;
+			ret = 0;
+		}
+	}
+	if (f)
+	{
+		fclose(f);
+	}
+	return ret;
+}
+
+int eth_tune_cached_kernel(char *kernel, size_t size)
+{
+	struct eth_tune_params p;
+	char model[sizeof(p.cpu_model)];
+	char path[4096];
+
+	tune_cpu_model(model, sizeof(model));
+	if (eth_tune_cache_path(path, sizeof(path)) != 0 || tune_cache_load(path, model, eth_online_cpus(), &p) != 0)
+	{
+		return -1;
+	}
+	snprintf(kernel, size, "%s", p.kernel);
+	return 0;
+}
+
+// Replaces this host's entry and keeps everyone else's, through a
+// temporary file renamed into place
+static int tune_cache_store(const char *path, const struct eth_tune_params *params)
+{
+	struct eth_tune_params *entries = calloc(TUNE_MAX_ENTRIES, sizeof(*entries));
+	size_t count = 0;
+	char line[512];
+	int ret = -1;
+
+	if (!entries)
+	{
+		return -1;
+	}
+	FILE *f = fopen(path, "r");
+	while (f && count < TUNE_MAX_ENTRIES - 1 && fgets(line, sizeof(line), f))
+	{
+		if (line[0] != '#' && tune_parse(line, &entries[count]) == 0 &&
+			(strcmp(entries[count].cpu_model, params->cpu_model) != 0 || entries[count].cpus != params->cpus))
+		{
+			count++;
+		}
+	}
+	if (f)
+	{
+		fclose(f);
+	}
+	entries[count++] = *params;
+
+	// Create missing directories on the way, like mkdir -p
+	size_t plen = strlen(path);
+	char *tmp = malloc(plen + 5);
+	if (!tmp)
+	{
+		free(entries);
+		return -1;
+	}
+	memcpy(tmp, path, plen + 1);
+	for (char *slash = strchr(tmp + 1, '/'); slash; slash = strchr(slash + 1, '/'))
+	{
+		*slash = '\0';
+		int made = mkdir(tmp, 0700) == 0 || errno == EEXIST;
+		*slash = '/';
+		if (!made)
+		{
+			goto out;
+		}
+	}
+	memcpy(tmp, path, plen);
+	memcpy(tmp + plen, ".tmp", 5);
+
+	f = fopen(tmp, "w");
+	if (!f)
+	{
+		goto out;
+	}
+	fprintf(f, "%s\n", TUNE_CACHE_MAGIC);
+	for (size_t i = 0; i < count; i++)
+	{
+		tune_format(f, &entries[i]);
+	}
+	ret = fclose(f) == 0 && rename(tmp, path) == 0 ? 0 : -1;
+	if (ret != 0)
+	{
+		unlink(tmp);
+	}
+
+out:
+	free(tmp);
+	free(entries);
+	return ret;
+}
+
+// 32-byte random draws per second, as the pipeline's random stage makes them
+static double tune_rng_rate(void)
+{
+	unsigned char buf[TUNE_BLOCK * ETH_PRIV_KEY_SIZE];
+	double start = tune_now(), elapsed;
+	size_t done = 0;
+
+	do
+	{
+		secure_random(buf, sizeof(buf));
+		done += TUNE_BLOCK;
+	} while ((elapsed = tune_now() - start) < TUNE_STAGE_SECONDS);
+	OPENSSL_cleanse(buf, sizeof(buf));
+	return done / elapsed;
+}
+
+// Public keys per second on one thread
+static double tune_ec_rate(const unsigned char *keys, unsigned char *pubs)
+{
+	secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+	double start = tune_now(), elapsed;
+	size_t done = 0;
+
+	if (!ctx)
+	{
+		return 0;
+	}
+	do
+	{
+		for (size_t i = 0; i < TUNE_BLOCK; i++)
+		{
+			eth_ec_pubkey64(ctx, keys + i * ETH_PRIV_KEY_SIZE, pubs + i * 64);
+		}
+		done += TUNE_BLOCK;
+	} while ((elapsed = tune_now() - start) < TUNE_STAGE_SECONDS);
+	secp256k1_context_destroy(ctx);
+	return done / elapsed;
+}
+
+// Address hashes plus hex encoding per second, best of three runs
+static double tune_keccak_rate(const unsigned char *pubs)
+{
+	unsigned char address[ETH_ADDRESS_SIZE];
+	char hex[2 * ETH_ADDRESS_SIZE];
+	double best = 0;
+
+	for (int run = 0; run < 3; run++)
+	{
+		double start = tune_now(), elapsed;
+		size_t done = 0;
+		do
+		{
+			for (int r = 0; r < 16; r++)
+			{
+				for (size_t i = 0; i < TUNE_BLOCK; i++)
+				{
+					eth_pubkey_to_address(pubs + i * 64, address);
+					eth_hex_encode(address, ETH_ADDRESS_SIZE, hex);
+				}
+			}
+			done += 16 * TUNE_BLOCK;
+		} while ((elapsed = tune_now() - start) < TUNE_STAGE_SECONDS);
+		best = done / elapsed > best ? done / elapsed : best;
+	}
+	return best;
+}
+
+// Rings hold 16 batches, and never fewer records than the pipeline default
+static size_t tune_ring(size_t batch)
+{
+	return batch * 16 > 4096 ? batch * 16 : 4096;
+}
+
+// Wallets per second through the whole pipeline into /dev/null
+static double tune_trial(int fd, size_t count, unsigned int lanes, size_t batch)
+{
+	struct eth_pipeline_config config = {
+		.count = count,
+		.lanes = lanes,
+		.batch = batch,
+		.ring_size = tune_ring(batch),
+		.fd = fd,
+		.format = ETH_OUTPUT_HEX,
+		.pin = 1,
+	};
+	double start = tune_now();
+	if (generate_eth_wallets_pipeline(&config) != 0)
+	{
+		return 0;
+	}
+	return count / (tune_now() - start);
+}
+
+static size_t tune_trial_count(double ec_rate, unsigned int lanes, size_t batch)
+{
+	size_t count = (size_t)(ec_rate * lanes * TUNE_TRIAL_SECONDS);
+	// Enough batches per lane that filling and draining the rings is noise
+	return count > 4 * batch * lanes ? count : 4 * batch * lanes;
+}
+
+static int tune_measure(struct eth_tune_params *params)
+{
+	unsigned char *keys = malloc(TUNE_BLOCK * ETH_PRIV_KEY_SIZE);
+	unsigned char *pubs = malloc(TUNE_BLOCK * 64);
+	int fd = open("/dev/null", O_WRONLY);
+	const char *initial = eth_kernel_name();
+	struct eth_entropy_source source;
+	unsigned long long used;
+	int ret = -1;
+
+	// Pipeline trials draw real keys, which must not eat an entropy source:
+	// they run on the OS RNG and the source is put back afterwards
+	int detached = eth_entropy_detach(&source, &used);
+	if (!keys || !pubs || fd < 0)
+	{
+		goto out;
+	}
+	// Throwaway keys; the installed entropy source is for real ones
+	for (size_t i = 0; i < TUNE_BLOCK; i++)
+	{
+		do
+		{
+			secure_random(keys + i * ETH_PRIV_KEY_SIZE, ETH_PRIV_KEY_SIZE);
+		} while (!secp256k1_ec_seckey_verify(secp256k1_context_static, keys + i * ETH_PRIV_KEY_SIZE));
+	}
+
+	params->rng_rate = tune_rng_rate();
+	params->ec_rate = tune_ec_rate(keys, pubs);
+	if (params->ec_rate <= 0)
+	{
+		goto out;
+	}
+
+	// Kernel variant: the same measurement the library makes when it has
+	// no cache entry, unless WALGEN_KERNEL pinned it
+	const char *best = getenv("WALGEN_KERNEL") ? initial : eth_kernel_measure();
+	eth_kernel_select(best);
+	params->keccak_rate = tune_keccak_rate(pubs);
+	snprintf(params->kernel, sizeof(params->kernel), "%s", best);
+
+	// Batch size at one lane per CPU, then the lane count at that batch.
+	// Ring sizes follow the batch, so they are not searched separately.
+	unsigned int cpus = params->cpus;
+	params->lanes = cpus;
+	params->rate = 0;
+	for (size_t i = 0; i < sizeof(tune_batches) / sizeof(tune_batches[0]); i++)
+	{
+		size_t batch = tune_batches[i];
+		double rate = tune_trial(fd, tune_trial_count(params->ec_rate, cpus, batch), cpus, batch);
+		if (rate > params->rate)
+		{
+			params->rate = rate;
+			params->batch = batch;
+		}
+	}
+	unsigned int lanes[] = {cpus / 3, cpus / 2, (3 * cpus) / 4};
+	for (size_t i = 0; i < sizeof(lanes) / sizeof(lanes[0]); i++)
+	{
+		if (lanes[i] == 0 || lanes[i] == params->lanes || (i > 0 && lanes[i] == lanes[i - 1]))
+		{
+			continue;
+		}
+		double rate = tune_trial(fd, tune_trial_count(params->ec_rate, lanes[i], params->batch), lanes[i],
+			params->batch);
+		// Fewer lanes only win by a clear margin, since they leave cores idle
+		if (rate > params->rate * 1.03)
+		{
+			params->rate = rate;
+			params->lanes = lanes[i];
+		}
+	}
+	params->ring_size = tune_ring(params->batch);
+	ret = params->rate > 0 ? 0 : -1;
+
+out:
+	if (detached)
+	{
+		eth_entropy_attach(&source, used);
+	}
+	if (ret != 0)
+	{
+		eth_kernel_select(initial);
+	}
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+	if (keys)
+	{
+		OPENSSL_cleanse(keys, TUNE_BLOCK * ETH_PRIV_KEY_SIZE);
+	}
+	free(keys);
+	free(pubs);
+	return ret;
+}
+
+int eth_autotune(const char *cache_path, int force, struct eth_tune_params *params)
+{
+	struct eth_tune_params p;
+	char path[4096];
+
+	memset(&p, 0, sizeof(p));
+	tune_cpu_model(p.cpu_model, sizeof(p.cpu_model));
+	p.cpus = eth_online_cpus();
+	if (!cache_path && eth_tune_cache_path(path, sizeof(path)) == 0)
+	{
+		cache_path = path;
+	}
+
+	// A cached kernel this build or CPU cannot run means the entry is stale
+	int hit = !force && cache_path && tune_cache_load(cache_path, p.cpu_model, p.cpus, &p) == 0 &&
+		(getenv("WALGEN_KERNEL") || eth_kernel_select(p.kernel) == 0);
+	if (hit)
+	{
+		p.cached = 1;
+	}
+	else
+	{
+		if (tune_measure(&p) != 0)
+		{
+			return -1;
+		}
+		if (cache_path)
+		{
+			// A read-only cache only costs the next run its tuning time
+			tune_cache_store(cache_path, &p);
+		}
+	}
+	if (getenv("WALGEN_KERNEL"))
+	{
+		snprintf(p.kernel, sizeof(p.kernel), "%s", eth_kernel_name());
+	}
+
+	pthread_mutex_lock(&tune_lock);
+	tune_current = p;
+	tuned = 1;
+	pthread_mutex_unlock(&tune_lock);
+	if (params)
+	{
+		*params = p;
+	}
+	return 0;
+}
+
+int eth_tune_query(struct eth_tune_params *params)
+{
+	pthread_mutex_lock(&tune_lock);
+	int ret = tuned ? 0 : -1;
+	if (tuned && params)
+	{
+		*params = tune_current;
+	}
+	pthread_mutex_unlock(&tune_lock);
+	return ret;
+}
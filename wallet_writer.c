@@ -0,0 +1,651 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <openssl/crypto.h>
+#include "wallet_gen.h"
+#include "wallet_internal.h"
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register)
+#include <linux/io_uring.h>
+#define WRITER_HAVE_URING 1
+#endif
+#endif
+
+#define WRITER_DEFAULT_BUFFER (4 << 20)
+#define WRITER_DEFAULT_DEPTH 8
+// O_DIRECT wants buffers, lengths and offsets on logical-block boundaries
+#define WRITER_ALIGN 4096
+// Most buffers the pwritev thread coalesces into one call
+#define WRITER_MAX_IOV 64
+
+#ifdef WRITER_HAVE_URING
+struct writer_uring
+{
+	int fd;
+	unsigned int *sq_tail;
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;
+	unsigned int *cq_tail;
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_map;
+	size_t sq_map_len;
+	void *cq_map;
+	size_t cq_map_len;
+	size_t sqes_len;
+	int registered; // buffers registered, so writes use WRITE_FIXED
+};
+#endif
+
+struct eth_writer
+{
+	struct eth_writer_config config;
+	int backend;
+	int seekable;
+	off_t offset;             // where the next submitted buffer goes
+	struct eth_huge_buffer mem;
+	size_t *len;              // bytes queued from each buffer
+	unsigned long long seq;   // buffer being filled, counting from 0
+	size_t used;              // bytes in it
+	int acquired;             // its previous write has completed
+	atomic_int failed;
+	struct eth_writer_stats stats;
+	int fd_flags;             // before O_DIRECT was set; -1 once restored
+#ifdef WRITER_HAVE_URING
+	struct writer_uring ring;
+	unsigned char *busy;      // per buffer: write in flight
+	off_t *offsets;           // per buffer: file offset of that write
+	unsigned long long *started; // per buffer: submission time, for latency
+	unsigned int in_flight;
+#endif
+	// pwritev backend: buffers [written, queued) wait for the thread
+	pthread_t thread;
+	int thread_started;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned long long queued;
+	unsigned long long written;
+	int closing;
+};
+
+static unsigned char *writer_buf(struct eth_writer *w, unsigned long long seq)
+{
+	return (unsigned char *)w->mem.data + (seq % w->config.depth) * w->config.buffer_size;
+}
+
+// Plain blocking write of one range, for short-write remainders and the
+// non-seekable case
+static int writer_write_at(struct eth_writer *w, const unsigned char *buf, size_t len, off_t offset)
+{
+	while (len > 0)
+	{
+		ssize_t n = w->seekable ? pwrite(w->config.fd, buf, len, offset) : write(w->config.fd, buf, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		buf += n;
+		len -= (size_t)n;
+		offset += n;
+	}
+	return 0;
+}
+
+#ifdef WRITER_HAVE_URING
+static int uring_enter(int fd, unsigned int submit, unsigned int wait)
+{
+	int ret;
+	do
+	{
+		ret = (int)syscall(__NR_io_uring_enter, fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (ret < 0 && errno == EINTR);
+	return ret;
+}
+
+static void uring_close(struct writer_uring *r)
+{
+	if (r->sqes)
+	{
+		munmap(r->sqes, r->sqes_len);
+	}
+	if (r->cq_map && r->cq_map != r->sq_map)
+	{
+		munmap(r->cq_map, r->cq_map_len);
+	}
+	if (r->sq_map)
+	{
+		munmap(r->sq_map, r->sq_map_len);
+	}
+	if (r->fd >= 0)
+	{
+		close(r->fd);
+	}
+	memset(r, 0, sizeof(*r));
+	r->fd = -1;
+}
+
+// Raw setup without liburing: map the submission and completion rings and
+// register every buffer so the kernel pins them once, not per write
+static int uring_open(struct eth_writer *w)
+{
+	struct writer_uring *r = &w->ring;
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	memset(r, 0, sizeof(*r));
+	r->fd = (int)syscall(__NR_io_uring_setup, w->config.depth, &p);
+	if (r->fd < 0)
+	{
+		r->fd = -1;
+		return -1;
+	}
+
+	r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		r->sq_map_len = r->cq_map_len = r->sq_map_len > r->cq_map_len ? r->sq_map_len : r->cq_map_len;
+	}
+	r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+		IORING_OFF_SQ_RING);
+	if (r->sq_map == MAP_FAILED)
+	{
+		r->sq_map = NULL;
+		uring_close(r);
+		return -1;
+	}
+	r->cq_map = r->sq_map;
+	if (!(p.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+			IORING_OFF_CQ_RING);
+		if (r->cq_map == MAP_FAILED)
+		{
+			r->cq_map = NULL;
+			uring_close(r);
+			return -1;
+		}
+	}
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+	{
+		r->sqes = NULL;
+		uring_close(r);
+		return -1;
+	}
+
+	unsigned char *sq = r->sq_map, *cq = r->cq_map;
+	r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	// Registration counts against RLIMIT_MEMLOCK on older kernels; plain
+	// IORING_OP_WRITE still works without it
+	struct iovec *iov = calloc(w->config.depth, sizeof(*iov));
+	if (iov)
+	{
+		for (unsigned int i = 0; i < w->config.depth; i++)
+		{
+			iov[i].iov_base = writer_buf(w, i);
+			iov[i].iov_len = w->config.buffer_size;
+		}
+		r->registered = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, w->config.depth) == 0;
+		free(iov);
+	}
+	return 0;
+}
+
+// Handles every completion that is ready, waiting for at least one if `wait`
+static void uring_reap(struct eth_writer *w, int wait)
+{
+	struct writer_uring *r = &w->ring;
+	if (wait && uring_enter(r->fd, 0, 1) < 0)
+	{
+		atomic_store(&w->failed, 1);
+		return;
+	}
+	unsigned int head = *r->cq_head;
+	unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++)
+	{
+		const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		unsigned int i = (unsigned int)cqe->user_data;
+		size_t len = w->len[i];
+		if (cqe->res < 0)
+		{
+			atomic_store(&w->failed, 1);
+		}
+		else if ((size_t)cqe->res < len)
+		{
+			// Short write (disk full, signal): finish it synchronously
+			unsigned char *buf = (unsigned char *)w->mem.data + (size_t)i * w->config.buffer_size;
+			if (writer_write_at(w, buf + cqe->res, len - (size_t)cqe->res, w->offsets[i] + cqe->res) != 0)
+			{
+				atomic_store(&w->failed, 1);
+			}
+		}
+		w->busy[i] = 0;
+		w->in_flight--;
+		eth_latency_end(ETH_LATENCY_FLUSH, w->started[i]);
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void uring_submit(struct eth_writer *w, unsigned int i, size_t len)
+{
+	struct writer_uring *r = &w->ring;
+	unsigned int tail = *r->sq_tail;
+	unsigned int idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = r->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = w->config.fd;
+	sqe->addr = (unsigned long long)(uintptr_t)((unsigned char *)w->mem.data + (size_t)i * w->config.buffer_size);
+	sqe->len = (unsigned int)len;
+	sqe->off = (unsigned long long)w->offset;
+	sqe->buf_index = (unsigned short)i;
+	sqe->user_data = i;
+	r->sq_array[idx] = idx;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	w->busy[i] = 1;
+	w->offsets[i] = w->offset;
+	w->started[i] = eth_latency_start();
+	if (++w->in_flight > w->stats.max_in_flight)
+	{
+		w->stats.max_in_flight = w->in_flight;
+	}
+	if (uring_enter(r->fd, 1, 0) < 0)
+	{
+		atomic_store(&w->failed, 1);
+		w->busy[i] = 0;
+		w->in_flight--;
+	}
+	w->stats.writes++;
+}
+#endif
+
+// pwritev backend: one thread writes every queued buffer in order,
+// coalescing consecutive ones into a single call
+static void *writer_thread_main(void *arg)
+{
+	struct eth_writer *w = arg;
+	struct iovec iov[WRITER_MAX_IOV];
+	off_t offset = w->offset;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;)
+	{
+		while (w->written == w->queued && !w->closing)
+		{
+			pthread_cond_wait(&w->cond, &w->lock);
+		}
+		if (w->written == w->queued)
+		{
+			break;
+		}
+		unsigned long long first = w->written;
+		unsigned long long last = w->queued;
+		pthread_mutex_unlock(&w->lock);
+
+		int n = 0;
+		for (unsigned long long s = first; s < last && n < WRITER_MAX_IOV; s++, n++)
+		{
+			iov[n].iov_base = writer_buf(w, s);
+			iov[n].iov_len = w->len[s % w->config.depth];
+		}
+		struct iovec *v = iov;
+		int left = n;
+		unsigned long long start = eth_latency_start();
+		while (left > 0 && !atomic_load(&w->failed))
+		{
+			ssize_t done = w->seekable ? pwritev(w->config.fd, v, left, offset) : writev(w->config.fd, v, left);
+			if (done < 0)
+			{
+				if (errno != EINTR)
+				{
+					atomic_store(&w->failed, 1);
+				}
+				continue;
+			}
+			offset += done;
+			while (left > 0 && (size_t)done >= v->iov_len)
+			{
+				done -= (ssize_t)v->iov_len;
+				v++;
+				left--;
+			}
+			if (left > 0)
+			{
+				v->iov_base = (unsigned char *)v->iov_base + done;
+				v->iov_len -= (size_t)done;
+			}
+		}
+
+		eth_latency_end(ETH_LATENCY_FLUSH, start);
+
+		pthread_mutex_lock(&w->lock);
+		w->written = first + (unsigned long long)n;
+		w->stats.writes++;
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+struct eth_writer *eth_writer_create(const struct eth_writer_config *config)
+{
+	if (!config || config->fd < 0 || config->backend < ETH_WRITER_AUTO || config->backend > ETH_WRITER_PWRITEV)
+	{
+		return NULL;
+	}
+	struct eth_writer *w = calloc(1, sizeof(*w));
+	if (!w)
+	{
+		return NULL;
+	}
+	w->config = *config;
+	if (w->config.buffer_size == 0)
+	{
+		w->config.buffer_size = WRITER_DEFAULT_BUFFER;
+	}
+	w->config.buffer_size = (w->config.buffer_size + WRITER_ALIGN - 1) & ~(size_t)(WRITER_ALIGN - 1);
+	if (w->config.depth < 2)
+	{
+		w->config.depth = config->depth ? 2 : WRITER_DEFAULT_DEPTH;
+	}
+	atomic_init(&w->failed, 0);
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->fd_flags = -1;
+#ifdef WRITER_HAVE_URING
+	w->ring.fd = -1;
+#endif
+
+	w->offset = lseek(config->fd, 0, SEEK_CUR);
+	w->seekable = w->offset >= 0;
+	if (!w->seekable)
+	{
+		w->offset = 0;
+	}
+	w->len = calloc(w->config.depth, sizeof(*w->len));
+	// Page-aligned (huge pages if enabled), as O_DIRECT needs
+	if (!w->len || eth_huge_alloc(&w->mem, w->config.depth * w->config.buffer_size) != 0)
+	{
+		eth_writer_free(w);
+		return NULL;
+	}
+
+	if (config->direct && w->seekable && w->offset % WRITER_ALIGN == 0)
+	{
+#ifdef O_DIRECT
+		int flags = fcntl(config->fd, F_GETFL);
+		// tmpfs and some others refuse O_DIRECT; writes stay buffered there
+		w->stats.direct = flags >= 0 && fcntl(config->fd, F_SETFL, flags | O_DIRECT) == 0;
+		w->fd_flags = w->stats.direct ? flags : -1;
+#endif
+	}
+
+	// Completions may arrive out of order, which is only safe with explicit
+	// offsets: pipes and sockets go through the ordered pwritev thread
+	w->backend = ETH_WRITER_PWRITEV;
+#ifdef WRITER_HAVE_URING
+	if (config->backend != ETH_WRITER_PWRITEV && w->seekable)
+	{
+		w->busy = calloc(w->config.depth, 1);
+		w->offsets = calloc(w->config.depth, sizeof(*w->offsets));
+		w->started = calloc(w->config.depth, sizeof(*w->started));
+		if (w->busy && w->offsets && w->started && uring_open(w) == 0)
+		{
+			w->backend = ETH_WRITER_URING;
+		}
+	}
+#endif
+	if (w->backend != ETH_WRITER_URING && config->backend == ETH_WRITER_URING)
+	{
+		eth_writer_free(w);
+		return NULL;
+	}
+	if (w->backend == ETH_WRITER_PWRITEV)
+	{
+		if (pthread_create(&w->thread, NULL, writer_thread_main, w) != 0)
+		{
+			eth_writer_free(w);
+			return NULL;
+		}
+		w->thread_started = 1;
+	}
+	return w;
+}
+
+// Waits until the buffer for w->seq has been written out
+static void writer_acquire(struct eth_writer *w)
+{
+#ifdef WRITER_HAVE_URING
+	if (w->backend == ETH_WRITER_URING)
+	{
+		unsigned int i = (unsigned int)(w->seq % w->config.depth);
+		if (w->busy[i])
+		{
+			w->stats.stalls++;
+		}
+		while (w->busy[i] && !atomic_load(&w->failed))
+		{
+			uring_reap(w, 1);
+		}
+		w->acquired = 1;
+		return;
+	}
+#endif
+	pthread_mutex_lock(&w->lock);
+	if (w->seq - w->written >= w->config.depth)
+	{
+		w->stats.stalls++;
+	}
+	while (w->seq - w->written >= w->config.depth)
+	{
+		pthread_cond_wait(&w->cond, &w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+	w->acquired = 1;
+}
+
+static void writer_submit(struct eth_writer *w)
+{
+	unsigned int i = (unsigned int)(w->seq % w->config.depth);
+	w->len[i] = w->used;
+	w->stats.bytes += w->used;
+#ifdef WRITER_HAVE_URING
+	if (w->backend == ETH_WRITER_URING)
+	{
+		uring_submit(w, i, w->used);
+		// Free whatever finished meanwhile without blocking
+		uring_reap(w, 0);
+	}
+	else
+#endif
+	{
+		pthread_mutex_lock(&w->lock);
+		w->queued = w->seq + 1;
+		if (w->queued - w->written > w->stats.max_in_flight)
+		{
+			w->stats.max_in_flight = (unsigned int)(w->queued - w->written);
+		}
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+	w->offset += (off_t)w->used;
+	w->seq++;
+	w->used = 0;
+	w->acquired = 0;
+}
+
+size_t eth_writer_reserve(struct eth_writer *w, unsigned char **space)
+{
+	if (!w->acquired)
+	{
+		writer_acquire(w);
+	}
+	*space = writer_buf(w, w->seq) + w->used;
+	return w->config.buffer_size - w->used;
+}
+
+int eth_writer_commit(struct eth_writer *w, size_t len)
+{
+	w->used += len;
+	if (w->used >= w->config.buffer_size)
+	{
+		writer_submit(w);
+	}
+	return atomic_load(&w->failed) ? -1 : 0;
+}
+
+int eth_writer_write(struct eth_writer *w, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	while (len > 0)
+	{
+		unsigned char *space;
+		size_t n = eth_writer_reserve(w, &space);
+		if (n > len)
+		{
+			n = len;
+		}
+		memcpy(space, p, n);
+		p += n;
+		len -= n;
+		if (eth_writer_commit(w, n) != 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+// Everything submitted so far has completed
+static void writer_drain(struct eth_writer *w)
+{
+#ifdef WRITER_HAVE_URING
+	if (w->backend == ETH_WRITER_URING)
+	{
+		while (w->in_flight > 0 && !atomic_load(&w->failed))
+		{
+			uring_reap(w, 1);
+		}
+		return;
+	}
+#endif
+	pthread_mutex_lock(&w->lock);
+	while (w->written != w->queued)
+	{
+		pthread_cond_wait(&w->cond, &w->lock);
+	}
+	pthread_mutex_unlock(&w->lock);
+}
+
+static int writer_restore_flags(struct eth_writer *w)
+{
+	int ret = w->fd_flags < 0 || fcntl(w->config.fd, F_SETFL, w->fd_flags) == 0 ? 0 : -1;
+	w->fd_flags = -1;
+	return ret;
+}
+
+int eth_writer_finish(struct eth_writer *w)
+{
+	if (!w)
+	{
+		return -1;
+	}
+	// The fd goes back to the flags the caller opened it with; a partial
+	// last buffer is not block-sized, so it goes out buffered anyway
+	if (w->fd_flags >= 0)
+	{
+		writer_drain(w);
+		if (writer_restore_flags(w) != 0)
+		{
+			atomic_store(&w->failed, 1);
+		}
+	}
+	if (w->used > 0)
+	{
+		writer_submit(w);
+	}
+	writer_drain(w);
+	return atomic_load(&w->failed) ? -1 : 0;
+}
+
+void eth_writer_stats(const struct eth_writer *w, struct eth_writer_stats *stats)
+{
+	*stats = w->stats;
+}
+
+const char *eth_writer_backend(const struct eth_writer *w)
+{
+#ifdef WRITER_HAVE_URING
+	if (w->backend == ETH_WRITER_URING)
+	{
+		return w->ring.registered ? "io_uring (registered buffers)" : "io_uring";
+	}
+#endif
+	return "pwritev";
+}
+
+void eth_writer_free(struct eth_writer *w)
+{
+	if (!w)
+	{
+		return;
+	}
+	if (w->thread_started)
+	{
+		pthread_mutex_lock(&w->lock);
+		w->closing = 1;
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+		pthread_join(w->thread, NULL);
+	}
+#ifdef WRITER_HAVE_URING
+	if (w->backend == ETH_WRITER_URING)
+	{
+		writer_drain(w);
+	}
+	if (w->ring.fd >= 0)
+	{
+		uring_close(&w->ring);
+	}
+	free(w->busy);
+	free(w->offsets);
+	free(w->started);
+#endif
+	// Freed without finishing: the fd still must not stay O_DIRECT
+	writer_restore_flags(w);
+	if (w->mem.data)
+	{
+		OPENSSL_cleanse(w->mem.data, w->mem.size);
+		eth_huge_free(&w->mem);
+	}
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+	free(w->len);
+	free(w);
+}